@@ -0,0 +1,43 @@
+#!/usr/bin/env ruby
+# Compares two bench/run.rb result files and exits non-zero when any
+# backend/metric pair got slower than the threshold.
+#
+#   ruby bench/compare.rb baseline.json current.json [--threshold 10]
+
+require 'json'
+require 'optparse'
+
+threshold = 10.0
+OptionParser.new do |opts|
+  opts.banner = "Usage: compare.rb BASELINE CURRENT [--threshold PERCENT]"
+  opts.on("--threshold PERCENT", Float, "Allowed slowdown in percent") { |v| threshold = v }
+end.parse!
+
+abort "Usage: compare.rb BASELINE CURRENT [--threshold PERCENT]" unless ARGV.size == 2
+
+def index(path)
+  JSON.parse(File.read(path))["results"].to_h { |r| [[r["backend"], r["metric"]], r] }
+end
+
+baseline = index(ARGV[0])
+current = index(ARGV[1])
+regressions = 0
+
+puts format("%-8s %-13s %14s %14s %9s", "backend", "metric", "baseline", "current", "change")
+(baseline.keys & current.keys).sort.each do |key|
+  old_rate = baseline[key]["rate"].to_f
+  new_rate = current[key]["rate"].to_f
+  next if old_rate.zero?
+
+  change = (new_rate - old_rate) / old_rate * 100
+  mark = change < -threshold ? "❌" : ""
+  regressions += 1 unless mark.empty?
+  puts format("%-8s %-13s %14.2f %14.2f %8.1f%% %s", *key, old_rate, new_rate, change, mark)
+end
+
+if regressions > 0
+  puts "\n❌ #{regressions} metric(s) regressed by more than #{threshold}%"
+  exit 1
+end
+
+puts "\n✅ No regressions above #{threshold}%"
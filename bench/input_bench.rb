@@ -0,0 +1,60 @@
+#!/usr/bin/env ruby
+# Input handling benchmark: XTEST injects motion, button and key events
+# into a window at fixed rates and the wrapper's event loop handles them.
+# Prints one JSON object per rate, in the ruby_bench.rb format:
+#
+#   ruby bench/input_bench.rb [--scale 1.0] [--rates 1000,5000,20000]
+#
+# Expects DISPLAY to point at a private server (bench/run.rb starts Xvfb):
+# the injected input moves that server's pointer and keyboard.
+
+require 'json'
+require 'optparse'
+require_relative '../lib/xcb_wrapper'
+begin
+  require_relative '../lib/xcb/input_load'
+rescue LoadError => e
+  warn "⚠️  input benchmark skipped: #{e.message}"
+  exit 0
+end
+
+options = { scale: 1.0, rates: [1_000, 5_000, 20_000] }
+OptionParser.new do |opts|
+  opts.banner = "Usage: input_bench.rb [--scale N] [--rates LIST]"
+  opts.on("--scale N", Float, "Multiply the event count") { |v| options[:scale] = v }
+  opts.on("--rates LIST", Array, "Injection rates in events/s") { |v| options[:rates] = v.map(&:to_i) }
+end.parse!
+
+conn = XCB::Connection.new
+unless conn.extension(XCB::XTest::ID)
+  warn "⚠️  input benchmark skipped: no XTEST extension"
+  exit 0
+end
+
+window = conn.default_screen.create_window(x: 0, y: 0, width: 640, height: 480, border_width: 0,
+                                           events: [:exposure])
+count = [(20_000 * options[:scale]).to_i, 10].max
+handled = 0
+
+begin
+  options[:rates].each do |rate|
+    report = XCB::InputLoad.new(window, rate: rate, count: count).run do |event|
+      # Stand-in for application work: decode what a handler would read
+      case event.type
+      when :motion_notify then handled += event.x + event.y
+      when :button_press, :button_release then handled += event.button
+      when :key_press, :key_release then handled += event.key_code
+      end
+    end
+
+    latency = report[:latency_us] || {}
+    result = { backend: "wrapper", metric: "input_#{rate}", ops: report[:received],
+               seconds: report[:seconds], rate: report[:throughput], unit: "events/s",
+               injected: report[:injected], coalesced: report[:coalesced], dropped: report[:dropped],
+               injection_rate: report[:injection_rate],
+               mean_us: latency[:mean], p50_us: latency[:p50], p99_us: latency[:p99], max_us: latency[:max] }
+    puts JSON.generate(result)
+  end
+ensure
+  conn.close
+end
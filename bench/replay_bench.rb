@@ -0,0 +1,37 @@
+#!/usr/bin/env ruby
+# Replays recorded sessions (XCB_RECORD=file ruby app.rb) into the
+# server at DISPLAY and prints one JSON object per log, in the
+# ruby_bench.rb format:
+#
+#   ruby bench/replay_bench.rb [--speed N] paint.xrec.gz browser.xrec.gz
+#
+# Without --speed the requests go out as fast as the server takes them;
+# --speed 1 keeps the recorded pace (latency under the real load).
+
+require 'json'
+require 'optparse'
+require_relative '../lib/xcb_wrapper'
+require_relative '../lib/xcb/recording'
+
+options = { speed: nil }
+OptionParser.new do |opts|
+  opts.banner = "Usage: replay_bench.rb [--speed N] LOG..."
+  opts.on("--speed N", Float, "Replay at N times the recorded pace") { |v| options[:speed] = v }
+end.parse!
+
+abort "No recordings given" if ARGV.empty?
+
+ARGV.each do |path|
+  report = XCB::Recording::Replayer.new(path, display: ENV['DISPLAY'], speed: options[:speed]).run
+  warn "⚠️  #{path}: server did not finish the stream" unless report[:completed]
+
+  latency = report[:latency_us] || {}
+  name = File.basename(path).sub(/\.xrec(\.gz)?\z/, "")
+  result = { backend: "replay", metric: "replay_#{name}", ops: report[:requests],
+             seconds: report[:seconds], rate: report[:requests_per_second], unit: "requests/s",
+             mb_per_s: report[:megabytes_per_second], recorded_seconds: report[:recorded_seconds],
+             skipped: report[:skipped], unmapped: report[:unmapped], replies: report[:replies], errors: report[:errors],
+             events: report[:events], recorded_events: report[:recorded_events],
+             mean_us: latency[:mean], p50_us: latency[:p50], p99_us: latency[:p99], max_us: latency[:max] }
+  puts JSON.generate(result)
+end
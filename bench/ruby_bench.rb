@@ -0,0 +1,306 @@
+#!/usr/bin/env ruby
+# Ruby side of the benchmark suite. Runs every workload through one backend
+# and prints one JSON object per metric to stdout:
+#
+#   ruby bench/ruby_bench.rb --backend wrapper|ffi [--scale 1.0]
+#
+# Expects DISPLAY to point at a server (bench/run.rb starts a private Xvfb).
+
+require 'json'
+require 'optparse'
+require_relative '../lib/xcb_wrapper'
+
+module XCB
+  module Bench
+    WIDTH = 640
+    HEIGHT = 480
+    TEXT = "The quick brown fox jumps over the lazy dog".freeze
+    IMAGE_SIDE = 256
+    EVENT_BATCH = 500
+
+    # Measures the same workloads for any backend
+    class Runner
+      def initialize(backend, scale: 1.0)
+        @backend = backend
+        @scale = scale
+      end
+
+      def run
+        results = []
+        results << primitive(:points, 20_000) { |i| @backend.draw_point(i % WIDTH, i % HEIGHT) }
+        results << primitive(:lines, 20_000) { |i| @backend.draw_line(0, i % HEIGHT, WIDTH - 1, HEIGHT - 1 - i % HEIGHT) }
+        results << primitive(:rects, 20_000) { |i| @backend.fill_rectangle(i % WIDTH, i % HEIGHT, 16, 16) }
+        results << primitive(:text, 10_000) { |i| @backend.draw_text(4, 12 + i % (HEIGHT - 12), TEXT) }
+        results << events(20_000)
+        results << roundtrip(2_000)
+        results << image_upload(200)
+        results
+      end
+
+      private
+
+      def count(base)
+        [(base * @scale).to_i, 1].max
+      end
+
+      def measure
+        start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        yield
+        Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+      end
+
+      def result(metric, ops, seconds, rate, unit, extra = {})
+        { backend: @backend.name, metric: metric, ops: ops,
+          seconds: seconds.round(6), rate: rate.round(2), unit: unit }.merge(extra)
+      end
+
+      # Primitive throughput includes the final round trip, so the server
+      # has actually executed every request when the clock stops
+      def primitive(metric, base)
+        ops = count(base)
+        @backend.sync
+        seconds = measure do
+          ops.times { |i| yield i }
+          @backend.sync
+        end
+        result(metric, ops, seconds, ops / seconds, "ops/s")
+      end
+
+      # Client messages sent to our own window, drained through the
+      # backend's blocking event wait
+      def events(base)
+        ops = count(base)
+        @backend.sync
+        @backend.drain_events
+        seconds = measure do
+          remaining = ops
+          while remaining > 0
+            batch = [remaining, EVENT_BATCH].min
+            @backend.send_client_messages(batch)
+            batch.times { @backend.wait_for_event }
+            remaining -= batch
+          end
+        end
+        result(:events, ops, seconds, ops / seconds, "events/s")
+      end
+
+      def roundtrip(base)
+        ops = count(base)
+        samples = Array.new(ops) { measure { @backend.sync } }
+        samples.sort!
+        mean = samples.sum / ops
+        result(:roundtrip, ops, samples.sum, 1.0 / mean, "roundtrips/s",
+               mean_us: (mean * 1e6).round(2),
+               p50_us: (samples[ops / 2] * 1e6).round(2),
+               p99_us: (samples[(ops * 0.99).floor.clamp(0, ops - 1)] * 1e6).round(2))
+      end
+
+      def image_upload(base)
+        ops = count(base)
+        data = Random.new(42).bytes(IMAGE_SIDE * IMAGE_SIDE * 4)
+        @backend.sync
+        seconds = measure do
+          ops.times { @backend.put_image(data, IMAGE_SIDE, IMAGE_SIDE) }
+          @backend.sync
+        end
+        megabytes = data.bytesize * ops / (1024.0 * 1024.0)
+        result(:image_upload, ops, seconds, megabytes / seconds, "MB/s", bytes: data.bytesize * ops)
+      end
+    end
+
+    # High-level wrapper: every call goes through Window/GraphicsContext
+    # exactly as application code would use it
+    class WrapperBackend
+      def name
+        "wrapper"
+      end
+
+      def initialize
+        @conn = XCB::Connection.new
+        @window = @conn.default_screen.create_window(width: WIDTH, height: HEIGHT, events: [:exposure])
+        @window.show
+        @font = XCB::Font.fixed(@conn)
+        @gc = @window.create_graphics_context(foreground: :black, font: @font)
+        @pixmap = XCB::Pixmap.new(@conn, @window.window_id, IMAGE_SIDE, IMAGE_SIDE)
+        @pixmap_gc = @pixmap.create_graphics_context
+        @message = client_message(@window.window_id)
+      end
+
+      def draw_point(x, y)
+        @gc.draw_point(x, y)
+      end
+
+      def draw_line(x1, y1, x2, y2)
+        @gc.draw_line(x1, y1, x2, y2)
+      end
+
+      def fill_rectangle(x, y, width, height)
+        @gc.fill_rectangle(x, y, width, height)
+      end
+
+      def draw_text(x, y, text)
+        @gc.draw_text(x, y, text)
+      end
+
+      def put_image(data, width, height)
+        @pixmap_gc.put_image(0, 0, width, height, data)
+      end
+
+      def sync
+        @conn.sync
+      end
+
+      def send_client_messages(count)
+        count.times { XCB.xcb_send_event(@conn.connection, 0, @window.window_id, 0, @message) }
+        @conn.flush
+      end
+
+      def wait_for_event
+        @conn.wait_for_event
+      end
+
+      def drain_events
+        nil while @conn.poll_for_event
+      end
+
+      def close
+        @conn.close
+      end
+
+      private
+
+      def client_message(window_id)
+        [XCB::XCB_CLIENT_MESSAGE, 32, 0, window_id, 0].pack("CCSLL") + ("\0" * 20)
+      end
+    end
+
+    # Raw FFI: direct XCB.xcb_* calls, one flush per sync point
+    class FFIBackend
+      def name
+        "ffi"
+      end
+
+      def initialize
+        @conn = XCB.xcb_connect(nil, nil)
+        raise XCB::XCBError, "Failed to connect to X server" if XCB.xcb_connection_has_error(@conn) != 0
+
+        setup = XCB.xcb_get_setup(@conn)
+        screen = XCB::Screen.new(XCB.xcb_setup_roots_iterator(setup)[:data])
+        @depth = screen[:root_depth]
+
+        @window = XCB.xcb_generate_id(@conn)
+        values = FFI::MemoryPointer.new(:uint32, 2)
+        values.write_array_of_uint32([screen[:white_pixel], XCB::XCB_EVENT_MASK_EXPOSURE])
+        XCB.xcb_create_window(@conn, XCB::XCB_COPY_FROM_PARENT, @window, screen[:root],
+                              0, 0, WIDTH, HEIGHT, 1, XCB::XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                              screen[:root_visual], XCB::XCB_CW_BACK_PIXEL | XCB::XCB_CW_EVENT_MASK, values)
+        XCB.xcb_map_window(@conn, @window)
+
+        @font = XCB.xcb_generate_id(@conn)
+        XCB.xcb_open_font(@conn, @font, 5, "fixed")
+
+        @gc = XCB.xcb_generate_id(@conn)
+        gc_values = FFI::MemoryPointer.new(:uint32, 2)
+        gc_values.write_array_of_uint32([screen[:black_pixel], @font])
+        XCB.xcb_create_gc(@conn, @gc, @window, XCB::XCB_GC_FOREGROUND | XCB::XCB_GC_FONT, gc_values)
+
+        @pixmap = XCB.xcb_generate_id(@conn)
+        XCB.xcb_create_pixmap(@conn, @depth, @pixmap, @window, IMAGE_SIDE, IMAGE_SIDE)
+        @pixmap_gc = XCB.xcb_generate_id(@conn)
+        XCB.xcb_create_gc(@conn, @pixmap_gc, @pixmap, 0, nil)
+        XCB.xcb_flush(@conn)
+
+        @point = XCB::Point.new
+        @segment = FFI::MemoryPointer.new(XCB::Point, 2)
+        @rect = XCB::Rectangle.new
+        @message = [XCB::XCB_CLIENT_MESSAGE, 32, 0, @window, 0].pack("CCSLL") + ("\0" * 20)
+        @max_request = XCB.xcb_get_maximum_request_length(@conn) * 4
+      end
+
+      def draw_point(x, y)
+        @point[:x] = x
+        @point[:y] = y
+        XCB.xcb_poly_point(@conn, XCB::XCB_COORD_MODE_ORIGIN, @window, @gc, 1, @point)
+      end
+
+      def draw_line(x1, y1, x2, y2)
+        @segment.put_array_of_int16(0, [x1, y1, x2, y2])
+        XCB.xcb_poly_line(@conn, XCB::XCB_COORD_MODE_ORIGIN, @window, @gc, 2, @segment)
+      end
+
+      def fill_rectangle(x, y, width, height)
+        @rect[:x] = x
+        @rect[:y] = y
+        @rect[:width] = width
+        @rect[:height] = height
+        XCB.xcb_poly_fill_rectangle(@conn, @window, @gc, 1, @rect)
+      end
+
+      def draw_text(x, y, text)
+        XCB.xcb_image_text_8(@conn, text.bytesize, @window, @gc, x, y, text)
+      end
+
+      def put_image(data, width, height)
+        stride = width * 4
+        rows_per_request = [(@max_request - 32) / stride, 1].max
+        row = 0
+        while row < height
+          rows = [rows_per_request, height - row].min
+          XCB.xcb_put_image(@conn, XCB::XCB_IMAGE_FORMAT_Z_PIXMAP, @pixmap, @pixmap_gc,
+                            width, rows, 0, row, 0, @depth, stride * rows,
+                            data.byteslice(stride * row, stride * rows))
+          row += rows
+        end
+      end
+
+      def sync
+        cookie = XCB.xcb_get_input_focus(@conn)
+        reply = XCB.xcb_get_input_focus_reply(@conn, cookie, nil)
+        XCB::LibC.free(reply) unless reply.null?
+      end
+
+      def send_client_messages(count)
+        count.times { XCB.xcb_send_event(@conn, 0, @window, 0, @message) }
+        XCB.xcb_flush(@conn)
+      end
+
+      def wait_for_event
+        event = XCB.xcb_wait_for_event(@conn)
+        XCB::LibC.free(event) unless event.null?
+      end
+
+      def drain_events
+        until (event = XCB.xcb_poll_for_event(@conn)).null?
+          XCB::LibC.free(event)
+        end
+      end
+
+      def close
+        XCB.xcb_disconnect(@conn)
+      end
+    end
+
+    BACKENDS = {
+      "wrapper" => WrapperBackend,
+      "ffi" => FFIBackend
+    }.freeze
+  end
+end
+
+if __FILE__ == $0
+  options = { backend: "wrapper", scale: 1.0 }
+  OptionParser.new do |opts|
+    opts.banner = "Usage: ruby_bench.rb --backend wrapper|ffi [--scale N]"
+    opts.on("--backend NAME", XCB::Bench::BACKENDS.keys) { |v| options[:backend] = v }
+    opts.on("--scale N", Float, "Multiply every iteration count") { |v| options[:scale] = v }
+  end.parse!
+
+  backend = XCB::Bench::BACKENDS.fetch(options[:backend]).new
+  begin
+    XCB::Bench::Runner.new(backend, scale: options[:scale]).run.each do |result|
+      puts JSON.generate(result)
+    end
+  ensure
+    backend.close
+  end
+end
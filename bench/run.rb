@@ -0,0 +1,106 @@
+#!/usr/bin/env ruby
+# Benchmark suite entry point. Starts a private Xvfb, runs every workload
+# through the wrapper, raw FFI and C reference backends, and writes a single
+# JSON document that bench/compare.rb can diff between releases.
+#
+#   ruby bench/run.rb [--backends wrapper,ffi,c,input] [--scale 1.0] [--output FILE]
+#                     [--replay LOG,...]
+
+require 'json'
+require 'open3'
+require 'optparse'
+require 'rbconfig'
+require 'socket'
+require 'time'
+require 'tmpdir'
+require_relative 'xvfb'
+
+ROOT = File.expand_path('..', __dir__)
+C_SOURCE = File.join(ROOT, 'c_examples', 'bench_xcb.c')
+
+options = {
+  backends: %w[wrapper ffi c input],
+  scale: 1.0,
+  output: nil,
+  geometry: "1280x1024x24",
+  display: nil,
+  replay: []
+}
+
+OptionParser.new do |opts|
+  opts.banner = "Usage: run.rb [options]"
+  opts.on("--backends LIST", Array, "Backends to run (wrapper,ffi,c,input)") { |v| options[:backends] = v }
+  opts.on("--scale N", Float, "Multiply every iteration count") { |v| options[:scale] = v }
+  opts.on("--output FILE", "Write JSON here instead of stdout") { |v| options[:output] = v }
+  opts.on("--geometry WxHxD", "Xvfb screen geometry") { |v| options[:geometry] = v }
+  opts.on("--display NAME", "Use this display number for Xvfb") { |v| options[:display] = v }
+  opts.on("--replay LIST", Array, "Also replay these recorded sessions") { |v| options[:replay] = v }
+end.parse!
+
+def build_c_reference(dir)
+  binary = File.join(dir, 'bench_xcb')
+  _out, err, status = Open3.capture3("cc", "-O2", "-o", binary, C_SOURCE, "-lxcb")
+  raise XCB::Bench::Error, "Failed to build C reference:\n#{err}" unless status.success?
+
+  binary
+end
+
+def run_backend(command, env)
+  out, err, status = Open3.capture3(env, *command)
+  raise XCB::Bench::Error, "#{command.join(' ')} failed:\n#{err}" unless status.success?
+
+  out.each_line.map { |line| JSON.parse(line) }
+end
+
+def git_revision
+  out, status = Open3.capture2("git", "-C", ROOT, "rev-parse", "--short", "HEAD")
+  status.success? ? out.strip : nil
+rescue Errno::ENOENT
+  nil
+end
+
+results = []
+
+Dir.mktmpdir("xcb-bench") do |dir|
+  commands = options[:backends].map do |backend|
+    case backend
+    when "wrapper", "ffi"
+      [RbConfig.ruby, File.join(__dir__, 'ruby_bench.rb'), "--backend", backend, "--scale", options[:scale].to_s]
+    when "c"
+      [build_c_reference(dir), options[:scale].to_s]
+    when "input"
+      [RbConfig.ruby, File.join(__dir__, 'input_bench.rb'), "--scale", options[:scale].to_s]
+    else
+      abort "Unknown backend: #{backend}"
+    end
+  end
+  unless options[:replay].empty?
+    commands << [RbConfig.ruby, File.join(__dir__, 'replay_bench.rb'), *options[:replay].map { |log| File.expand_path(log) }]
+  end
+
+  XCB::Bench::Xvfb.run(geometry: options[:geometry], display: options[:display]) do |xvfb|
+    commands.each do |command|
+      warn "⏱️  #{command.first(3).map { |c| File.basename(c) }.join(' ')}"
+      results.concat(run_backend(command, xvfb.env))
+    end
+  end
+end
+
+document = {
+  version: File.read(File.join(ROOT, 'VERSION')).strip,
+  revision: git_revision,
+  ruby: RUBY_DESCRIPTION,
+  host: Socket.gethostname,
+  timestamp: Time.now.utc.iso8601,
+  geometry: options[:geometry],
+  scale: options[:scale],
+  results: results
+}
+
+json = JSON.pretty_generate(document)
+if options[:output]
+  File.write(options[:output], json + "\n")
+  warn "✅ Results written to #{options[:output]}"
+else
+  puts json
+end
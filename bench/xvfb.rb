@@ -0,0 +1,75 @@
+require 'fileutils'
+require 'timeout'
+
+module XCB
+  module Bench
+    # Private headless X server for benchmark runs
+    class Xvfb
+      attr_reader :display, :geometry
+
+      SOCKET_DIR = "/tmp/.X11-unix".freeze
+
+      def initialize(geometry: "1280x1024x24", display: nil, binary: "Xvfb")
+        @geometry = geometry
+        @display = display || free_display
+        @binary = binary
+        @pid = nil
+      end
+
+      def start(timeout: 10)
+        @pid = Process.spawn(@binary, @display, "-screen", "0", @geometry,
+                             "-nolisten", "tcp", "-noreset",
+                             out: File::NULL, err: File::NULL)
+
+        Timeout.timeout(timeout) do
+          sleep 0.05 until File.exist?(socket_path)
+        end
+        self
+      rescue Timeout::Error
+        stop
+        raise Error, "Xvfb #{@display} did not come up within #{timeout}s"
+      end
+
+      def stop
+        return unless @pid
+
+        Process.kill("TERM", @pid) rescue nil
+        Process.wait(@pid) rescue nil
+        @pid = nil
+      end
+
+      def running?
+        !@pid.nil?
+      end
+
+      # Start a server for the duration of the block
+      def self.run(**options)
+        server = new(**options).start
+        yield server
+      ensure
+        server&.stop
+      end
+
+      def env
+        { "DISPLAY" => @display }
+      end
+
+      private
+
+      def socket_path
+        File.join(SOCKET_DIR, "X#{@display.delete(':')}")
+      end
+
+      def free_display
+        number = (90..199).find do |n|
+          !File.exist?("/tmp/.X#{n}-lock") && !File.exist?(File.join(SOCKET_DIR, "X#{n}"))
+        end
+        raise Error, "No free X display number" unless number
+
+        ":#{number}"
+      end
+    end
+
+    class Error < StandardError; end
+  end
+end
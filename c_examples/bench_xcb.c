@@ -0,0 +1,231 @@
+/*
+ * C reference for the benchmark suite (bench/run.rb).
+ * Runs the same workloads as bench/ruby_bench.rb directly against libxcb
+ * and prints one JSON object per metric.
+ *
+ *   gcc -O2 -o bench_xcb bench_xcb.c -lxcb
+ *   ./bench_xcb [scale]
+ */
+#include <xcb/xcb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WIDTH 640
+#define HEIGHT 480
+#define IMAGE_SIDE 256
+#define EVENT_BATCH 500
+
+static const char *TEXT = "The quick brown fox jumps over the lazy dog";
+
+static xcb_connection_t *conn;
+static xcb_window_t window;
+static xcb_gcontext_t gc, pixmap_gc;
+static xcb_pixmap_t pixmap;
+static uint8_t depth;
+static double scale = 1.0;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int count(int base) {
+    int n = (int)(base * scale);
+    return n > 0 ? n : 1;
+}
+
+static void sync_server(void) {
+    free(xcb_get_input_focus_reply(conn, xcb_get_input_focus(conn), NULL));
+}
+
+static void report(const char *metric, int ops, double seconds, double rate, const char *unit) {
+    printf("{\"backend\":\"c\",\"metric\":\"%s\",\"ops\":%d,\"seconds\":%.6f,\"rate\":%.2f,\"unit\":\"%s\"}\n",
+           metric, ops, seconds, rate, unit);
+}
+
+static void bench_points(void) {
+    int ops = count(20000);
+    sync_server();
+    double start = now();
+    for (int i = 0; i < ops; i++) {
+        xcb_point_t p = { i % WIDTH, i % HEIGHT };
+        xcb_poly_point(conn, XCB_COORD_MODE_ORIGIN, window, gc, 1, &p);
+    }
+    sync_server();
+    double seconds = now() - start;
+    report("points", ops, seconds, ops / seconds, "ops/s");
+}
+
+static void bench_lines(void) {
+    int ops = count(20000);
+    sync_server();
+    double start = now();
+    for (int i = 0; i < ops; i++) {
+        xcb_point_t p[2] = { { 0, i % HEIGHT }, { WIDTH - 1, HEIGHT - 1 - i % HEIGHT } };
+        xcb_poly_line(conn, XCB_COORD_MODE_ORIGIN, window, gc, 2, p);
+    }
+    sync_server();
+    double seconds = now() - start;
+    report("lines", ops, seconds, ops / seconds, "ops/s");
+}
+
+static void bench_rects(void) {
+    int ops = count(20000);
+    sync_server();
+    double start = now();
+    for (int i = 0; i < ops; i++) {
+        xcb_rectangle_t r = { i % WIDTH, i % HEIGHT, 16, 16 };
+        xcb_poly_fill_rectangle(conn, window, gc, 1, &r);
+    }
+    sync_server();
+    double seconds = now() - start;
+    report("rects", ops, seconds, ops / seconds, "ops/s");
+}
+
+static void bench_text(void) {
+    int ops = count(10000);
+    uint8_t len = (uint8_t)strlen(TEXT);
+    sync_server();
+    double start = now();
+    for (int i = 0; i < ops; i++) {
+        xcb_image_text_8(conn, len, window, gc, 4, 12 + i % (HEIGHT - 12), TEXT);
+    }
+    sync_server();
+    double seconds = now() - start;
+    report("text", ops, seconds, ops / seconds, "ops/s");
+}
+
+static void bench_events(void) {
+    int ops = count(20000);
+    xcb_client_message_event_t message;
+    xcb_generic_event_t *event;
+
+    memset(&message, 0, sizeof(message));
+    message.response_type = XCB_CLIENT_MESSAGE;
+    message.format = 32;
+    message.window = window;
+
+    sync_server();
+    while ((event = xcb_poll_for_event(conn)))
+        free(event);
+
+    double start = now();
+    int remaining = ops;
+    while (remaining > 0) {
+        int batch = remaining < EVENT_BATCH ? remaining : EVENT_BATCH;
+        for (int i = 0; i < batch; i++)
+            xcb_send_event(conn, 0, window, 0, (const char *)&message);
+        xcb_flush(conn);
+        for (int i = 0; i < batch; i++)
+            free(xcb_wait_for_event(conn));
+        remaining -= batch;
+    }
+    double seconds = now() - start;
+    report("events", ops, seconds, ops / seconds, "events/s");
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_roundtrip(void) {
+    int ops = count(2000);
+    double *samples = malloc(sizeof(double) * ops);
+    double total = 0;
+
+    for (int i = 0; i < ops; i++) {
+        double start = now();
+        sync_server();
+        samples[i] = now() - start;
+        total += samples[i];
+    }
+    qsort(samples, ops, sizeof(double), compare_double);
+
+    int p99 = (int)(ops * 0.99);
+    if (p99 >= ops) p99 = ops - 1;
+    double mean = total / ops;
+    printf("{\"backend\":\"c\",\"metric\":\"roundtrip\",\"ops\":%d,\"seconds\":%.6f,\"rate\":%.2f,"
+           "\"unit\":\"roundtrips/s\",\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f}\n",
+           ops, total, 1.0 / mean, mean * 1e6, samples[ops / 2] * 1e6, samples[p99] * 1e6);
+    free(samples);
+}
+
+static void bench_image_upload(void) {
+    int ops = count(200);
+    uint32_t stride = IMAGE_SIDE * 4;
+    uint32_t size = stride * IMAGE_SIDE;
+    uint32_t max_request = xcb_get_maximum_request_length(conn) * 4;
+    uint32_t rows_per_request = (max_request - 32) / stride;
+    uint8_t *data = malloc(size);
+
+    if (rows_per_request < 1) rows_per_request = 1;
+    srand(42);
+    for (uint32_t i = 0; i < size; i++)
+        data[i] = rand() & 0xff;
+
+    sync_server();
+    double start = now();
+    for (int i = 0; i < ops; i++) {
+        for (uint32_t row = 0; row < IMAGE_SIDE; row += rows_per_request) {
+            uint32_t rows = IMAGE_SIDE - row < rows_per_request ? IMAGE_SIDE - row : rows_per_request;
+            xcb_put_image(conn, XCB_IMAGE_FORMAT_Z_PIXMAP, pixmap, pixmap_gc, IMAGE_SIDE, rows,
+                          0, row, 0, depth, stride * rows, data + stride * row);
+        }
+    }
+    sync_server();
+    double seconds = now() - start;
+    double megabytes = (double)size * ops / (1024.0 * 1024.0);
+    printf("{\"backend\":\"c\",\"metric\":\"image_upload\",\"ops\":%d,\"seconds\":%.6f,\"rate\":%.2f,"
+           "\"unit\":\"MB/s\",\"bytes\":%.0f}\n",
+           ops, seconds, megabytes / seconds, (double)size * ops);
+    free(data);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        scale = atof(argv[1]);
+
+    conn = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(conn)) {
+        fprintf(stderr, "Failed to connect to X server\n");
+        return 1;
+    }
+
+    xcb_screen_t *screen = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
+    depth = screen->root_depth;
+
+    uint32_t win_values[] = { screen->white_pixel, XCB_EVENT_MASK_EXPOSURE };
+    window = xcb_generate_id(conn);
+    xcb_create_window(conn, XCB_COPY_FROM_PARENT, window, screen->root,
+                      0, 0, WIDTH, HEIGHT, 1, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                      screen->root_visual, XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, win_values);
+    xcb_map_window(conn, window);
+
+    xcb_font_t font = xcb_generate_id(conn);
+    xcb_open_font(conn, font, 5, "fixed");
+
+    uint32_t gc_values[] = { screen->black_pixel, font };
+    gc = xcb_generate_id(conn);
+    xcb_create_gc(conn, gc, window, XCB_GC_FOREGROUND | XCB_GC_FONT, gc_values);
+
+    pixmap = xcb_generate_id(conn);
+    xcb_create_pixmap(conn, depth, pixmap, window, IMAGE_SIDE, IMAGE_SIDE);
+    pixmap_gc = xcb_generate_id(conn);
+    xcb_create_gc(conn, pixmap_gc, pixmap, 0, NULL);
+    xcb_flush(conn);
+
+    bench_points();
+    bench_lines();
+    bench_rects();
+    bench_text();
+    bench_events();
+    bench_roundtrip();
+    bench_image_upload();
+
+    xcb_disconnect(conn);
+    return 0;
+}
@@ -2,6 +2,8 @@
 # Bouncing Balls - эффектная анимация с физикой в Ruby XCB
 
 require_relative '../../lib/xcb_wrapper'
+require_relative '../../lib/xcb/frame_scheduler'
+require_relative '../../lib/xcb/sprite'
 
 puts "🎾 Bouncing Balls - Ruby XCB Demo"
 
@@ -19,14 +21,26 @@ XCB.application do |app|
   # Create graphics resources
   font = app.create_font("fixed")
   
+  # GC options per color; the frame scheduler binds them to its back buffers
   graphics = {
-    black: canvas.create_graphics_context(foreground: :black),
-    white: canvas.create_graphics_context(foreground: :white, font: font),
-    red: canvas.create_graphics_context(foreground: :red),
-    green: canvas.create_graphics_context(foreground: :green),
-    blue: canvas.create_graphics_context(foreground: :blue)
+    black: { foreground: :black },
+    white: { foreground: :white, font: font },
+    red: { foreground: :red },
+    green: { foreground: :green },
+    blue: { foreground: :blue }
   }
   
+  # Every ball size and color is rasterized once into a sprite sheet;
+  # a ball then costs one blit per frame
+  sprites = XCB::SpriteSheet.new(app.connection, width: 512, height: 512)
+  (10...30).each do |radius|
+    [:red, :green, :blue].each do |color|
+      sprites.add([radius, color], radius * 2 + 1, radius * 2 + 1) do |canvas|
+        canvas.fill_circle(radius, radius, radius, color)
+      end
+    end
+  end
+  
   # Ball class for physics
   class Ball
     attr_accessor :x, :y, :vx, :vy, :radius, :color
@@ -85,6 +99,10 @@ XCB.application do |app|
       end
     end
     
+    def draw_sprite(batch)
+      batch.draw([@radius, @color], @x - @radius, @y - @radius)
+    end
+    
     def draw_optimized(graphics)
       # Optimized circle drawing with horizontal lines
       (-@radius..@radius).each do |dy|
@@ -112,7 +130,7 @@ XCB.application do |app|
     state[:balls] << Ball.new(x, y)
   end
   
-  def draw_interface(graphics, state)
+  def draw_interface(graphics, sprites, target, state, timing)
     g = graphics
     
     # Clear screen
@@ -124,9 +142,9 @@ XCB.application do |app|
       g[:black].fill_rectangle(0, 0, 600, 400)
     end
     
-    # Draw all balls
-    state[:balls].each do |ball|
-      ball.draw_optimized(g)
+    # Draw all balls: one batch of sprite blits
+    sprites.batch(target) do |batch|
+      state[:balls].each { |ball| ball.draw_sprite(batch) }
     end
     
     # Draw UI
@@ -135,7 +153,9 @@ XCB.application do |app|
     
     status = state[:paused] ? "PAUSED" : "Running"
     trails = state[:show_trails] ? "ON" : "OFF"
-    g[:white].draw_text(10, 365, "Status: #{status} | Trails: #{trails} | Frame: #{state[:frame_count]}")
+    g[:white].draw_text(10, 345, "Status: #{status} | Trails: #{trails} | Frame: #{state[:frame_count]}")
+    latency = timing[:avg_latency_ms] ? "#{timing[:avg_latency_ms]} ms" : "-"
+    g[:white].draw_text(10, 365, "#{timing[:mode]} | interval: #{timing[:interval_ms]} ms | latency: #{latency} | missed: #{timing[:missed]}")
     g[:white].draw_text(10, 385, "Click: add ball | SPACE: pause | T: trails | G/H: gravity | C: clear | ESC: exit")
   end
   
@@ -149,69 +169,10 @@ XCB.application do |app|
   puts "🧹 Press C to clear all balls"
   puts "🚪 Press ESC to exit"
   
-  # Animation loop
-  last_time = Time.now
-  target_fps = 60
-  frame_time = 1.0 / target_fps
-  
-  loop do
-    current_time = Time.now
-    delta_time = current_time - last_time
-    
-    # Check for events (non-blocking)
-    event = app.connection.poll_for_event
-    
-    if event
-      case event.type
-      when :expose
-        draw_interface(graphics, state)
-        
-      when :button_press
-        x, y = event.position
-        if y > 60 && y < 360  # Only add balls in play area
-          puts "🎾 New ball added at (#{x}, #{y})"
-          state[:balls] << Ball.new(x, y)
-          draw_interface(graphics, state)
-        end
-        
-      when :key_press
-        case event.key_code
-        when 65  # SPACE
-          state[:paused] = !state[:paused]
-          status = state[:paused] ? "paused" : "resumed"
-          puts "⏸️ Animation #{status}"
-          draw_interface(graphics, state)
-          
-        when 28  # T
-          state[:show_trails] = !state[:show_trails]
-          trails = state[:show_trails] ? "enabled" : "disabled"
-          puts "🌟 Trails #{trails}"
-          draw_interface(graphics, state)
-          
-        when 42  # G
-          state[:gravity] = [state[:gravity] - 0.05, 0].max
-          puts "🌍 Gravity decreased to #{state[:gravity].round(2)}"
-          draw_interface(graphics, state)
-          
-        when 43  # H
-          state[:gravity] = [state[:gravity] + 0.05, 1.0].min
-          puts "🌍 Gravity increased to #{state[:gravity].round(2)}"
-          draw_interface(graphics, state)
-          
-        when 54  # C
-          state[:balls].clear
-          puts "🧹 All balls cleared"
-          draw_interface(graphics, state)
-          
-        when 9   # ESC
-          puts "🚪 Exiting bouncing balls demo"
-          break
-        end
-      end
-    end
-    
-    # Animation update
-    if delta_time >= frame_time && !state[:paused]
+  # One physics step and one render per display interval: Present's
+  # CompleteNotify (or the timer fallback) drives each frame
+  scheduler = XCB::FrameScheduler.new(canvas, graphics: graphics) do |frame|
+    unless state[:paused]
       # Update physics
       state[:balls].each do |ball|
         ball.update(600, 400, state[:gravity])
@@ -222,15 +183,54 @@ XCB.application do |app|
         ball.vx.abs < 0.1 && ball.vy.abs < 0.1 && ball.y > 380
       end
       
-      # Redraw
-      draw_interface(graphics, state)
       state[:frame_count] += 1
-      last_time = current_time
     end
     
-    # Small sleep to prevent busy waiting
-    sleep(0.001)
+    draw_interface(frame.graphics, sprites, frame.pixmap, state, scheduler.stats)
+  end
+  puts "⏱️ Frame pacing: #{scheduler.mode}, sprites: #{sprites.mode}"
+  
+  scheduler.run do |event|
+    case event.type
+    when :button_press
+      x, y = event.position
+      if y > 60 && y < 340  # Only add balls in play area
+        puts "🎾 New ball added at (#{x}, #{y})"
+        state[:balls] << Ball.new(x, y)
+      end
+      
+    when :key_press
+      case event.base_key_name
+      when "space"
+        state[:paused] = !state[:paused]
+        status = state[:paused] ? "paused" : "resumed"
+        puts "⏸️ Animation #{status}"
+        
+      when "t"
+        state[:show_trails] = !state[:show_trails]
+        trails = state[:show_trails] ? "enabled" : "disabled"
+        puts "🌟 Trails #{trails}"
+        
+      when "g"
+        state[:gravity] = [state[:gravity] - 0.05, 0].max
+        puts "🌍 Gravity decreased to #{state[:gravity].round(2)}"
+        
+      when "h"
+        state[:gravity] = [state[:gravity] + 0.05, 1.0].min
+        puts "🌍 Gravity increased to #{state[:gravity].round(2)}"
+        
+      when "c"
+        state[:balls].clear
+        puts "🧹 All balls cleared"
+        
+      when "Escape"
+        puts "🚪 Exiting bouncing balls demo"
+        :quit
+      end
+    end
   end
+  
+  puts "📊 #{scheduler.stats}"
 end
 
 puts "✅ Bouncing balls demo completed!"
\ No newline at end of file
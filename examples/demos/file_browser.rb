@@ -30,11 +30,47 @@ XCB.application do |app|
   # Application state
   state = {
     current_path: Pathname.pwd,
-    entries: [],
-    selected_index: 0,
-    scroll_offset: 0
   }
   
+  # File list: rendered rows are cached offscreen, scrolling blits
+  row_graphics = nil
+  list = XCB::ListView.new(browser, x: 8, y: 48, width: 480, height: 288, row_height: 16) do |row|
+    row_graphics ||= {
+      black: list.create_graphics_context(foreground: :black, font: font),
+      white: list.create_graphics_context(foreground: :white, font: font),
+      blue: list.create_graphics_context(foreground: :blue, font: font)
+    }
+    entry = row.item
+    
+    # Selection highlight
+    if row.selected?
+      row_graphics[:blue].fill_rectangle(0, row.y, row.width, row.height)
+      text_color = :white
+    else
+      text_color = :black
+    end
+    
+    # Entry icon and name
+    icon = case entry[:type]
+           when :parent then "⬆️"
+           when :directory then "📁"
+           when :file then "📄"
+           end
+    
+    lines = [[7, row.baseline, "#{icon} #{entry[:name]}"]]
+    
+    # File info (size for files)
+    if entry[:type] == :file
+      begin
+        lines << [392, row.baseline, format_size(entry[:path].size)]
+      rescue
+        # Skip if can't get size
+      end
+    end
+    
+    row_graphics[text_color].draw_texts(lines)
+  end
+  
   def load_directory(path)
     begin
       entries = []
@@ -70,7 +106,7 @@ XCB.application do |app|
     end
   end
   
-  def draw_interface(graphics, state)
+  def draw_interface(graphics, state, list)
     g = graphics
     
     # Clear window
@@ -89,76 +125,19 @@ XCB.application do |app|
     # Instructions
     g[:black].draw_text(10, 365, "Click to navigate | ↑↓: select | Enter: open | Backspace: up | ESC: exit")
     
-    # File list
-    visible_entries = 18  # Lines that fit in the window
-    start_y = 60
-    line_height = 16
+    list.paint
+    draw_scrollbar(graphics, list)
+  end
+  
+  def draw_scrollbar(graphics, list)
+    graphics[:white].fill_rectangle(490, 48, 8, list.height)
+    return unless list.items.size > list.visible_rows
     
-    state[:entries].each_with_index do |entry, index|
-      next if index < state[:scroll_offset]
-      break if index >= state[:scroll_offset] + visible_entries
-      
-      y = start_y + (index - state[:scroll_offset]) * line_height
-      
-      # Selection highlight
-      if index == state[:selected_index]
-        g[:blue].fill_rectangle(8, y - 12, 484, 14)
-        text_color = :white
-      else
-        text_color = :black
-      end
-      
-      # Entry icon and name
-      case entry[:type]
-      when :parent
-        icon = "⬆️"
-        name_color = :blue
-      when :directory
-        icon = "📁"
-        name_color = :blue
-      when :file
-        icon = "📄"
-        name_color = :black
-      end
-      
-      # Draw entry
-      if index == state[:selected_index]
-        g[:white].draw_text(15, y, "#{icon} #{entry[:name]}")
-        
-        # File info (size for files)
-        if entry[:type] == :file
-          begin
-            size = entry[:path].size
-            size_text = format_size(size)
-            g[:white].draw_text(400, y, size_text)
-          rescue
-            # Skip if can't get size
-          end
-        end
-      else
-        g[:black].draw_text(15, y, "#{icon} #{entry[:name]}")
-        
-        # File info (size for files)
-        if entry[:type] == :file
-          begin
-            size = entry[:path].size
-            size_text = format_size(size)
-            g[:black].draw_text(400, y, size_text)
-          rescue
-            # Skip if can't get size
-          end
-        end
-      end
-    end
+    total_height = list.height
+    scrollbar_height = (list.visible_rows.to_f / list.items.size * total_height).to_i
+    scrollbar_y = 48 + (list.scroll_offset.to_f / list.items.size * total_height).to_i
     
-    # Scrollbar indicator
-    if state[:entries].size > visible_entries
-      total_height = 280
-      scrollbar_height = (visible_entries.to_f / state[:entries].size * total_height).to_i
-      scrollbar_y = 60 + (state[:scroll_offset].to_f / state[:entries].size * total_height).to_i
-      
-      g[:black].fill_rectangle(490, scrollbar_y, 8, scrollbar_height)
-    end
+    graphics[:black].fill_rectangle(490, scrollbar_y, 8, scrollbar_height)
   end
   
   def format_size(size)
@@ -176,69 +155,45 @@ XCB.application do |app|
     "#{size_f.round(1)} #{units[unit_index]}"
   end
   
-  def handle_click(state, x, y)
+  def handle_click(state, list, x, y)
     # Check if click is in file list area
-    return unless y >= 60 && y <= 340
-    
-    # Calculate clicked entry
-    line_height = 16
-    clicked_line = (y - 60) / line_height + state[:scroll_offset]
-    
-    return unless clicked_line < state[:entries].size
+    clicked_line = list.index_at(y)
+    return unless clicked_line
     
     # Select and open entry
-    state[:selected_index] = clicked_line
-    open_selected_entry(state)
+    list.select(clicked_line)
+    open_selected_entry(state, list)
   end
   
-  def open_selected_entry(state)
-    return if state[:entries].empty?
+  def open_selected_entry(state, list)
+    return if list.items.empty?
     
-    entry = state[:entries][state[:selected_index]]
+    entry = list.items[list.selected_index]
     
     case entry[:type]
     when :parent, :directory
       puts "📂 Opening directory: #{entry[:path]}"
       state[:current_path] = entry[:path]
-      state[:entries] = load_directory(state[:current_path])
-      state[:selected_index] = 0
-      state[:scroll_offset] = 0
+      list.items = load_directory(state[:current_path])
+      true
     when :file
       puts "📄 File: #{entry[:name]} (#{format_size(entry[:path].size)})"
+      false
     end
   end
   
-  def move_selection(state, direction)
-    case direction
-    when :up
-      state[:selected_index] = [state[:selected_index] - 1, 0].max
-    when :down
-      state[:selected_index] = [state[:selected_index] + 1, state[:entries].size - 1].min
-    end
-    
-    # Auto-scroll
-    visible_entries = 18
-    if state[:selected_index] < state[:scroll_offset]
-      state[:scroll_offset] = state[:selected_index]
-    elsif state[:selected_index] >= state[:scroll_offset] + visible_entries
-      state[:scroll_offset] = state[:selected_index] - visible_entries + 1
-    end
-  end
-  
-  def go_up_directory(state)
+  def go_up_directory(state, list)
     unless state[:current_path].root?
       puts "⬆️ Going up to parent directory"
       state[:current_path] = state[:current_path].parent
-      state[:entries] = load_directory(state[:current_path])
-      state[:selected_index] = 0
-      state[:scroll_offset] = 0
+      list.items = load_directory(state[:current_path])
+      true
     end
   end
   
   # Initialize
-  state[:entries] = load_directory(state[:current_path])
-  
   browser.show
+  list.items = load_directory(state[:current_path])
   
   puts "📁 File browser started!"
   puts "📂 Current directory: #{state[:current_path]}"
@@ -248,38 +203,40 @@ XCB.application do |app|
   
   # Main event loop
   app.run do |event, window|
+    # Scroll exposures only touch the list rows
+    next if event.type == :graphics_exposure && list.handle_event(event)
+    
     case event.type
     when :expose
-      draw_interface(graphics, state)
-      
+      draw_interface(graphics, state, list) if event.expose_count.zero?
+    
     when :button_press
       x, y = event.position
       puts "🖱️ Click at (#{x}, #{y})"
-      handle_click(state, x, y)
-      draw_interface(graphics, state)
-      
+      handle_click(state, list, x, y) && draw_interface(graphics, state, list)
+    
     when :key_press
-      case event.key_code
-      when 111  # Up arrow
-        move_selection(state, :up)
-        puts "⬆️ Selected: #{state[:entries][state[:selected_index]][:name]}"
-        draw_interface(graphics, state)
-        
-      when 116  # Down arrow  
-        move_selection(state, :down)
-        puts "⬇️ Selected: #{state[:entries][state[:selected_index]][:name]}"
-        draw_interface(graphics, state)
-        
-      when 36   # Enter
-        puts "📂 Opening: #{state[:entries][state[:selected_index]][:name]}"
-        open_selected_entry(state)
-        draw_interface(graphics, state)
-        
-      when 22   # Backspace
-        go_up_directory(state)
-        draw_interface(graphics, state)
+      case event.key_name
+      when "Up"
+        list.move_selection(-1)
+        puts "⬆️ Selected: #{list.items[list.selected_index][:name]}" unless list.items.empty?
+        draw_scrollbar(graphics, list)
+      
+      when "Down"
+        list.move_selection(1)
+        puts "⬇️ Selected: #{list.items[list.selected_index][:name]}" unless list.items.empty?
+        draw_scrollbar(graphics, list)
+      
+      when "Return"
+        next if list.items.empty?
         
-      when 9    # ESC
+        puts "📂 Opening: #{list.items[list.selected_index][:name]}"
+        open_selected_entry(state, list) && draw_interface(graphics, state, list)
+      
+      when "BackSpace"
+        go_up_directory(state, list) && draw_interface(graphics, state, list)
+      
+      when "Escape"
         puts "🚪 Exiting file browser"
         :quit
       end
@@ -2,6 +2,11 @@
 # Simple Paint Application - демонстрация возможностей Ruby XCB Wrapper
 
 require_relative '../../lib/xcb_wrapper'
+begin
+  require_relative '../../lib/xcb/input'
+rescue LoadError
+  # Без libxcb-xinput рисуем по core motion_notify
+end
 
 puts "🎨 Simple Paint - Ruby XCB Demo"
 
@@ -39,7 +44,8 @@ XCB.application do |app|
     chaos_mode: false,
     last_x: nil,
     last_y: nil,
-    strokes: []
+    strokes: [],
+    exposed: []
   }
   
   colors = [:black, :red, :green, :blue]
@@ -102,6 +108,58 @@ XCB.application do |app|
     brushes[color].draw_line(x1, y1, x2, y2)
   end
   
+  def extend_stroke(state, x, y, colors, line_widths)
+    # In chaos mode, change color/width randomly for each segment
+    if state[:chaos_mode] && rand(5) == 0  # 20% chance to change
+      state[:current_color] = colors.sample
+      state[:line_width] = line_widths.sample
+    end
+    
+    stroke = {
+      color: state[:current_color],
+      width: state[:line_width],
+      x1: state[:last_x], y1: state[:last_y],
+      x2: x, y2: y
+    }
+    state[:strokes] << stroke
+    
+    # Update position
+    state[:last_x] = x
+    state[:last_y] = y
+    stroke
+  end
+  
+  # XInput 2 delivers every motion sample (subpixel, timestamped) in
+  # batches; each batch is drawn as a few PolySegment requests
+  input = nil
+  if defined?(XCB::Input)
+    begin
+      input = XCB::Input.new(canvas, events: [:motion])
+      input.on_batch do |samples|
+        next unless state[:drawing]
+        
+        strokes = samples.filter_map do |sample|
+          x = sample.x.round
+          y = sample.y.round
+          next if y <= 60 || (x == state[:last_x] && y == state[:last_y])
+          
+          extend_stroke(state, x, y, colors, line_widths)
+        end
+        
+        strokes.chunk_while { |a, b| a[:color] == b[:color] && a[:width] == b[:width] }.each do |run|
+          brush = brushes[run.first[:color]]
+          brush.set_line_width(run.first[:width])
+          app.connection.encoder.poly_segment(canvas, brush, run.map { |s| s.values_at(:x1, :y1, :x2, :y2) })
+        end
+        app.connection.flush
+      end
+      puts "🖊️ XInput 2 motion: every sample is drawn"
+    rescue XCB::XCBError => e
+      puts "⚠️ #{e.message}, using core motion events"
+      input = nil
+    end
+  end
+  
   canvas.show
   puts "🎨 Paint application started!"
   puts "🖱️ Drag to draw"
@@ -115,15 +173,34 @@ XCB.application do |app|
   app.run do |event, window|
     case event.type
     when :expose
-      # Redraw everything
-      draw_ui(brushes, state[:current_color], state[:line_width], state[:chaos_mode])
+      # Collect the exposed rectangles and repaint once, when the last
+      # one of the batch arrives (count 0)
+      state[:exposed] << [event.expose_x, event.expose_y, event.expose_width, event.expose_height]
+      next unless event.expose_count.zero?
       
-      # Redraw all strokes
+      exposed = state[:exposed]
+      active = brushes.values
+      active.each { |brush| brush.set_clip_rectangles(exposed) }
+      
+      draw_ui(brushes, state[:current_color], state[:line_width], state[:chaos_mode]) if exposed.any? { |_x, y, _w, _h| y < 60 }
+      
+      # Only strokes that touch an exposed rectangle; the clip keeps the
+      # rest of the window untouched
       state[:strokes].each do |stroke|
+        margin = stroke[:width]
+        left, right = [stroke[:x1], stroke[:x2]].minmax
+        top, bottom = [stroke[:y1], stroke[:y2]].minmax
+        next unless exposed.any? do |x, y, w, h|
+          left - margin < x + w && right + margin >= x && top - margin < y + h && bottom + margin >= y
+        end
+        
         draw_stroke(brushes, stroke[:color], stroke[:width],
                    stroke[:x1], stroke[:y1], stroke[:x2], stroke[:y2])
       end
       
+      active.each(&:clear_clip)
+      exposed.clear
+    
     when :button_press
       if event.y > 60  # Drawing area only (increased UI height)
         state[:drawing] = true
@@ -139,84 +216,60 @@ XCB.application do |app|
           puts "🖊️ Start drawing at (#{event.x}, #{event.y}) [#{state[:current_color]}, #{state[:line_width]}px]"
         end
       end
-      
+    
     when :button_release
       state[:drawing] = false
       state[:last_x] = nil
       state[:last_y] = nil
       puts "🖊️ Stop drawing"
-      
+    
     when :motion_notify
       if state[:drawing] && state[:last_x] && state[:last_y]
         x, y = event.x, event.y
         
         if y > 60  # Stay in drawing area (increased UI height)
-          # In chaos mode, change color/width randomly for each segment
-          if state[:chaos_mode] && rand(5) == 0  # 20% chance to change
-            state[:current_color] = colors.sample
-            state[:line_width] = line_widths.sample
-          end
-          
-          # Draw line
-          draw_stroke(brushes, state[:current_color], state[:line_width],
-                     state[:last_x], state[:last_y], x, y)
-          
-          # Save stroke
-          state[:strokes] << {
-            color: state[:current_color],
-            width: state[:line_width],
-            x1: state[:last_x], y1: state[:last_y],
-            x2: x, y2: y
-          }
-          
-          # Update position
-          state[:last_x] = x
-          state[:last_y] = y
+          stroke = extend_stroke(state, x, y, colors, line_widths)
+          draw_stroke(brushes, stroke[:color], stroke[:width],
+                     stroke[:x1], stroke[:y1], stroke[:x2], stroke[:y2])
         end
       end
-      
+    
     when :key_press
-      case event.key_code
-      when 10..13  # Keys 1-4 (colors)
+      case event.base_key_name
+      when "1", "2", "3", "4"  # colors
         unless state[:chaos_mode]  # Only allow manual color change in normal mode
-          color_index = event.key_code - 10
+          color_index = event.base_key_name.to_i - 1
           if color_index < colors.size
             state[:current_color] = colors[color_index]
             puts "🎨 Color changed to #{state[:current_color]}"
             draw_ui(brushes, state[:current_color], state[:line_width], state[:chaos_mode])
           end
         end
-        
-      when 24..27  # Keys Q-T (line widths: Q=24, W=25, E=26, T=28)  
+      
+      when "q", "w", "e", "t"  # line widths
         unless state[:chaos_mode]  # Only allow manual width change in normal mode
-          width_index = case event.key_code
-                        when 24 then 0  # Q
-                        when 25 then 1  # W  
-                        when 26 then 2  # E
-                        when 28 then 3  # T
-                        else -1
-                        end
+          width_index = %w[q w e t].index(event.base_key_name)
           
-          if width_index >= 0 && width_index < line_widths.size
+          if width_index < line_widths.size
             state[:line_width] = line_widths[width_index]
             puts "📏 Line width changed to #{state[:line_width]}px"
             draw_ui(brushes, state[:current_color], state[:line_width], state[:chaos_mode])
           end
         end
-        
-      when 65  # SPACE key
+      
+      when "space"
         state[:chaos_mode] = !state[:chaos_mode]
         mode_text = state[:chaos_mode] ? "enabled" : "disabled"
         puts "🌀 Chaos mode #{mode_text}"
         draw_ui(brushes, state[:current_color], state[:line_width], state[:chaos_mode])
-        
-      when 54  # Key C
+      
+      when "c"
         puts "🧹 Canvas cleared"
         state[:strokes].clear
         brushes[:white].fill_rectangle(0, 60, 600, 340)
         draw_ui(brushes, state[:current_color], state[:line_width], state[:chaos_mode])
-        
-      when 9  # ESC
+      
+      when "Escape"
         puts "🚪 Exiting paint application"
         :quit
       end
@@ -113,7 +113,7 @@ XCB.application do |app|
       graphics[:text].draw_text(50, 60, "Clicks: #{state[:click_count]} | Ruby-way API demonstration")
       
     when :key_press
-      if event.key_code == 9  # ESC
+      if event.key_name == "Escape"
         puts "🚪 Ruby-style exit via ESC"
         :quit  # Ruby-way to signal quit
       end
@@ -113,11 +113,11 @@ XCB.connect do |conn|
       gc_text.draw_text(20, 60, info)
       
     when :key_press
-      key_code = event.key_code
-      puts "⌨️ Key pressed: #{key_code}"
+      key_name = event.key_name
+      puts "⌨️ Key pressed: #{key_name} (keycode #{event.key_code})"
       
-      # ESC key (code 9) exits
-      if key_code == 9
+      # ESC exits, whatever its keycode on this keyboard
+      if key_name == "Escape"
         puts "🚪 ESC pressed - exiting"
         :break
       end
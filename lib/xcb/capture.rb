@@ -0,0 +1,334 @@
+require 'zlib'
+begin
+  require_relative '../xcb_shm'
+rescue LoadError
+  # libxcb-shm is not installed: captures use GetImage only
+end
+
+module XCB
+  # Reading pixels back from windows and pixmaps. An area is read in
+  # horizontal strips (GetImage replies sized to the maximum request
+  # length, or one MIT-SHM segment per strip on local connections), the
+  # next strip being requested before the current one is converted, and
+  # each strip is converted to RGB/RGBA and handed on before the next one
+  # arrives, so a capture never holds a second full copy of the image.
+  module Capture
+    SHM_SEGMENT_SIZE = 4 * 1024 * 1024
+    
+    # Server pixel layout of a drawable and conversion to 8-bit RGB(A)
+    class PixelFormat
+      attr_reader :depth, :bits_per_pixel, :scanline_pad
+      
+      def initialize(connection, depth, visual)
+        format = connection.pixmap_format(depth)
+        @depth = depth
+        @bits_per_pixel = format[:bits_per_pixel]
+        @scanline_pad = format[:scanline_pad]
+        @lsb_first = connection.image_byte_order == :lsb_first
+        @masks = visual ? visual.values_at(:red_mask, :green_mask, :blue_mask) : [0xff0000, 0xff00, 0xff]
+        @row_formats = {}
+      end
+      
+      def stride(width)
+        (width * @bits_per_pixel + @scanline_pad - 1) / @scanline_pad * @scanline_pad / 8
+      end
+      
+      def channels(alpha)
+        alpha ? 4 : 3
+      end
+      
+      # Rows of ZPixmap data with the given stride to packed RGB or RGBA
+      def convert(data, width, rows, alpha: false)
+        if @bits_per_pixel == 32 && @lsb_first && @masks == [0xff0000, 0xff00, 0xff]
+          convert_xrgb32(data, width, rows, alpha)
+        else
+          convert_generic(data, width, rows, alpha)
+        end
+      end
+      
+      private
+      
+      # Common TrueColor case: one little-endian 0xAARRGGBB word per
+      # pixel; unpack/pack do the byte shuffling in C
+      def convert_xrgb32(data, width, rows, alpha)
+        pixels = data.unpack('V*')
+        if alpha
+          opaque = @depth != 32
+          pixels.map! { |v| opaque ? (v << 8) | 0xff : (v << 8) | (v >> 24) }
+          return pixels.pack('N*')
+        end
+        
+        xrgb = pixels.pack('N*')
+        row_format = @row_formats[width] ||= "xC3" * width
+        out = String.new(capacity: width * rows * 3, encoding: Encoding::BINARY)
+        rows.times do |row|
+          xrgb.byteslice(row * width * 4, width * 4).unpack(row_format).pack('C*', buffer: out)
+        end
+        out
+      end
+      
+      def convert_generic(data, width, rows, alpha)
+        shifts = @masks.map { |mask| mask.zero? ? 0 : mask.to_s(2).length - 8 }
+        bytes = @bits_per_pixel / 8
+        row_stride = stride(width)
+        out = String.new(capacity: width * rows * channels(alpha), encoding: Encoding::BINARY)
+        
+        rows.times do |row|
+          line = data.byteslice(row * row_stride, width * bytes)
+          pixels = case @bits_per_pixel
+                   when 32 then line.unpack(@lsb_first ? 'V*' : 'N*')
+                   when 16 then line.unpack(@lsb_first ? 'v*' : 'n*')
+                   when 24 then line.unpack('C*').each_slice(3).map { |a, b, c| @lsb_first ? a | b << 8 | c << 16 : a << 16 | b << 8 | c }
+                   else raise XCBError, "Unsupported bits per pixel: #{@bits_per_pixel}"
+                   end
+          pixels.each do |v|
+            rgb = @masks.each_with_index.map do |mask, i|
+              c = v & mask
+              shifts[i] >= 0 ? c >> shifts[i] : c << -shifts[i]
+            end
+            rgb << 0xff if alpha
+            rgb.pack('C*', buffer: out)
+          end
+        end
+        out
+      end
+    end
+    
+    # A System V shared memory segment attached to the server
+    class ShmSegment
+      attr_reader :connection, :seg_id, :size, :address
+      
+      def self.available?(connection)
+        defined?(Shm) && connection.extension(Shm::ID) ? true : false
+      end
+      
+      def initialize(connection, size)
+        @connection = connection
+        @size = size
+        @shm_id = Shm.shmget(Shm::IPC_PRIVATE, size, Shm::IPC_CREAT | 0o600)
+        raise XCBError, "shmget failed" if @shm_id < 0
+        
+        @address = Shm.shmat(@shm_id, nil, 0)
+        if @address.address == (1 << 64) - 1
+          Shm.shmctl(@shm_id, Shm::IPC_RMID, nil)
+          raise XCBError, "shmat failed"
+        end
+        
+        @seg_id = connection.generate_id
+        error = XCB.xcb_request_check(connection.connection,
+                                      Shm.xcb_shm_attach_checked(connection.connection, @seg_id, @shm_id, 0))
+        # The segment goes away once both sides have detached
+        Shm.shmctl(@shm_id, Shm::IPC_RMID, nil)
+        unless error.null?
+          XCB::LibC.free(error)
+          Shm.shmdt(@address)
+          raise XCBError, "MIT-SHM attach failed (remote display?)"
+        end
+        connection.send(:register_resource, self)
+      end
+      
+      def cleanup
+        return if @address.nil?
+        
+        Shm.xcb_shm_detach(@connection.connection, @seg_id) rescue nil
+        Shm.shmdt(@address)
+        @address = nil
+      end
+    end
+    
+    # Strips of one area: yields (y, rows, raw ZPixmap data)
+    class Reader
+      attr_reader :drawable, :x, :y, :width, :height, :format
+      
+      def initialize(drawable, x, y, width, height, format, shm: true)
+        @connection = drawable.connection
+        @drawable = drawable
+        @x = x
+        @y = y
+        @width = width
+        @height = height
+        @format = format
+        @shm = shm && Capture.shm_segment(@connection)
+      end
+      
+      def each_strip(&block)
+        @shm ? each_shm_strip(&block) : each_get_image_strip(&block)
+      end
+      
+      private
+      
+      def strip_rows(limit)
+        [[limit / @format.stride(@width), 1].max, @height].min
+      end
+      
+      def each_get_image_strip
+        conn = @connection.connection
+        rows = strip_rows(@connection.maximum_request_length - 32)
+        request = lambda do |top|
+          h = [rows, @height - top].min
+          [top, h, XCB.xcb_get_image(conn, XCB::XCB_IMAGE_FORMAT_Z_PIXMAP, @drawable.drawable_id,
+                                     @x, @y + top, @width, h, 0xffffffff)]
+        end
+        
+        pending = request.call(0)
+        while pending
+          top, h, cookie = pending
+          reply = @connection.wait_for_reply("GetImage", 73) { XCB.xcb_get_image_reply(conn, cookie, nil) }
+          raise XCBError, "GetImage failed at row #{top}" if reply.null?
+          
+          begin
+            # Ask for the next strip while this one is converted
+            pending = top + h < @height ? request.call(top + h) : nil
+            @connection.flush
+            yield top, h, reply.get_bytes(32, reply.get_uint32(4) * 4)
+          ensure
+            XCB::LibC.free(reply)
+          end
+        end
+      end
+      
+      def each_shm_strip
+        conn = @connection.connection
+        rows = strip_rows(@shm.size)
+        top = 0
+        while top < @height
+          h = [rows, @height - top].min
+          cookie = Shm.xcb_shm_get_image(conn, @drawable.drawable_id, @x, @y + top, @width, h,
+                                         0xffffffff, XCB::XCB_IMAGE_FORMAT_Z_PIXMAP, @shm.seg_id, 0)
+          reply = @connection.wait_for_reply("ShmGetImage", "MIT-SHM:4") { Shm.xcb_shm_get_image_reply(conn, cookie, nil) }
+          raise XCBError, "ShmGetImage failed at row #{top}" if reply.null?
+          
+          size = reply.get_uint32(Shm::GET_IMAGE_SIZE)
+          XCB::LibC.free(reply)
+          yield top, h, @shm.address.get_bytes(0, size)
+          top += h
+        end
+      end
+    end
+    
+    # Binary PPM (P6), written row strip by row strip
+    class PPMWriter
+      def initialize(io, width, height)
+        @io = io
+        io.write("P6\n#{width} #{height}\n255\n")
+      end
+      
+      def channels
+        3
+      end
+      
+      def write(rgb)
+        @io.write(rgb)
+      end
+      
+      def finish; end
+    end
+    
+    # PNG with one IDAT chunk per strip from a running deflate stream
+    class PNGWriter
+      SIGNATURE = "\x89PNG\r\n\x1a\n".b
+      
+      def initialize(io, width, height, alpha: false, level: Zlib::BEST_SPEED)
+        @io = io
+        @row_bytes = width * (alpha ? 4 : 3)
+        @alpha = alpha
+        @deflate = Zlib::Deflate.new(level)
+        io.write(SIGNATURE)
+        chunk("IHDR", [width, height, 8, alpha ? 6 : 2, 0, 0, 0].pack('N2C5'))
+      end
+      
+      def channels
+        @alpha ? 4 : 3
+      end
+      
+      # Rows get filter type 0 (None)
+      def write(pixels)
+        rows = pixels.bytesize / @row_bytes
+        filtered = String.new(capacity: pixels.bytesize + rows, encoding: Encoding::BINARY)
+        rows.times { |row| filtered << "\0" << pixels.byteslice(row * @row_bytes, @row_bytes) }
+        data = @deflate.deflate(filtered)
+        chunk("IDAT", data) unless data.empty?
+      end
+      
+      def finish
+        chunk("IDAT", @deflate.finish)
+        @deflate.close
+        chunk("IEND", "")
+      end
+      
+      private
+      
+      def chunk(type, data)
+        @io.write([data.bytesize].pack('N'))
+        @io.write(type)
+        @io.write(data)
+        @io.write([Zlib.crc32(data, Zlib.crc32(type))].pack('N'))
+      end
+    end
+    
+    # One reusable SHM segment per connection, nil when MIT-SHM is unusable
+    def self.shm_segment(connection)
+      @shm_segments ||= ObjectSpace::WeakMap.new
+      return @shm_segments[connection] if @shm_segments.key?(connection)
+      
+      @shm_segments[connection] = ShmSegment.available?(connection) ? ShmSegment.new(connection, SHM_SEGMENT_SIZE) : false
+    rescue XCBError
+      @shm_segments[connection] = false
+    end
+  end
+  
+  # capture / capture_ppm / capture_png for windows and pixmaps
+  module Capturable
+    # Without a block returns an Enumerator of [y, rows, pixels] strips;
+    # pixels are packed 8-bit RGB, or RGBA with alpha: true
+    def capture(x: 0, y: 0, width: self.width - x, height: self.height - y, alpha: false, shm: true)
+      return enum_for(:capture, x: x, y: y, width: width, height: height, alpha: alpha, shm: shm) unless block_given?
+      
+      format = capture_pixel_format
+      Capture::Reader.new(self, x, y, width, height, format, shm: shm).each_strip do |top, rows, data|
+        yield top, rows, format.convert(data, width, rows, alpha: alpha)
+      end
+      self
+    end
+    
+    # Write a binary PPM to a path or IO
+    def capture_ppm(target, **options)
+      capture_to(target, options) { |io, w, h| Capture::PPMWriter.new(io, w, h) }
+    end
+    
+    # Write a PNG to a path or IO (alpha: true for RGBA)
+    def capture_png(target, alpha: false, **options)
+      capture_to(target, options.merge(alpha: alpha)) { |io, w, h| Capture::PNGWriter.new(io, w, h, alpha: alpha) }
+    end
+    
+    private
+    
+    def capture_to(target, options)
+      x = options.fetch(:x, 0)
+      y = options.fetch(:y, 0)
+      width = options.fetch(:width, self.width - x)
+      height = options.fetch(:height, self.height - y)
+      
+      write = lambda do |io|
+        writer = yield io, width, height
+        capture(**options, width: width, height: height) { |_top, _rows, pixels| writer.write(pixels) }
+        writer.finish
+      end
+      
+      if target.respond_to?(:write)
+        write.call(target)
+      else
+        File.open(target, 'wb') { |io| write.call(io) }
+      end
+      self
+    end
+    
+    def capture_pixel_format
+      @capture_pixel_format ||= begin
+        depth = respond_to?(:depth) ? self.depth : screen.depth
+        visual = depth == screen.depth ? screen.visual_type : screen.visual_for_depth(depth)
+        Capture::PixelFormat.new(connection, depth, visual)
+      end
+    end
+  end
+end
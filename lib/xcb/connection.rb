@@ -1,18 +1,37 @@
 module XCB
   class Connection
-    attr_reader :connection, :screens
+    attr_reader :connection, :screens, :display_name, :tracer
     
-    def initialize(display_name = nil, screen_number = nil)
-      @connection = connect_to_display(display_name, screen_number)
-      raise XCBError, "Failed to connect to X server" if connection_has_error?
+    # record: path logs the session's protocol stream (see Recording);
+    # XCB_RECORD=path does so for the first connection of the process
+    def initialize(display_name = nil, screen_number = nil, record: Connection.record_from_env)
+      @display_name = display_name
+      @connection = connect_to_display(display_name, screen_number, record)
+      if connection_has_error?
+        # xcb_connect always returns a connection object that must be freed
+        XCB.xcb_disconnect(@connection)
+        @recorder&.finish
+        raise XCBError, "Failed to connect to X server#{" #{display_name}" if display_name}"
+      end
       
       @screens = load_screens
       @resources = []
+      trace_from_env if ENV['XCB_TRACE']
       
       # Автоматическая очистка при завершении
       ObjectSpace.define_finalizer(self, self.class.finalize(@connection, @resources))
     end
     
+    def self.record_from_env
+      return nil if @record_env_claimed || !ENV['XCB_RECORD']
+      
+      @record_env_claimed = true
+      ENV['XCB_RECORD']
+    end
+    
+    # The Recording::Recorder proxy when recording, else nil
+    attr_reader :recorder
+    
     def screen(number = 0)
       @screens[number] || @screens.first
     end
@@ -26,21 +45,171 @@ module XCB
     end
     
     def flush
+      tracer = @tracer
+      started = tracer.now if tracer
+      @encoder.flush if @encoder
       XCB.xcb_flush(@connection)
+      tracer&.complete("xcb_flush", :io, started)
+    end
+    
+    # Start recording a timeline (see Tracer); returns the tracer
+    def trace(capacity: Tracer::DEFAULT_CAPACITY)
+      @tracer ||= Tracer.new(capacity: capacity)
+    end
+    
+    def stop_trace
+      tracer = @tracer
+      @tracer = nil
+      tracer
+    end
+    
+    # Run the block as a span when tracing, else just run it. The span's
+    # one argument is given as key, value so that nothing is allocated
+    # while tracing is off
+    #   traced("draw_texts", :draw, :lines, lines.size) { ... }
+    def traced(name, category, key = nil, value = nil, &block)
+      return yield unless @tracer
+      
+      @tracer.span(name, category, key && { key => value }, &block)
+    end
+    
+    # Blocks on one reply. With a tracer the wait is a :wait span named
+    # after the request, with its opcode (core number, or
+    # "EXTENSION:minor") as argument, so implicit round trips show up
+    # on the timeline:
+    #   reply = conn.wait_for_reply("GetGeometry", 14) { XCB.xcb_get_geometry_reply(c, cookie, nil) }
+    def wait_for_reply(request, opcode, &block)
+      return yield unless @tracer
+      
+      @tracer.span(request, :wait, { opcode: opcode }, &block)
+    end
+    
+    # Reusable native buffers for request arguments (see ScratchArena)
+    def scratch
+      @scratch ||= ScratchArena.new
+    end
+    
+    # Keycode -> keysym table, fetched on first use and kept current by
+    # MappingNotify (see Keymap)
+    def keymap
+      @keymap ||= Keymap.new(self)
+    end
+    
+    def keymap_loaded?
+      !@keymap.nil?
+    end
+    
+    # Direct protocol encoder for batched drawing (see RequestEncoder)
+    def encoder
+      @encoder ||= RequestEncoder.new(self)
+    end
+    
+    # Round trip to the server: returns once every request sent so far
+    # has been processed
+    def sync
+      cookie = XCB.xcb_get_input_focus(@connection)
+      reply = wait_for_reply("sync", 43) { XCB.xcb_get_input_focus_reply(@connection, cookie, nil) }
+      XCB::LibC.free(reply) unless reply.null?
+      self
+    end
+    
+    # Cached xcb_get_extension_data for an extension id (e.g. Render::ID);
+    # nil when the server does not support the extension
+    def extension(extension_id)
+      @extensions ||= {}
+      key = extension_id.address
+      return @extensions[key] if @extensions.key?(key)
+      
+      reply = XCB.xcb_get_extension_data(@connection, extension_id)
+      @extensions[key] = if reply.null? || reply.get_uint8(8) == 0
+                           nil
+                         else
+                           { major_opcode: reply.get_uint8(9),
+                             first_event: reply.get_uint8(10),
+                             first_error: reply.get_uint8(11) }
+                         end
+    end
+    
+    def require_extension(extension_id, name)
+      extension(extension_id) || raise(XCBError, "#{name} extension is not available")
+    end
+    
+    # Interned atom id, cached per connection
+    def atom(name)
+      atoms(name).first
+    end
+    
+    # Interns several atoms with one round trip: all requests are sent
+    # before the first reply is read
+    def atoms(*names)
+      @atoms ||= {}
+      missing = names.map(&:to_s).uniq.reject { |name| @atoms.key?(name) }
+      cookies = missing.map { |name| XCB.xcb_intern_atom(@connection, 0, name.bytesize, name) }
+      
+      traced("intern_atoms", :wait, :count, missing.size) do
+        missing.zip(cookies).each do |name, cookie|
+          reply = XCB.xcb_intern_atom_reply(@connection, cookie, nil)
+          raise XCBError, "InternAtom failed for #{name}" if reply.null?
+          
+          @atoms[name] = reply.get_uint32(8)
+          XCB::LibC.free(reply)
+        end
+      end
+      
+      names.map { |name| @atoms[name.to_s] }
+    end
+    
+    # ZPixmap layout for a depth from the setup: bits_per_pixel, scanline_pad
+    def pixmap_format(depth)
+      load_setup_formats unless @pixmap_formats
+      @pixmap_formats[depth] || raise(XCBError, "No pixmap format for depth #{depth}")
+    end
+    
+    # :lsb_first or :msb_first
+    def image_byte_order
+      load_setup_formats unless @pixmap_formats
+      @image_byte_order
+    end
+    
+    # Maximum request size in bytes (the server reports 4-byte units)
+    def maximum_request_length
+      @maximum_request_length ||= XCB.xcb_get_maximum_request_length(@connection) * 4
     end
     
     def wait_for_event
-      event_ptr = XCB.xcb_wait_for_event(@connection)
+      return route_wait_for_event if @event_routes
+      
+      event_ptr = wait_for_event_ptr
       return nil if event_ptr.null?
       
-      Event.new(event_ptr)
+      new_event(event_ptr)
     end
     
     def poll_for_event
+      return route_poll_for_event if @event_routes
+      
       event_ptr = XCB.xcb_poll_for_event(@connection)
       return nil if event_ptr.null?
       
-      Event.new(event_ptr)
+      new_event(event_ptr)
+    end
+    
+    # Divert generic (XGE) events of one extension to a separate queue.
+    # route.push(event) sees each event as it is read and returns true to
+    # consume it; route.flush runs once the socket has been drained, so the
+    # extension gets its events in batches and core events are never
+    # queued behind them
+    def add_event_route(extension_opcode, route)
+      (@event_routes ||= {})[extension_opcode] = route
+      self
+    end
+    
+    def remove_event_route(extension_opcode)
+      return self unless @event_routes
+      
+      @event_routes.delete(extension_opcode)
+      @event_routes = nil if @event_routes.empty?
+      self
     end
     
     # Ruby-style event loop with block
@@ -51,15 +220,59 @@ module XCB
       end
     end
     
+    # Window object created on this connection for a window id, if any
+    def tracked_window(window_id)
+      @tracked_windows && @tracked_windows[window_id]
+    end
+    
+    # Connection is shut down (I/O error, server gone, protocol error)
+    def error?
+      @connection.null? || connection_has_error?
+    end
+    
+    def file_descriptor
+      XCB.xcb_get_file_descriptor(@connection)
+    end
+    
+    # Send a GetInputFocus without waiting; its sequence number is a fence
+    # for poll_for_reply: when it is answered every earlier request has
+    # been processed
+    def fence
+      XCB.xcb_get_input_focus(@connection)
+    end
+    
+    # Non-blocking reply check: nil while pending, otherwise true (the
+    # reply or error has been read and freed)
+    def poll_for_reply(sequence)
+      reply_ptr = FFI::MemoryPointer.new(:pointer)
+      error_ptr = FFI::MemoryPointer.new(:pointer)
+      return nil if XCB.xcb_poll_for_reply(@connection, sequence, reply_ptr, error_ptr).zero?
+      
+      [reply_ptr.read_pointer, error_ptr.read_pointer].each { |ptr| XCB::LibC.free(ptr) unless ptr.null? }
+      true
+    end
+    
     def close
+      return if @connection.null?
+      
+      @encoder.flush if @encoder && !error?
       cleanup_resources
-      XCB.xcb_disconnect(@connection) unless @connection.null?
+      XCB.xcb_disconnect(@connection)
       @connection = FFI::Pointer::NULL
+      @recorder&.finish
+      ObjectSpace.undefine_finalizer(self)
     end
     
     private
     
-    def connect_to_display(display_name, screen_number)
+    def connect_to_display(display_name, screen_number, record)
+      if record
+        require_relative 'recording'
+        @recorder = Recording::Recorder.new(display_name, record)
+        @screen_number = screen_number || Recording.screen_number(display_name)
+        return XCB.xcb_connect_to_fd(@recorder.fd, nil)
+      end
+      
       if screen_number
         screen_ptr = FFI::MemoryPointer.new(:int)
         screen_ptr.write_int(screen_number)
@@ -85,10 +298,104 @@ module XCB
       screens
     end
     
+    # Structure events keep the geometry cache of our windows current
+    def new_event(event_ptr)
+      event = Event.new(event_ptr, self)
+      @keymap.invalidate(event) if @keymap && event.type == :mapping_notify
+      if @tracked_windows && event.structure?
+        @tracked_windows[event.subject_window]&.update_from_event(event)
+      end
+      event
+    end
+    
+    def track_window(window)
+      (@tracked_windows ||= {})[window.window_id] = window
+    end
+    
+    def untrack_window(window)
+      @tracked_windows&.delete(window.window_id)
+    end
+    
+    # xcb_wait_for_event, traced as a blocking wait with the event type
+    def wait_for_event_ptr
+      tracer = @tracer
+      return XCB.xcb_wait_for_event(@connection) unless tracer
+      
+      started = tracer.now
+      event_ptr = XCB.xcb_wait_for_event(@connection)
+      type = event_ptr.null? ? nil : event_ptr.get_uint8(0) & 0x7f
+      tracer.complete("xcb_wait_for_event", :wait, started, { type: Event::TYPES[type] || type })
+      event_ptr
+    end
+    
+    # XCB_TRACE=path records from connect; the trace is written at exit
+    # and whenever XCB_TRACE_SIGNAL (default USR2) arrives
+    def trace_from_env
+      path = ENV['XCB_TRACE']
+      tracer = trace
+      tracer.write_on_signal(path, ENV['XCB_TRACE_SIGNAL'] || "USR2")
+      at_exit { tracer.write(path) }
+    end
+    
+    def route_wait_for_event
+      loop do
+        event_ptr = XCB.xcb_poll_for_event(@connection)
+        if event_ptr.null?
+          flush_event_routes
+          event_ptr = wait_for_event_ptr
+          return nil if event_ptr.null?
+        end
+        
+        event = new_event(event_ptr)
+        return event unless route_event(event)
+      end
+    end
+    
+    def route_poll_for_event
+      loop do
+        event_ptr = XCB.xcb_poll_for_event(@connection)
+        if event_ptr.null?
+          flush_event_routes
+          return nil
+        end
+        
+        event = new_event(event_ptr)
+        return event unless route_event(event)
+      end
+    end
+    
+    def route_event(event)
+      return false unless event.generic?
+      
+      route = @event_routes[event.extension_opcode]
+      route ? route.push(event) : false
+    end
+    
+    def flush_event_routes
+      @event_routes&.each_value(&:flush)
+    end
+    
+    # xcb_setup_t: formats follow the 40-byte header and the padded vendor
+    def load_setup_formats
+      setup = XCB.xcb_get_setup(@connection)
+      @image_byte_order = setup.get_uint8(30).zero? ? :lsb_first : :msb_first
+      offset = 40 + ((setup.get_uint16(24) + 3) & ~3)
+      @pixmap_formats = {}
+      setup.get_uint8(29).times do |i|
+        depth, bits_per_pixel, scanline_pad = setup.get_bytes(offset + i * 8, 3).unpack('C3')
+        @pixmap_formats[depth] = { bits_per_pixel: bits_per_pixel, scanline_pad: scanline_pad }
+      end
+    end
+    
     def register_resource(resource)
       @resources << resource
     end
     
+    # For resources freed before the connection closes
+    def unregister_resource(resource)
+      @resources.delete(resource)
+    end
+    
     def cleanup_resources
       @resources.each(&:cleanup) rescue nil
       @resources.clear
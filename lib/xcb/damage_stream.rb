@@ -0,0 +1,293 @@
+require_relative '../xcb_wrapper'
+require_relative 'capture'
+require_relative '../xcb_damage'
+require_relative '../xcb_xfixes'
+
+module XCB
+  # Incremental capture of a window or the whole root for recording and
+  # remote viewing. A DAMAGE object (NonEmpty level: one DamageNotify until
+  # the damage is subtracted) tells that something changed; on the next
+  # tick the accumulated damage is moved into an XFixes region with
+  # DamageSubtract, fetched as rectangles and only those are read back
+  # (Capture::Reader, through MIT-SHM when the display is local). Reading
+  # cost follows what changed on screen, not the resolution; a full
+  # keyframe goes out on the first tick, every keyframe_interval seconds
+  # and after a resize.
+  #
+  #   stream = XCB::DamageStream.new(conn.default_screen.root_window, connection: conn)
+  #   loop do
+  #     while (event = conn.poll_for_event)
+  #       next if stream.handle_event(event)
+  #       ...
+  #     end
+  #     stream.tick { |update| encoder.push(update.x, update.y, update.width, update.height, update.pixels) }
+  #     sleep(1.0 / 30)
+  #   end
+  class DamageStream
+    # Packed RGB (or RGBA) rows of one changed area; a keyframe covers the
+    # whole drawable
+    Update = Struct.new(:x, :y, :width, :height, :pixels, :keyframe) do
+      def keyframe?
+        keyframe
+      end
+    end
+    
+    # A bare drawable id (e.g. the root window) for Capture::Reader
+    Target = Struct.new(:connection, :drawable_id)
+    
+    attr_reader :connection, :drawable_id, :width, :height, :depth, :keyframe_interval
+    
+    # drawable is a Window, a Pixmap or an id (then connection: is needed).
+    # Neighbouring damaged rectangles are read as one while that reads at
+    # most merge_slack extra pixels; more than max_rectangles are read as
+    # their bounding box
+    def initialize(drawable, connection: nil, keyframe_interval: 10.0, alpha: false, shm: true,
+                   merge_slack: 4096, max_rectangles: 32)
+      @connection = connection || drawable.connection
+      @target = drawable.respond_to?(:drawable_id) ? drawable : Target.new(@connection, drawable)
+      @drawable_id = @target.drawable_id
+      @keyframe_interval = keyframe_interval
+      @alpha = alpha
+      @shm = shm
+      @merge_slack = merge_slack
+      @max_rectangles = max_rectangles
+      
+      damage = @connection.require_extension(Damage::ID, "DAMAGE")
+      @connection.require_extension(XFixes::ID, "XFIXES")
+      @damage_event = damage[:first_event] + Damage::NOTIFY
+      event_mask = load_geometry
+      
+      conn = @connection.connection
+      @damage_id = @connection.generate_id
+      @region = @connection.generate_id
+      XFixes.xcb_xfixes_create_region(conn, @region, 0, nil)
+      Damage.xcb_damage_create(conn, @damage_id, @drawable_id, Damage::REPORT_LEVEL_NON_EMPTY)
+      watch_structure(event_mask)
+      @connection.flush
+      
+      @pending = false
+      @keyframe_due = true
+      @last_keyframe = nil
+      @ticks = @updates = @keyframes = @pixels = 0
+      @connection.send(:register_resource, self)
+    end
+    
+    # DamageNotify of this stream is consumed (returns true); a
+    # ConfigureNotify that resizes the drawable forces a keyframe
+    def handle_event(event)
+      if event.response_type == @damage_event
+        return false unless event.event_ptr.get_uint32(Damage::NOTIFY_DAMAGE) == @damage_id
+        
+        @pending = true
+        return true
+      end
+      
+      if event.type == :configure_notify && event.subject_window == @drawable_id
+        _x, _y, width, height, _border_width = event.geometry
+        if width != @width || height != @height
+          @width = width
+          @height = height
+          keyframe!
+        end
+      end
+      false
+    end
+    
+    def keyframe!
+      @keyframe_due = true
+      self
+    end
+    
+    # Anything to read on the next tick
+    def pending?
+      @pending || keyframe_due?
+    end
+    
+    # Read what changed since the last tick and yield an Update per area
+    # (returns them without a block). The damage is subtracted before the
+    # pixels are read, so drawing that races the read is damage again
+    # and comes with the next tick
+    def tick(&block)
+      return enum_for(:tick).to_a unless block_given?
+      
+      @ticks += 1
+      keyframe = keyframe_due?
+      return self unless keyframe || @pending
+      
+      @pending = false
+      @connection.traced("damage_capture", :capture, :keyframe, keyframe) do
+        if keyframe
+          Damage.xcb_damage_subtract(@connection.connection, @damage_id, XCB::XCB_NONE, XCB::XCB_NONE)
+          @keyframe_due = false
+          @last_keyframe = clock
+          @keyframes += 1
+          emit(0, 0, @width, @height, true, &block)
+        else
+          damaged_rectangles.each { |x, y, width, height| emit(x, y, width, height, false, &block) }
+        end
+      end
+      self
+    end
+    
+    # read_ratio is the share of full-frame reads actually done
+    def stats
+      full = @ticks * @width * @height
+      { ticks: @ticks, updates: @updates, keyframes: @keyframes, pixels: @pixels,
+        read_ratio: full.zero? ? 0.0 : (@pixels.to_f / full).round(4) }
+    end
+    
+    def close
+      return if @damage_id.nil?
+      
+      cleanup
+      @connection.send(:unregister_resource, self)
+      @connection.flush
+    end
+    
+    def cleanup
+      return if @damage_id.nil?
+      
+      conn = @connection.connection
+      Damage.xcb_damage_destroy(conn, @damage_id) rescue nil
+      XFixes.xcb_xfixes_destroy_region(conn, @region) rescue nil
+      @damage_id = nil
+    end
+    
+    def inspect
+      "#<XCB::DamageStream drawable=#{@drawable_id} #{@width}x#{@height} updates=#{@updates} keyframes=#{@keyframes}>"
+    end
+    
+    private
+    
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+    
+    def keyframe_due?
+      @keyframe_due || (@keyframe_interval && clock - @last_keyframe >= @keyframe_interval)
+    end
+    
+    # Versions are negotiated together with the drawable's geometry, in
+    # one round trip. Returns the event mask this client has selected on
+    # a window it does not track (nil otherwise)
+    def load_geometry
+      conn = @connection.connection
+      foreign = !@target.is_a?(Pixmap) && @connection.tracked_window(@drawable_id).nil?
+      cookies = [XFixes.xcb_xfixes_query_version(conn, 2, 0),
+                 Damage.xcb_damage_query_version(conn, 1, 1),
+                 XCB.xcb_get_geometry(conn, @drawable_id)]
+      attributes_cookie = XCB.xcb_get_window_attributes(conn, @drawable_id) if foreign
+      versions = [
+        @connection.wait_for_reply("XFixesQueryVersion", "XFIXES:0") { XFixes.xcb_xfixes_query_version_reply(conn, cookies[0], nil) },
+        @connection.wait_for_reply("DamageQueryVersion", "DAMAGE:0") { Damage.xcb_damage_query_version_reply(conn, cookies[1], nil) }
+      ]
+      versions.each { |reply| XCB::LibC.free(reply) unless reply.null? }
+      
+      geometry = @connection.wait_for_reply("GetGeometry", 14) { XCB.xcb_get_geometry_reply(conn, cookies[2], nil) }
+      if geometry.null?
+        XCB.xcb_discard_reply(conn, attributes_cookie) if foreign
+        raise XCBError, "No such drawable: #{@drawable_id}"
+      end
+      
+      begin
+        @depth = geometry.get_uint8(1)
+        @width, @height = geometry.get_bytes(16, 4).unpack('S2')
+      ensure
+        XCB::LibC.free(geometry)
+      end
+      screen = @connection.default_screen
+      visual = @depth == screen.depth ? screen.visual_type : screen.visual_for_depth(@depth)
+      @format = Capture::PixelFormat.new(@connection, @depth, visual)
+      return nil unless foreign
+      
+      attributes = @connection.wait_for_reply("GetWindowAttributes", 3) do
+        XCB.xcb_get_window_attributes_reply(conn, attributes_cookie, nil)
+      end
+      return nil if attributes.null?
+      
+      begin
+        attributes.get_uint32(36)   # your_event_mask
+      ensure
+        XCB::LibC.free(attributes)
+      end
+    end
+    
+    # Resizes arrive as ConfigureNotify. Our own windows keep their mask;
+    # on others (often the root) StructureNotify is added to whatever
+    # this client already selected there, e.g. PropertyChange
+    def watch_structure(event_mask)
+      return if @target.is_a?(Pixmap)
+      
+      window = @connection.tracked_window(@drawable_id)
+      if window
+        window.add_events(:structure_notify)
+      elsif event_mask && event_mask & XCB::XCB_EVENT_MASK_STRUCTURE_NOTIFY == 0
+        XCB.xcb_change_window_attributes(@connection.connection, @drawable_id, XCB::XCB_CW_EVENT_MASK,
+                                         @connection.scratch.uint32(event_mask | XCB::XCB_EVENT_MASK_STRUCTURE_NOTIFY))
+      end
+    end
+    
+    # Damage since the last tick as [x, y, width, height], clipped to the
+    # drawable and merged
+    def damaged_rectangles
+      conn = @connection.connection
+      Damage.xcb_damage_subtract(conn, @damage_id, XCB::XCB_NONE, @region)
+      cookie = XFixes.xcb_xfixes_fetch_region(conn, @region)
+      reply = @connection.wait_for_reply("XFixesFetchRegion", "XFIXES:19") { XFixes.xcb_xfixes_fetch_region_reply(conn, cookie, nil) }
+      return [] if reply.null?
+      
+      begin
+        count = reply.get_uint32(4) / 2
+        values = reply.get_bytes(XFixes::FETCH_REGION_RECTANGLES, count * 8).unpack('s2S2' * count)
+      ensure
+        XCB::LibC.free(reply)
+      end
+      
+      rectangles = values.each_slice(4).filter_map do |x, y, width, height|
+        left = x.clamp(0, @width)
+        top = y.clamp(0, @height)
+        right = (x + width).clamp(0, @width)
+        bottom = (y + height).clamp(0, @height)
+        [left, top, right - left, bottom - top] if right > left && bottom > top
+      end
+      merge(rectangles)
+    end
+    
+    # XFixes regions are y-x banded, so a damaged shape comes as many thin
+    # rectangles; each one joins the first merged area whose bounding box
+    # with it wastes at most merge_slack pixels
+    def merge(rectangles)
+      merged = []
+      rectangles.each do |rect|
+        index = merged.index { |other| waste(other, rect) <= @merge_slack }
+        if index
+          merged[index] = union(merged[index], rect)
+        else
+          merged << rect
+        end
+      end
+      merged.size > @max_rectangles ? [merged.reduce { |a, b| union(a, b) }] : merged
+    end
+    
+    def union(a, b)
+      left = [a[0], b[0]].min
+      top = [a[1], b[1]].min
+      [left, top, [a[0] + a[2], b[0] + b[2]].max - left, [a[1] + a[3], b[1] + b[3]].max - top]
+    end
+    
+    def waste(a, b)
+      box = union(a, b)
+      box[2] * box[3] - a[2] * a[3] - b[2] * b[3]
+    end
+    
+    def emit(x, y, width, height, keyframe)
+      pixels = String.new(capacity: width * height * @format.channels(@alpha), encoding: Encoding::BINARY)
+      Capture::Reader.new(@target, x, y, width, height, @format, shm: @shm).each_strip do |_top, rows, data|
+        pixels << @format.convert(data, width, rows, alpha: @alpha)
+      end
+      @updates += 1
+      @pixels += width * height
+      yield Update.new(x, y, width, height, pixels, keyframe)
+    end
+  end
+end
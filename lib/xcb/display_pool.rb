@@ -0,0 +1,326 @@
+module XCB
+  # Drives many X displays from one thread, e.g. one headless Xvfb per
+  # render job. Each display keeps its own connection, default screen and
+  # resource cache; a reactor multiplexes their sockets with IO.select.
+  #
+  # A job is a block called with the least busy healthy display. It issues
+  # its requests and returns; the job completes once the server has
+  # processed them (a GetInputFocus fence polled without blocking), so
+  # jobs on different displays overlap. A job that returns a Proc gets it
+  # called after the fence, with its value as the result (render, then
+  # read back). Broken connections are detected with
+  # xcb_connection_has_error, their running jobs are retried on another
+  # display and the display reconnects in the background.
+  #
+  #   pool = XCB::DisplayPool.new([":90", ":91", ":92"])
+  #   jobs = files.map { |f| pool.submit { |display| render_thumbnail(display, f) } }
+  #   pool.run_until_idle
+  #   jobs.map(&:value)
+  class DisplayPool
+    class Job
+      attr_reader :id, :block, :attempts, :value, :error, :display
+      attr_accessor :continuation, :fence, :result
+      
+      def initialize(id, block)
+        @id = id
+        @block = block
+        @attempts = 0
+      end
+      
+      def start(display)
+        @display = display
+        @attempts += 1
+        @continuation = nil
+        @fence = nil
+      end
+      
+      def complete(value)
+        @value = value
+        @done = true
+      end
+      
+      def fail(error)
+        @error = error
+        @done = true
+      end
+      
+      def done?
+        @done == true
+      end
+      
+      def success?
+        done? && @error.nil?
+      end
+      
+      def inspect
+        state = done? ? (success? ? "done" : "failed") : "pending"
+        "#<XCB::DisplayPool::Job #{@id} #{state} attempts=#{@attempts}>"
+      end
+    end
+    
+    class Display
+      attr_reader :name, :connection, :cache, :jobs, :reconnects, :errors, :last_error
+      attr_accessor :retry_at, :retry_delay
+      
+      def initialize(name)
+        @name = name
+        @cache = {}
+        @jobs = []
+        @reconnects = 0
+        @errors = 0
+        @retry_delay = nil
+        connect
+      end
+      
+      def screen
+        @connection.default_screen
+      end
+      
+      def healthy?
+        !@connection.nil? && !@connection.error?
+      end
+      
+      def io
+        @io ||= IO.for_fd(@connection.file_descriptor, autoclose: false)
+      end
+      
+      def connect
+        @connection = Connection.new(@name)
+        @io = nil
+        @retry_delay = nil
+        true
+      rescue XCBError => e
+        @connection = nil
+        @last_error = e
+        false
+      end
+      
+      # Drop the broken connection and everything cached for it
+      def disconnect(error = nil)
+        @last_error = error if error
+        @errors += 1 if error
+        @connection&.close
+        @connection = nil
+        @io = nil
+        @cache.clear
+      end
+      
+      def reconnect
+        @reconnects += 1
+        connect
+      end
+      
+      def inspect
+        "#<XCB::DisplayPool::Display #{@name} #{healthy? ? 'up' : 'down'} jobs=#{@jobs.size}>"
+      end
+    end
+    
+    attr_reader :displays, :max_jobs, :retries
+    
+    def initialize(names, max_jobs: 4, retries: 2, health_interval: 1.0, reconnect_delay: 0.25)
+      @displays = names.map { |name| Display.new(name) }
+      @max_jobs = max_jobs
+      @retries = retries
+      @health_interval = health_interval
+      @reconnect_delay = reconnect_delay
+      @queue = []
+      @next_id = 0
+      @next_health_check = 0
+      @displays.each { |display| schedule_reconnect(display) unless display.healthy? }
+    end
+    
+    def submit(&block)
+      job = Job.new(@next_id += 1, block)
+      @queue << job
+      job
+    end
+    
+    # Called for every event read on any display: |display, event|
+    def on_event(&block)
+      @on_event = block
+      self
+    end
+    
+    def idle?
+      @queue.empty? && @displays.all? { |display| display.jobs.empty? }
+    end
+    
+    def healthy_displays
+      @displays.select(&:healthy?)
+    end
+    
+    def run_until_idle(timeout: nil)
+      deadline = timeout && clock + timeout
+      until idle?
+        remaining = deadline && deadline - clock
+        break if remaining && remaining <= 0
+        
+        step(remaining)
+      end
+      idle?
+    end
+    
+    # One reactor iteration: start jobs, wait for any socket, service it
+    def step(timeout = nil)
+      check_health if clock >= @next_health_check
+      dispatch
+      
+      # A round trip in a job phase, or the event drain, can pull another
+      # job's fence reply into libxcb's buffer; the socket then stays
+      # quiet although the reply is there, so look before selecting
+      progressed = healthy_displays.map { |display| service(display) }.any?
+      
+      active = healthy_displays
+      waits = [timeout, @health_interval, reconnect_wait].compact
+      waits = [0] if progressed
+      if active.empty?
+        sleep(waits.min || @health_interval)
+        return self
+      end
+      
+      ready, = IO.select(active.map(&:io), nil, nil, waits.min)
+      (ready || []).each do |io|
+        display = active.find { |d| d.io == io }
+        service(display) if display
+      end
+      self
+    end
+    
+    def stats
+      { displays: @displays.size, healthy: healthy_displays.size, queued: @queue.size,
+        running: @displays.sum { |d| d.jobs.size },
+        reconnects: @displays.sum(&:reconnects), errors: @displays.sum(&:errors) }
+    end
+    
+    def close
+      @displays.each(&:disconnect)
+    end
+    
+    def inspect
+      "#<XCB::DisplayPool #{stats}>"
+    end
+    
+    private
+    
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+    
+    # Least busy healthy display first
+    def dispatch
+      until @queue.empty?
+        display = healthy_displays.select { |d| d.jobs.size < @max_jobs }.min_by { |d| d.jobs.size }
+        break unless display
+        
+        start(@queue.shift, display)
+      end
+    end
+    
+    def start(job, display)
+      job.start(display)
+      display.jobs << job
+      advance(job, job.block)
+    end
+    
+    # Run one phase of a job and fence it
+    def advance(job, phase)
+      display = job.display
+      result = phase.call(display)
+      job.continuation = result.is_a?(Proc) ? result : nil
+      job.result = result unless job.continuation
+      job.fence = display.connection.fence
+      display.connection.flush
+    rescue StandardError => e
+      display.jobs.delete(job)
+      if display.healthy?
+        job.fail(e)
+      else
+        failover(display, e)
+        retry_or_fail(job, e)
+      end
+    end
+    
+    # Complete or advance every job whose fence has been answered, and
+    # repeat until nothing moves: advancing one job can buffer the reply
+    # of another. True if any job progressed (or failed over)
+    def service(display)
+      connection = display.connection
+      progressed = false
+      
+      loop do
+        advanced = false
+        display.jobs.dup.each do |job|
+          break unless display.healthy?
+          next unless connection.poll_for_reply(job.fence)
+          # A shut-down connection reports every reply as done
+          break unless display.healthy?
+          
+          advanced = true
+          if job.continuation
+            advance(job, job.continuation)
+          else
+            display.jobs.delete(job)
+            job.complete(job.result)
+          end
+        end
+        
+        while display.healthy? && (event = connection.poll_for_event)
+          @on_event&.call(display, event)
+        end
+        
+        unless display.healthy?
+          failover(display, XCBError.new("Connection to #{display.name} lost"))
+          return true
+        end
+        break unless advanced
+        
+        progressed = true
+      end
+      progressed
+    end
+    
+    def check_health
+      @next_health_check = clock + @health_interval
+      @displays.each do |display|
+        if display.connection && !display.healthy?
+          failover(display, XCBError.new("Connection to #{display.name} has an error"))
+        elsif display.connection.nil? && display.retry_at && clock >= display.retry_at
+          schedule_reconnect(display) unless display.reconnect
+        end
+      end
+    end
+    
+    # Running jobs go back to the queue; the display reconnects later
+    def failover(display, error)
+      return unless display.connection
+      
+      jobs = display.jobs.dup
+      display.jobs.clear
+      display.disconnect(error)
+      jobs.each { |job| retry_or_fail(job, error) }
+      schedule_reconnect(display)
+    end
+    
+    def retry_or_fail(job, error)
+      if job.attempts <= @retries
+        @queue.unshift(job)
+      else
+        job.fail(error)
+      end
+    end
+    
+    # Exponential backoff up to 10 seconds
+    def schedule_reconnect(display)
+      display.retry_delay = display.retry_delay ? [display.retry_delay * 2, 10.0].min : @reconnect_delay
+      display.retry_at = clock + display.retry_delay
+      @next_health_check = [@next_health_check, display.retry_at].min
+    end
+    
+    def reconnect_wait
+      pending = @displays.filter_map { |d| d.retry_at if d.connection.nil? }
+      return nil if pending.empty?
+      
+      [pending.min - clock, 0].max
+    end
+  end
+end
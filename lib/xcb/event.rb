@@ -1,3 +1,5 @@
+require_relative 'wire_layout'
+
 module XCB
   class Event
     attr_reader :event_ptr, :type
@@ -9,11 +11,83 @@ module XCB
       4 => :button_press,
       5 => :button_release,
       6 => :motion_notify,
-      12 => :expose
+      12 => :expose,
+      13 => :graphics_exposure,
+      14 => :no_exposure,
+      17 => :destroy_notify,
+      18 => :unmap_notify,
+      19 => :map_notify,
+      21 => :reparent_notify,
+      22 => :configure_notify,
+      28 => :property_notify,
+      29 => :selection_clear,
+      30 => :selection_request,
+      31 => :selection_notify,
+      34 => :mapping_notify,
+      35 => :generic
     }.freeze
     
-    def initialize(event_ptr)
+    # StructureNotify / SubstructureNotify events about a window
+    STRUCTURE_TYPES = %i[destroy_notify unmap_notify map_notify reparent_notify configure_notify].freeze
+    
+    # Wire offsets of the fields read below, named after the xcb-proto
+    # event structs they come from (test/proto_test.rb checks them
+    # against the generated ones). Key, button and motion events share
+    # one layout, as do the window fields of structure events
+    {
+      KEY_DETAIL: ["KeyPressEvent", :detail, 1],
+      INPUT_TIME: ["KeyPressEvent", :time, 4],
+      INPUT_WINDOW: ["KeyPressEvent", :event, 12],
+      INPUT_ROOT_X: ["ButtonPressEvent", :root_x, 20],
+      INPUT_ROOT_Y: ["ButtonPressEvent", :root_y, 22],
+      INPUT_X: ["ButtonPressEvent", :event_x, 24],
+      INPUT_Y: ["ButtonPressEvent", :event_y, 26],
+      INPUT_STATE: ["ButtonPressEvent", :state, 28],
+      EXPOSE_WINDOW: ["ExposeEvent", :window, 4],
+      EXPOSE_X: ["ExposeEvent", :x, 8],
+      EXPOSE_Y: ["ExposeEvent", :y, 10],
+      EXPOSE_WIDTH: ["ExposeEvent", :width, 12],
+      EXPOSE_HEIGHT: ["ExposeEvent", :height, 14],
+      EXPOSE_COUNT: ["ExposeEvent", :count, 16],
+      GRAPHICS_EXPOSURE_X: ["GraphicsExposureEvent", :x, 8],
+      GRAPHICS_EXPOSURE_Y: ["GraphicsExposureEvent", :y, 10],
+      GRAPHICS_EXPOSURE_WIDTH: ["GraphicsExposureEvent", :width, 12],
+      GRAPHICS_EXPOSURE_HEIGHT: ["GraphicsExposureEvent", :height, 14],
+      GRAPHICS_EXPOSURE_COUNT: ["GraphicsExposureEvent", :count, 18],
+      PROPERTY_WINDOW: ["PropertyNotifyEvent", :window, 4],
+      PROPERTY_ATOM: ["PropertyNotifyEvent", :atom, 8],
+      PROPERTY_TIME: ["PropertyNotifyEvent", :time, 12],
+      PROPERTY_STATE: ["PropertyNotifyEvent", :state, 16],
+      SELECTION_CLEAR_TIME: ["SelectionClearEvent", :time, 4],
+      SELECTION_CLEAR_OWNER: ["SelectionClearEvent", :owner, 8],
+      SELECTION_CLEAR_SELECTION: ["SelectionClearEvent", :selection, 12],
+      SELECTION_REQUEST_OWNER: ["SelectionRequestEvent", :owner, 8],
+      SELECTION_REQUEST_REQUESTOR: ["SelectionRequestEvent", :requestor, 12],
+      SELECTION_REQUEST_SELECTION: ["SelectionRequestEvent", :selection, 16],
+      SELECTION_REQUEST_TARGET: ["SelectionRequestEvent", :target, 20],
+      SELECTION_REQUEST_PROPERTY: ["SelectionRequestEvent", :property, 24],
+      SELECTION_NOTIFY_REQUESTOR: ["SelectionNotifyEvent", :requestor, 8],
+      SELECTION_NOTIFY_SELECTION: ["SelectionNotifyEvent", :selection, 12],
+      SELECTION_NOTIFY_TARGET: ["SelectionNotifyEvent", :target, 16],
+      SELECTION_NOTIFY_PROPERTY: ["SelectionNotifyEvent", :property, 20],
+      STRUCTURE_EVENT: ["DestroyNotifyEvent", :event, 4],
+      STRUCTURE_WINDOW: ["DestroyNotifyEvent", :window, 8],
+      MAP_OVERRIDE_REDIRECT: ["MapNotifyEvent", :override_redirect, 12],
+      REPARENT_PARENT: ["ReparentNotifyEvent", :parent, 12],
+      REPARENT_X: ["ReparentNotifyEvent", :x, 16],
+      REPARENT_OVERRIDE_REDIRECT: ["ReparentNotifyEvent", :override_redirect, 20],
+      CONFIGURE_X: ["ConfigureNotifyEvent", :x, 16],
+      CONFIGURE_OVERRIDE_REDIRECT: ["ConfigureNotifyEvent", :override_redirect, 26],
+      GENERIC_EXTENSION: ["GeGenericEvent", :extension, 1],
+      GENERIC_EVENT_TYPE: ["GeGenericEvent", :event_type, 8]
+    }.each do |name, (struct, field, offset)|
+      const_set(name, Proto.wire_offset(struct, field, offset))
+    end
+    
+    # connection resolves keysyms (Connection#keymap)
+    def initialize(event_ptr, connection = nil)
       @event_ptr = event_ptr
+      @connection = connection
       @generic_event = XCB::GenericEvent.new(event_ptr)
       @type = TYPES[@generic_event[:response_type] & ~0x80] || :unknown
     end
@@ -46,21 +120,86 @@ module XCB
       @type == :expose
     end
     
+    # CopyArea could not copy part of the source; the rect must be redrawn
+    def graphics_exposure?
+      @type == :graphics_exposure
+    end
+    
+    # Extension event delivered through the Generic Event Extension
+    def generic?
+      @type == :generic
+    end
+    
+    # Major opcode of the extension that sent a generic event
+    def extension_opcode
+      return nil unless generic?
+      @event_ptr.get_uint8(GENERIC_EXTENSION)
+    end
+    
+    # Extension-specific event type (evtype) of a generic event
+    def generic_event_type
+      return nil unless generic?
+      @event_ptr.get_uint16(GENERIC_EVENT_TYPE)
+    end
+    
+    # Event code without the SendEvent bit; extension events (DamageNotify
+    # ...) are first_event + n and have no symbolic type
+    def response_type
+      @generic_event[:response_type] & 0x7f
+    end
+    
+    # Generated FFI struct over the event (require 'xcb_proto'), e.g.
+    # event.struct[:border_width]; extension events need their class
+    def struct(klass = nil)
+      klass ||= XCB::Proto::EVENTS[@generic_event[:response_type] & ~0x80] if defined?(XCB::Proto::EVENTS)
+      klass&.new(@event_ptr)
+    end
+    
     # Event-specific data accessors
     def key_code
       return nil unless key_press? || key_release?
-      @event_ptr.get_uint8(1)  # detail field
+      @event_ptr.get_uint8(KEY_DETAIL)
+    end
+    
+    # Keysym of a key event under its modifiers, from the connection's
+    # cached keymap (no round trip once the keymap is loaded)
+    def keysym
+      return nil unless (key_press? || key_release?) && @connection
+      
+      @connection.keymap.lookup(key_code, state)
+    end
+    
+    # X keysym name: "Escape", "space", "a", "A", "F1", "U+0439"
+    def key_name
+      sym = keysym
+      sym && Keymap.name(sym)
+    end
+    
+    # Name of the key's unshifted keysym, whatever Shift and Caps Lock
+    # say: "c" for c, C and Shift+c. For matching shortcuts
+    def base_key_name
+      return nil unless (key_press? || key_release?) && @connection
+      
+      Keymap.name(@connection.keymap.keysym(key_code, 0))
+    end
+    
+    # Modifier and button mask of key, button and motion events
+    def state
+      case @type
+      when :key_press, :key_release, :button_press, :button_release, :motion_notify
+        @event_ptr.get_uint16(INPUT_STATE)
+      end
     end
     
     def button
       return nil unless button_press? || button_release?
-      @event_ptr.get_uint8(1)  # detail field
+      @event_ptr.get_uint8(KEY_DETAIL)
     end
     
     def x
       case @type
       when :button_press, :button_release, :motion_notify
-        @event_ptr.get_int16(24)  # event_x
+        @event_ptr.get_int16(INPUT_X)
       else
         nil
       end
@@ -69,7 +208,7 @@ module XCB
     def y
       case @type
       when :button_press, :button_release, :motion_notify
-        @event_ptr.get_int16(26)  # event_y
+        @event_ptr.get_int16(INPUT_Y)
       else
         nil
       end
@@ -78,7 +217,7 @@ module XCB
     def root_x
       case @type
       when :button_press, :button_release, :motion_notify
-        @event_ptr.get_int16(20)  # root_x
+        @event_ptr.get_int16(INPUT_ROOT_X)
       else
         nil
       end
@@ -87,7 +226,7 @@ module XCB
     def root_y
       case @type
       when :button_press, :button_release, :motion_notify
-        @event_ptr.get_int16(22)  # root_y
+        @event_ptr.get_int16(INPUT_ROOT_Y)
       else
         nil
       end
@@ -96,9 +235,17 @@ module XCB
     def window_id
       case @type
       when :button_press, :button_release, :motion_notify, :key_press, :key_release
-        @event_ptr.get_uint32(12)  # event window
-      when :expose
-        @event_ptr.get_uint32(4)   # window
+        @event_ptr.get_uint32(INPUT_WINDOW)
+      when :expose, :graphics_exposure, :no_exposure
+        @event_ptr.get_uint32(EXPOSE_WINDOW)        # window / drawable
+      when :property_notify
+        @event_ptr.get_uint32(PROPERTY_WINDOW)
+      when :selection_clear, :selection_request
+        @event_ptr.get_uint32(SELECTION_CLEAR_OWNER)
+      when :selection_notify
+        @event_ptr.get_uint32(SELECTION_NOTIFY_REQUESTOR)
+      when *STRUCTURE_TYPES
+        @event_ptr.get_uint32(STRUCTURE_EVENT)      # the window or its parent
       else
         nil
       end
@@ -106,28 +253,105 @@ module XCB
     
     # Expose event specific
     def expose_x
-      return nil unless expose?
-      @event_ptr.get_int16(8)
+      return nil unless expose? || graphics_exposure?
+      @event_ptr.get_int16(expose? ? EXPOSE_X : GRAPHICS_EXPOSURE_X)
     end
     
     def expose_y
-      return nil unless expose?
-      @event_ptr.get_int16(10)
+      return nil unless expose? || graphics_exposure?
+      @event_ptr.get_int16(expose? ? EXPOSE_Y : GRAPHICS_EXPOSURE_Y)
     end
     
     def expose_width
-      return nil unless expose?
-      @event_ptr.get_uint16(12)
+      return nil unless expose? || graphics_exposure?
+      @event_ptr.get_uint16(expose? ? EXPOSE_WIDTH : GRAPHICS_EXPOSURE_WIDTH)
     end
     
     def expose_height
-      return nil unless expose?
-      @event_ptr.get_uint16(14)
+      return nil unless expose? || graphics_exposure?
+      @event_ptr.get_uint16(expose? ? EXPOSE_HEIGHT : GRAPHICS_EXPOSURE_HEIGHT)
     end
     
     def expose_count
-      return nil unless expose?
-      @event_ptr.get_uint16(16)
+      if expose?
+        @event_ptr.get_uint16(EXPOSE_COUNT)
+      elsif graphics_exposure?
+        @event_ptr.get_uint16(GRAPHICS_EXPOSURE_COUNT)
+      end
+    end
+    
+    # PropertyNotify / selection events
+    def time
+      case @type
+      when :property_notify then @event_ptr.get_uint32(PROPERTY_TIME)
+      when :selection_clear, :selection_request, :selection_notify then @event_ptr.get_uint32(SELECTION_CLEAR_TIME)
+      end
+    end
+    
+    def property_atom
+      case @type
+      when :property_notify then @event_ptr.get_uint32(PROPERTY_ATOM)
+      when :selection_request then @event_ptr.get_uint32(SELECTION_REQUEST_PROPERTY)
+      when :selection_notify then @event_ptr.get_uint32(SELECTION_NOTIFY_PROPERTY)
+      end
+    end
+    
+    def property_deleted?
+      @type == :property_notify && @event_ptr.get_uint8(PROPERTY_STATE) == XCB::XCB_PROPERTY_DELETE
+    end
+    
+    def selection
+      case @type
+      when :selection_clear then @event_ptr.get_uint32(SELECTION_CLEAR_SELECTION)
+      when :selection_request then @event_ptr.get_uint32(SELECTION_REQUEST_SELECTION)
+      when :selection_notify then @event_ptr.get_uint32(SELECTION_NOTIFY_SELECTION)
+      end
+    end
+    
+    def selection_target
+      case @type
+      when :selection_request then @event_ptr.get_uint32(SELECTION_REQUEST_TARGET)
+      when :selection_notify then @event_ptr.get_uint32(SELECTION_NOTIFY_TARGET)
+      end
+    end
+    
+    def requestor
+      case @type
+      when :selection_request then @event_ptr.get_uint32(SELECTION_REQUEST_REQUESTOR)
+      when :selection_notify then @event_ptr.get_uint32(SELECTION_NOTIFY_REQUESTOR)
+      end
+    end
+    
+    # Structure events: the window that changed (window_id is the one
+    # the event was selected on, its parent for SubstructureNotify)
+    def structure?
+      STRUCTURE_TYPES.include?(@type)
+    end
+    
+    def subject_window
+      @event_ptr.get_uint32(STRUCTURE_WINDOW) if structure?
+    end
+    
+    # New parent of a reparented window
+    def parent
+      @event_ptr.get_uint32(REPARENT_PARENT) if @type == :reparent_notify
+    end
+    
+    # [x, y, width, height, border_width] from ConfigureNotify; [x, y] of
+    # a reparented window relative to its new parent
+    def geometry
+      case @type
+      when :configure_notify then @event_ptr.get_bytes(CONFIGURE_X, 10).unpack('s2S3')
+      when :reparent_notify then @event_ptr.get_bytes(REPARENT_X, 4).unpack('s2')
+      end
+    end
+    
+    def override_redirect?
+      case @type
+      when :configure_notify then @event_ptr.get_uint8(CONFIGURE_OVERRIDE_REDIRECT) != 0
+      when :reparent_notify then @event_ptr.get_uint8(REPARENT_OVERRIDE_REDIRECT) != 0
+      when :map_notify then @event_ptr.get_uint8(MAP_OVERRIDE_REDIRECT) != 0
+      end
     end
     
     # Convenience methods
@@ -142,7 +366,7 @@ module XCB
     end
     
     def expose_rect
-      return nil unless expose?
+      return nil unless expose? || graphics_exposure?
       [expose_x, expose_y, expose_width, expose_height]
     end
     
@@ -152,6 +376,7 @@ module XCB
       case @type
       when :key_press, :key_release
         data[:key_code] = key_code
+        data[:key_name] = key_name if @connection&.keymap_loaded?
         data[:window_id] = window_id
       when :button_press, :button_release
         data.merge!(
@@ -166,7 +391,32 @@ module XCB
           root_x: root_x, root_y: root_y,
           window_id: window_id
         )
-      when :expose
+      when :property_notify
+        data.merge!(
+          atom: property_atom,
+          deleted: property_deleted?,
+          window_id: window_id
+        )
+      when :selection_request, :selection_notify
+        data.merge!(
+          selection: selection,
+          target: selection_target,
+          property: property_atom,
+          requestor: requestor
+        )
+      when *STRUCTURE_TYPES
+        data.merge!(
+          window: subject_window,
+          window_id: window_id
+        )
+        data[:geometry] = geometry if geometry
+        data[:parent] = parent if parent
+      when :generic
+        data.merge!(
+          extension_opcode: extension_opcode,
+          event_type: generic_event_type
+        )
+      when :expose, :graphics_exposure
         data.merge!(
           x: expose_x, y: expose_y,
           width: expose_width, height: expose_height,
@@ -1,33 +1,45 @@
 module XCB
   class Font
     attr_reader :connection, :font_id, :name
+    # Ruby Encoding of an 8-bit font, or :char2b for ISO 10646 fonts
+    attr_reader :encoding
     
-    def initialize(connection, font_name)
+    def initialize(connection, font_name, encoding: nil)
       @connection = connection
       @name = font_name
       @font_id = connection.generate_id
+      @encoding = encoding || encoding_from_name(font_name)
       
       load_font
       connection.send(:register_resource, self)
     end
     
+    # QueryFont metrics (without the per-character table), cached:
+    # font_ascent, font_descent, min/max char widths, char range
     def query_info
-      cookie = XCB.xcb_query_font(@connection.connection, @font_id)
-      reply = XCB.xcb_query_font_reply(@connection.connection, cookie, nil)
+      return @info if @info
       
+      conn = @connection.connection
+      cookie = XCB.xcb_query_font(conn, @font_id)
+      reply = @connection.wait_for_reply("QueryFont", 47) { XCB.xcb_query_font_reply(conn, cookie, nil) }
       return nil if reply.null?
       
-      # Извлекаем информацию из reply
-      # Это упрощенная версия - в реальности нужно правильно парсить структуру
-      info = {
-        ascent: reply.read_int16,
-        descent: reply.read_int16
-      }
-      
-      info
-    ensure
-      # Освобождаем память reply
-      # В реальной реализации нужно вызвать free(reply)
+      begin
+        # xcb_query_font_reply_t: min_bounds at 8, max_bounds at 24 (CHARINFO)
+        min_width = reply.get_int16(8 + 4)
+        max_width = reply.get_int16(24 + 4)
+        min_char, max_char, default_char = reply.get_bytes(40, 6).unpack('S3')
+        ascent, descent = reply.get_bytes(52, 4).unpack('s2')
+        @info = { ascent: ascent, descent: descent, min_width: min_width, max_width: max_width,
+                  min_char: min_char, max_char: max_char, default_char: default_char,
+                  min_byte1: reply.get_uint8(49), max_byte1: reply.get_uint8(50) }
+      ensure
+        XCB::LibC.free(reply)
+      end
+    end
+    
+    def wide?
+      @encoding == :char2b
     end
     
     def height
@@ -59,8 +71,19 @@ module XCB
     private
     
     def load_font
-      XCB.xcb_open_font(@connection.connection, @font_id, @name.length, @name)
+      XCB.xcb_open_font(@connection.connection, @font_id, @name.bytesize, @name)
       @connection.flush
     end
+    
+    # XLFD names end in CHARSET_REGISTRY-CHARSET_ENCODING; aliases such as
+    # "fixed" resolve to ISO 8859-1 on standard servers
+    def encoding_from_name(name)
+      registry = name[/-([^-]+-[^-]+)\z/, 1].to_s.downcase
+      return :char2b if registry.start_with?("iso10646")
+      
+      Encoding.find(registry)
+    rescue ArgumentError
+      Encoding::ISO_8859_1
+    end
   end
 end
\ No newline at end of file
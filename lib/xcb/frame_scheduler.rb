@@ -0,0 +1,261 @@
+require_relative '../xcb_wrapper'
+begin
+  require_relative '../xcb_present'
+rescue LoadError
+  # libxcb-present is not installed: FrameScheduler uses its timer pacer
+end
+
+module XCB
+  # Paces an animation to the display. With the Present extension each
+  # frame is rendered into an idle back buffer and queued with
+  # PresentPixmap for the next MSC; its CompleteNotify reports when the
+  # frame reached the screen and triggers the next frame, so every display
+  # interval gets exactly one render. Without Present a timer pacer copies
+  # the back buffer to the window at a fixed rate and measures latency
+  # with a round trip.
+  #
+  #   scheduler = XCB::FrameScheduler.new(window, graphics: { black: { foreground: :black } }) do |frame|
+  #     frame.graphics[:black].fill_rectangle(0, 0, window.width, window.height)
+  #   end
+  #   scheduler.run { |event| :quit if event.key_press? }
+  class FrameScheduler
+    # Passed to the frame block; graphics are GCs bound to this frame's pixmap
+    Frame = Struct.new(:number, :pixmap, :graphics, :target_msc, :interval)
+    Buffer = Struct.new(:pixmap, :graphics, :idle)
+    
+    MAX_BUFFERS = 3
+    
+    attr_reader :window, :mode, :frames, :missed, :skipped, :interval
+    
+    def initialize(window, graphics: {}, rate: 60, present: true, &render)
+      @window = window
+      @connection = window.connection
+      @graphics = graphics
+      @render = render
+      @interval = 1.0 / rate
+      @mode = present && present_available? ? :present : :timer
+      
+      @buffers = []
+      @frames = 0
+      @missed = 0
+      @skipped = 0
+      @latencies = []
+      @started = false
+    end
+    
+    def present?
+      @mode == :present
+    end
+    
+    # Latency is measured from the start of a frame's render until the
+    # server reports it on screen (Present) or processed (timer)
+    def stats
+      latency = @latencies.last
+      { mode: @mode, frames: @frames, missed: @missed, skipped: @skipped,
+        interval_ms: (@interval * 1000).round(2),
+        latency_ms: latency && (latency * 1000).round(2),
+        avg_latency_ms: @latencies.empty? ? nil : (@latencies.sum / @latencies.size * 1000).round(2),
+        max_latency_ms: @latencies.empty? ? nil : (@latencies.max * 1000).round(2) }
+    end
+    
+    def start
+      return self if @started
+      
+      @started = true
+      present? ? start_present : start_timer
+      @connection.flush
+      self
+    end
+    
+    def stop
+      @running = false
+    end
+    
+    # Event loop that interleaves frames with input. Present events are
+    # consumed here; everything else goes to the block (:quit stops)
+    def run
+      start
+      io = IO.for_fd(XCB.xcb_get_file_descriptor(@connection.connection), autoclose: false)
+      @running = true
+      
+      while @running
+        while (event = @connection.poll_for_event)
+          next if handle_event(event)
+          next unless block_given?
+          
+          tracer = @connection.tracer
+          result = tracer ? tracer.span("dispatch", :event, { type: event.type }) { yield(event) } : yield(event)
+          if result == :quit
+            @running = false
+            break
+          end
+        end
+        break unless @running
+        
+        timeout = nil
+        unless present?
+          now = clock
+          if now >= @deadline
+            timer_frame(now)
+            next
+          end
+          timeout = @deadline - now
+        end
+        
+        @connection.flush
+        @connection.traced("select", :wait) { IO.select([io], nil, nil, timeout) }
+      end
+      self
+    end
+    
+    # Consumes PresentCompleteNotify / PresentIdleNotify for this window
+    def handle_event(event)
+      return false unless present? && event.generic? && event.extension_opcode == @opcode
+      
+      ptr = event.event_ptr
+      return false unless ptr.get_uint32(Present::EVENT_EVENT_ID) == @event_id
+      
+      case event.generic_event_type
+      when Present::EVENT_COMPLETE_NOTIFY
+        complete(ptr)
+      when Present::EVENT_IDLE_NOTIFY
+        pixmap_id = ptr.get_uint32(Present::IDLE_PIXMAP)
+        buffer = @buffers.find { |b| b.pixmap.pixmap_id == pixmap_id }
+        buffer.idle = true if buffer
+        present_frame if @waiting_for_buffer
+      end
+      true
+    end
+    
+    def cleanup
+      @buffers.each do |buffer|
+        buffer.graphics.each_value(&:cleanup)
+        buffer.pixmap.cleanup
+      end
+      @buffers.clear
+    end
+    
+    def inspect
+      "#<XCB::FrameScheduler #{@mode} frames=#{@frames} missed=#{@missed}>"
+    end
+    
+    private
+    
+    def present_available?
+      defined?(Present) && @connection.extension(Present::ID) ? true : false
+    end
+    
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+    
+    # === PRESENT ===
+    
+    def start_present
+      conn = @connection.connection
+      cookie = Present.xcb_present_query_version(conn, 1, 0)
+      reply = @connection.wait_for_reply("PresentQueryVersion", "Present:0") { Present.xcb_present_query_version_reply(conn, cookie, nil) }
+      XCB::LibC.free(reply) unless reply.null?
+      
+      @opcode = @connection.extension(Present::ID)[:major_opcode]
+      @event_id = @connection.generate_id
+      @serial = 0
+      @in_flight = {}
+      Present.xcb_present_select_input(conn, @event_id, @window.window_id,
+                                       Present::EVENT_MASK_COMPLETE_NOTIFY | Present::EVENT_MASK_IDLE_NOTIFY)
+      
+      # The first frame targets the MSC after the current one
+      Present.xcb_present_notify_msc(conn, @window.window_id, 0, 0, 0, 0)
+    end
+    
+    def complete(ptr)
+      msc = ptr.get_uint64(Present::COMPLETE_MSC)
+      ust = ptr.get_uint64(Present::COMPLETE_UST)
+      
+      if ptr.get_uint8(Present::COMPLETE_KIND) == Present::COMPLETE_KIND_PIXMAP
+        target_msc, started = @in_flight.delete(ptr.get_uint32(Present::EVENT_SERIAL))
+        if target_msc
+          @skipped += 1 if ptr.get_uint8(Present::COMPLETE_MODE) == Present::COMPLETE_MODE_SKIP
+          @missed += msc - target_msc if msc > target_msc
+          record_latency(clock - started)
+        end
+        # Measured display interval between consecutive presented frames
+        if @last_ust && msc > @last_msc && ust > @last_ust
+          @interval = (ust - @last_ust) / 1_000_000.0 / (msc - @last_msc)
+        end
+        @last_ust = ust
+        @last_msc = msc
+      end
+      
+      @msc = msc
+      present_frame if @in_flight.empty?
+    end
+    
+    def present_frame
+      buffer = acquire_buffer
+      unless buffer
+        @waiting_for_buffer = true
+        return
+      end
+      @waiting_for_buffer = false
+      
+      started = clock
+      target_msc = @msc + 1
+      render(buffer, target_msc)
+      
+      @serial += 1
+      @in_flight[@serial] = [target_msc, started]
+      buffer.idle = false
+      @window.present_pixmap(buffer.pixmap, serial: @serial, target_msc: target_msc)
+      @connection.flush
+    end
+    
+    # === TIMER FALLBACK ===
+    
+    def start_timer
+      @deadline = clock
+      @blit_gc = @window.create_graphics_context(graphics_exposures: false)
+    end
+    
+    def timer_frame(now)
+      late = ((now - @deadline) / @interval).floor
+      @missed += late
+      @deadline += (late + 1) * @interval
+      
+      buffer = acquire_buffer
+      render(buffer, nil)
+      @connection.encoder.copy_area(buffer.pixmap, @window, @blit_gc, 0, 0, 0, 0,
+                                    buffer.pixmap.width, buffer.pixmap.height)
+      @connection.sync
+      record_latency(clock - now)
+    end
+    
+    # === BUFFERS ===
+    
+    def acquire_buffer
+      buffer = @buffers.find(&:idle)
+      return buffer if buffer
+      return nil if @buffers.size >= (present? ? MAX_BUFFERS : 1)
+      
+      pixmap = XCB::Pixmap.new(@connection, @window.window_id, @window.width, @window.height)
+      graphics = @graphics.to_h { |name, options| [name, pixmap.create_graphics_context(options)] }
+      buffer = Buffer.new(pixmap, graphics, true)
+      @buffers << buffer
+      buffer
+    end
+    
+    def render(buffer, target_msc)
+      @frames += 1
+      return unless @render
+      
+      @connection.traced("frame", :draw, :frame, @frames) do
+        @render.call(Frame.new(@frames, buffer.pixmap, buffer.graphics, target_msc, @interval))
+      end
+    end
+    
+    def record_latency(seconds)
+      @latencies << seconds
+      @latencies.shift if @latencies.size > 120
+    end
+  end
+end
@@ -0,0 +1,44 @@
+require 'ffi'
+
+module XCB
+  # Minimal FreeType bindings for client-side glyph rasterization
+  module FreeType
+    extend FFI::Library
+    
+    ffi_lib ['freetype', 'libfreetype.so.6']
+    
+    LOAD_RENDER = 0x4
+    PIXEL_MODE_GRAY = 2
+    
+    # Field offsets on LP64 (FT_FaceRec, FT_SizeRec, FT_GlyphSlotRec, FT_Bitmap)
+    FACE_GLYPH = 152
+    FACE_SIZE = 160
+    SIZE_ASCENDER = 48
+    SIZE_DESCENDER = 56
+    SIZE_HEIGHT = 64
+    SLOT_ADVANCE_X = 128
+    SLOT_BITMAP = 152
+    SLOT_BITMAP_LEFT = 192
+    SLOT_BITMAP_TOP = 196
+    BITMAP_ROWS = 0
+    BITMAP_WIDTH = 4
+    BITMAP_PITCH = 8
+    BITMAP_BUFFER = 16
+    BITMAP_PIXEL_MODE = 26
+    
+    attach_function :init_freetype, :FT_Init_FreeType, [:pointer], :int
+    attach_function :new_face, :FT_New_Face, [:pointer, :string, :long, :pointer], :int
+    attach_function :set_pixel_sizes, :FT_Set_Pixel_Sizes, [:pointer, :uint, :uint], :int
+    attach_function :load_char, :FT_Load_Char, [:pointer, :ulong, :int32], :int
+    attach_function :done_face, :FT_Done_Face, [:pointer], :int
+    
+    def self.library
+      @library ||= begin
+        ptr = FFI::MemoryPointer.new(:pointer)
+        raise XCBError, "FT_Init_FreeType failed" if init_freetype(ptr) != 0
+        
+        ptr.read_pointer
+      end
+    end
+  end
+end
@@ -0,0 +1,294 @@
+require_relative 'picture'
+require_relative 'freetype'
+
+module XCB
+  # Client-side rasterizer for a TrueType/OpenType font file
+  class GlyphFont
+    SEARCH_PATHS = %w[
+      /usr/share/fonts/truetype/dejavu/DejaVuSans.ttf
+      /usr/share/fonts/TTF/DejaVuSans.ttf
+      /usr/share/fonts/dejavu/DejaVuSans.ttf
+      /usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf
+      /usr/share/fonts/noto/NotoSans-Regular.ttf
+    ].freeze
+    
+    # Alpha image in RENDER AddGlyphs layout (rows padded to 4 bytes)
+    Glyph = Struct.new(:width, :height, :x, :y, :x_off, :data)
+    
+    attr_reader :path, :size, :ascent, :descent, :line_height
+    
+    # XCB_FONT overrides the search for a system font file
+    def self.default_path
+      path = ENV['XCB_FONT'] || SEARCH_PATHS.find { |p| File.exist?(p) } ||
+             Dir.glob("/usr/share/fonts/**/*.{ttf,otf}").first
+      raise XCBError, "No font file found; set XCB_FONT" unless path
+      
+      path
+    end
+    
+    def initialize(path = nil, size: 13)
+      @path = path || self.class.default_path
+      @size = size
+      
+      face = FFI::MemoryPointer.new(:pointer)
+      if FreeType.new_face(FreeType.library, @path, 0, face) != 0
+        raise XCBError, "Cannot load font file #{@path}"
+      end
+      @face = face.read_pointer
+      FreeType.set_pixel_sizes(@face, 0, size)
+      
+      metrics = @face.get_pointer(FreeType::FACE_SIZE)
+      @ascent = metrics.get_long(FreeType::SIZE_ASCENDER) >> 6
+      @descent = -(metrics.get_long(FreeType::SIZE_DESCENDER) >> 6)
+      @line_height = metrics.get_long(FreeType::SIZE_HEIGHT) >> 6
+    end
+    
+    # Codepoints without a glyph in the face rasterize as .notdef
+    def rasterize(codepoint)
+      raise XCBError, "FT_Load_Char failed for U+%04X" % codepoint if FreeType.load_char(@face, codepoint, FreeType::LOAD_RENDER) != 0
+      
+      slot = @face.get_pointer(FreeType::FACE_GLYPH)
+      bitmap = slot + FreeType::SLOT_BITMAP
+      rows = bitmap.get_uint32(FreeType::BITMAP_ROWS)
+      width = bitmap.get_uint32(FreeType::BITMAP_WIDTH)
+      pitch = bitmap.get_int32(FreeType::BITMAP_PITCH)
+      buffer = bitmap.get_pointer(FreeType::BITMAP_BUFFER)
+      gray = bitmap.get_uint8(FreeType::BITMAP_PIXEL_MODE) == FreeType::PIXEL_MODE_GRAY
+      
+      stride = (width + 3) & ~3
+      padding = "\0".b * (stride - width)
+      data = String.new(capacity: stride * rows, encoding: Encoding::BINARY)
+      rows.times do |row|
+        line = buffer.get_bytes(row * pitch, pitch.abs)
+        data << (gray ? line.byteslice(0, width) : expand_mono(line, width)) << padding
+      end
+      
+      Glyph.new(width, rows,
+                -slot.get_int32(FreeType::SLOT_BITMAP_LEFT), slot.get_int32(FreeType::SLOT_BITMAP_TOP),
+                (slot.get_long(FreeType::SLOT_ADVANCE_X) + 32) >> 6, data)
+    end
+    
+    def close
+      FreeType.done_face(@face) unless @face.null?
+      @face = FFI::Pointer::NULL
+    end
+    
+    def inspect
+      "#<XCB::GlyphFont #{File.basename(@path)} #{@size}px>"
+    end
+    
+    private
+    
+    def expand_mono(line, width)
+      line.unpack1("B#{width}").tr("01", "\x00\xff".b).b
+    end
+  end
+  
+  # Server-side GlyphSet of antialiased glyphs. Glyph ids are codepoints;
+  # glyphs are uploaded once and evicted least-recently-used when the
+  # uploaded image bytes exceed max_bytes
+  class GlyphCache
+    attr_reader :connection, :font, :glyphset_id, :format, :max_bytes, :bytes,
+                :hits, :misses, :evictions
+    
+    def initialize(connection, font, max_bytes: 1 << 20)
+      @connection = connection
+      @font = font
+      @max_bytes = max_bytes
+      @format = Picture.standard_format(connection, Render::PICT_STANDARD_A_8)
+      @glyphset_id = connection.generate_id
+      Render.xcb_render_create_glyph_set(connection.connection, @glyphset_id, @format)
+      
+      # codepoint => [image bytes, advance], oldest first
+      @entries = {}
+      @bytes = 0
+      @hits = 0
+      @misses = 0
+      @evictions = 0
+      connection.send(:register_resource, self)
+    end
+    
+    # Upload whatever is missing and mark everything as recently used
+    def prepare(codepoints)
+      missing = nil
+      codepoints.each do |cp|
+        if (entry = @entries.delete(cp))
+          @entries[cp] = entry
+          @hits += 1
+        else
+          (missing ||= {})[cp] = true
+        end
+      end
+      upload(missing.keys, codepoints) if missing
+      self
+    end
+    
+    # Horizontal advance in pixels of an uploaded glyph
+    def advance(codepoint)
+      @entries[codepoint][1]
+    end
+    
+    def size
+      @entries.size
+    end
+    
+    def stats
+      { glyphs: @entries.size, bytes: @bytes, max_bytes: @max_bytes,
+        hits: @hits, misses: @misses, evictions: @evictions }
+    end
+    
+    def cleanup
+      Render.xcb_render_free_glyph_set(@connection.connection, @glyphset_id) rescue nil
+    end
+    
+    def inspect
+      "#<XCB::GlyphCache #{@font.inspect} glyphs=#{@entries.size} bytes=#{@bytes}/#{@max_bytes}>"
+    end
+    
+    private
+    
+    def upload(codepoints, pinned)
+      glyphs = codepoints.map { |cp| @font.rasterize(cp) }
+      @misses += codepoints.size
+      
+      incoming = glyphs.sum { |g| g.data.bytesize }
+      evict(@bytes + incoming - @max_bytes, pinned) if @bytes + incoming > @max_bytes
+      
+      # One AddGlyphs request per chunk that fits the request length
+      limit = @connection.maximum_request_length - 64
+      start = 0
+      while start < glyphs.size
+        stop = start
+        size = 0
+        while stop < glyphs.size && (stop == start || size + glyphs[stop].data.bytesize + 16 <= limit)
+          size += glyphs[stop].data.bytesize + 16
+          stop += 1
+        end
+        add_glyphs(codepoints[start...stop], glyphs[start...stop])
+        start = stop
+      end
+      
+      codepoints.each_with_index do |cp, i|
+        @entries[cp] = [glyphs[i].data.bytesize, glyphs[i].x_off]
+        @bytes += glyphs[i].data.bytesize
+      end
+    end
+    
+    def add_glyphs(ids, glyphs)
+      ids_ptr = FFI::MemoryPointer.new(:uint32, ids.size)
+      ids_ptr.write_array_of_uint32(ids)
+      
+      info_ptr = FFI::MemoryPointer.new(Render::GlyphInfo, glyphs.size)
+      glyphs.each_with_index do |g, i|
+        info_ptr.put_array_of_int16(i * Render::GlyphInfo.size, [g.width, g.height, g.x, g.y, g.x_off, 0])
+      end
+      
+      data = glyphs.map(&:data).join
+      Render.xcb_render_add_glyphs(@connection.connection, @glyphset_id, ids.size, ids_ptr,
+                                   info_ptr, data.bytesize, data)
+    end
+    
+    # Free the oldest glyphs that the current draw does not need
+    def evict(needed, pinned)
+      pinned = pinned.to_h { |cp| [cp, true] }
+      victims = []
+      freed = 0
+      @entries.each do |cp, (size, _)|
+        break if freed >= needed
+        next if pinned[cp]
+        
+        victims << cp
+        freed += size
+      end
+      return if victims.empty?
+      
+      victims.each { |cp| @bytes -= @entries.delete(cp)[0] }
+      @evictions += victims.size
+      
+      Render.xcb_render_free_glyphs(@connection.connection, @glyphset_id, victims.size,
+                                    @connection.scratch.uint32_array(victims))
+    end
+  end
+  
+  # Antialiased text on a window or pixmap: CompositeGlyphs requests that
+  # carry only glyph indices, batched across lines
+  class TextRenderer
+    ELT_MAX = 254
+    
+    attr_reader :cache, :picture
+    
+    def initialize(drawable, cache)
+      @connection = drawable.connection
+      @cache = cache
+      @picture = Picture.new(drawable)
+      @sources = {}
+    end
+    
+    def draw(x, y, text, color: 0x000000)
+      draw_lines([[x, y, text]], color: color)
+    end
+    
+    # lines: [[x, y, text], ...] drawn with one CompositeGlyphs request
+    # (split only at the maximum request length). Every glyph is uploaded
+    # before anything is composited, so eviction never frees a glyph that
+    # a queued command still refers to
+    def draw_lines(lines, color: 0x000000)
+      source = @sources[color] ||= Picture.solid(@connection, color)
+      runs = lines.filter_map do |x, y, text|
+        codepoints = text.to_s.encode(Encoding::UTF_8, invalid: :replace, undef: :replace).codepoints
+        [x, y, codepoints] unless codepoints.empty?
+      end
+      return self if runs.empty?
+      
+      @cache.prepare(runs.flat_map(&:last).uniq)
+      
+      limit = @connection.maximum_request_length - 28
+      commands = String.new(encoding: Encoding::BINARY)
+      pen_x = 0
+      pen_y = 0
+      
+      runs.each do |x, y, codepoints|
+        line = encode_line(codepoints, x - pen_x, y - pen_y)
+        
+        if commands.bytesize + line.bytesize > limit && !commands.empty?
+          composite(source, commands)
+          commands.clear
+          line = encode_line(codepoints, x, y)
+        end
+        
+        commands << line
+        pen_x = x + codepoints.sum { |cp| @cache.advance(cp) }
+        pen_y = y
+      end
+      
+      composite(source, commands)
+      @connection.flush
+      self
+    end
+    
+    def cleanup
+      @sources.each_value(&:cleanup)
+      @picture.cleanup
+    end
+    
+    private
+    
+    # GLYPHELT32 items: the first carries the move, continuations a zero delta
+    def encode_line(codepoints, dx, dy)
+      bytes = String.new(encoding: Encoding::BINARY)
+      codepoints.each_slice(ELT_MAX) do |slice|
+        [slice.size, dx, dy].pack('Cx3s2', buffer: bytes)
+        slice.pack('L*', buffer: bytes)
+        dx = 0
+        dy = 0
+      end
+      bytes
+    end
+    
+    def composite(source, commands)
+      Render.xcb_render_composite_glyphs_32(@connection.connection, Render::PICT_OP_OVER,
+                                            source.picture_id, @picture.picture_id, @cache.format,
+                                            @cache.glyphset_id, 0, 0, commands.bytesize, commands)
+    end
+  end
+end
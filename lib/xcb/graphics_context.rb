@@ -8,6 +8,10 @@ module XCB
       font: nil
     }.freeze
     
+    # Strictest first, for set_clip_rectangles(ordering: :auto)
+    CLIP_ORDERINGS = [XCB::XCB_CLIP_ORDERING_YX_BANDED, XCB::XCB_CLIP_ORDERING_YX_SORTED,
+                      XCB::XCB_CLIP_ORDERING_Y_SORTED].freeze
+    
     def initialize(connection, window, options = {})
       @connection = connection
       @window = window
@@ -17,45 +21,28 @@ module XCB
       create_graphics_context
     end
     
-    # Drawing operations
+    # Drawing operations (arguments are written into the connection's
+    # scratch arena, no per-call native allocation)
     def draw_point(x, y)
-      point = XCB::Point.new
-      point[:x] = x
-      point[:y] = y
-      
-      XCB.xcb_poly_point(@connection.connection, 0, @window.window_id, @gc_id, 1, point)
+      XCB.xcb_poly_point(@connection.connection, XCB::XCB_COORD_MODE_ORIGIN, @window.drawable_id, @gc_id,
+                         1, @connection.scratch.point(x, y))
       @connection.flush
       self
     end
     
     def draw_line(x1, y1, x2, y2)
-      points = FFI::MemoryPointer.new(XCB::Point, 2)
-      
-      point1 = XCB::Point.new(points[0])
-      point1[:x] = x1
-      point1[:y] = y1
-      
-      point2 = XCB::Point.new(points[1])
-      point2[:x] = x2
-      point2[:y] = y2
-      
-      XCB.xcb_poly_line(@connection.connection, XCB::XCB_COORD_MODE_ORIGIN, 
-                        @window.window_id, @gc_id, 2, points)
+      XCB.xcb_poly_line(@connection.connection, XCB::XCB_COORD_MODE_ORIGIN,
+                        @window.drawable_id, @gc_id, 2, @connection.scratch.points(x1, y1, x2, y2))
       @connection.flush
       self
     end
     
     def draw_rectangle(x, y, width, height, filled: false)
-      rect = XCB::Rectangle.new
-      rect[:x] = x
-      rect[:y] = y
-      rect[:width] = width
-      rect[:height] = height
-      
+      rect = @connection.scratch.rectangle(x, y, width, height)
       if filled
-        XCB.xcb_poly_fill_rectangle(@connection.connection, @window.window_id, @gc_id, 1, rect)
+        XCB.xcb_poly_fill_rectangle(@connection.connection, @window.drawable_id, @gc_id, 1, rect)
       else
-        XCB.xcb_poly_rectangle(@connection.connection, @window.window_id, @gc_id, 1, rect)
+        XCB.xcb_poly_rectangle(@connection.connection, @window.drawable_id, @gc_id, 1, rect)
       end
       
       @connection.flush
@@ -66,11 +53,72 @@ module XCB
       draw_rectangle(x, y, width, height, filled: true)
     end
     
+    # Text is transcoded to the font's encoding (CHAR2B for ISO 10646
+    # fonts); ImageText takes at most 255 characters per request
     def draw_text(x, y, text)
       raise XCBError, "No font set for graphics context" unless @font
       
-      XCB.xcb_image_text_8(@connection.connection, text.length, @window.window_id, 
-                           @gc_id, x, y, text)
+      bytes = Text.encode(text, @font)
+      if Text.wide?(@font)
+        XCB.xcb_image_text_16(@connection.connection, [bytes.bytesize / 2, 255].min,
+                              @window.drawable_id, @gc_id, x, y, bytes)
+      else
+        XCB.xcb_image_text_8(@connection.connection, [bytes.bytesize, 255].min,
+                             @window.drawable_id, @gc_id, x, y, bytes)
+      end
+      @connection.flush
+      self
+    end
+    
+    # Draw many lines at once: one PolyText request per line, all written
+    # through the connection's encoder with a single flush
+    #   gc.draw_texts([[10, 20, "first"], [10, 36, "second"]])
+    def draw_texts(lines)
+      raise XCBError, "No font set for graphics context" unless @font
+      
+      encoder = @connection.encoder
+      @connection.traced("draw_texts", :draw, :lines, lines.size) do
+        lines.each do |x, y, text|
+          items = text.is_a?(TextItems) ? text : TextItems.new(@font).text(text)
+          encoder.poly_text(@window, self, x, y, items)
+        end
+      end
+      @connection.flush
+      self
+    end
+    
+    # One PolyText line with per-item deltas and font switches
+    #   gc.draw_text_items(10, 20) { |t| t.text("Name"); t.font(bold); t.text("42", delta: 8) }
+    def draw_text_items(x, y)
+      raise XCBError, "No font set for graphics context" unless @font
+      
+      items = TextItems.new(@font)
+      yield items
+      @connection.encoder.poly_text(@window, self, x, y, items)
+      @connection.flush
+      self
+    end
+    
+    def text_items
+      TextItems.new(@font)
+    end
+    
+    # Upload raw ZPixmap data, split into row strips that fit the
+    # server's maximum request length. depth defaults to the drawable's
+    def put_image(x, y, width, height, data, depth: nil)
+      depth ||= @window.respond_to?(:depth) ? @window.depth : @window.screen.depth
+      stride = data.bytesize / height
+      rows_per_request = [(@connection.maximum_request_length - 32) / stride, 1].max
+      
+      row = 0
+      while row < height
+        rows = [rows_per_request, height - row].min
+        XCB.xcb_put_image(@connection.connection, XCB::XCB_IMAGE_FORMAT_Z_PIXMAP,
+                          @window.drawable_id, @gc_id, width, rows, x, y + row,
+                          0, depth, stride * rows, data.byteslice(stride * row, stride * rows))
+        row += rows
+      end
+      
       @connection.flush
       self
     end
@@ -100,6 +148,62 @@ module XCB
       self
     end
     
+    # Clipping. The current clip is remembered, so redrawing the same
+    # area again (one clip per Expose batch, several GCs) sends nothing.
+    # rectangles are [x, y, width, height] arrays relative to x/y; with
+    # ordering :auto they are sorted by y then x and sent with the
+    # strictest ordering they satisfy (YX_BANDED lets the server skip its
+    # own sort). An explicit ordering the list does not satisfy raises
+    # instead of earning a BadMatch
+    def set_clip_rectangles(rectangles, x: 0, y: 0, ordering: :auto)
+      if ordering == :auto
+        rectangles = rectangles.sort_by { |rx, ry, _w, _h| [ry, rx] }
+        ordering = CLIP_ORDERINGS.find { |candidate| clip_order?(rectangles, candidate) }
+      elsif !clip_order?(rectangles, ordering)
+        raise XCBError, "Clip rectangles do not satisfy ordering #{ordering}"
+      end
+      
+      state = [:rectangles, rectangles.map(&:dup), x, y]
+      return self if @clip == state
+      
+      XCB.xcb_set_clip_rectangles(@connection.connection, ordering, @gc_id, x, y, rectangles.size,
+                                  @connection.scratch.rectangles(rectangles))
+      @connection.flush
+      @clip = state
+      self
+    end
+    
+    # Clip to an XFixes region (require 'xcb/region'); the server copies
+    # it, so a region changed afterwards is sent again on the next call
+    def set_clip_region(region, x: 0, y: 0)
+      raise XCBError, "Region support is not loaded (require 'xcb/region')" unless defined?(Region)
+      
+      state = [:region, region.region_id, region.version, x, y]
+      return self if @clip == state
+      
+      XFixes.xcb_xfixes_set_gc_clip_region(@connection.connection, @gc_id, region.region_id, x, y)
+      @connection.flush
+      @clip = state
+      self
+    end
+    
+    def clear_clip
+      return self if @clip == :none
+      
+      change_gc(XCB::XCB_GC_CLIP_MASK, XCB::XCB_NONE)
+      @clip = :none
+      self
+    end
+    
+    # Draw inside a region or list of rectangles, then drop the clip
+    #   gc.with_clip(exposed) { strokes.each { |s| gc.draw_line(*s) } }
+    def with_clip(area)
+      area.is_a?(Array) ? set_clip_rectangles(area) : set_clip_region(area)
+      yield self
+    ensure
+      clear_clip
+    end
+    
     def cleanup
       XCB.xcb_free_gc(@connection.connection, @gc_id) rescue nil
     end
@@ -111,49 +215,55 @@ module XCB
     private
     
     def create_graphics_context
-      mask = 0
-      values = []
-      
-      # Foreground
-      if @options[:foreground]
-        mask |= XCB::XCB_GC_FOREGROUND
-        values << resolve_color(@options[:foreground])
-      end
-      
-      # Background
-      if @options[:background]
-        mask |= XCB::XCB_GC_BACKGROUND
-        values << resolve_color(@options[:background])
-      end
+      values = @connection.scratch.value_list
+      values.set(XCB::XCB_GC_FOREGROUND, resolve_color(@options[:foreground])) if @options[:foreground]
+      values.set(XCB::XCB_GC_BACKGROUND, resolve_color(@options[:background])) if @options[:background]
       
-      # Font
       if @options[:font]
         @font = @options[:font]
-        mask |= XCB::XCB_GC_FONT
-        font_id = @font.respond_to?(:font_id) ? @font.font_id : @font
-        values << font_id
+        values.set(XCB::XCB_GC_FONT, @font.respond_to?(:font_id) ? @font.font_id : @font)
       end
       
-      # Create values array
-      if values.any?
-        values_ptr = FFI::MemoryPointer.new(:uint32, values.size)
-        values.each_with_index { |val, i| values_ptr[i].write_uint32(val) }
-      else
-        values_ptr = nil
-        mask = 0
+      # Depth-1 pixmap: only pixels set in the mask are drawn
+      if @options[:clip_mask]
+        mask = @options[:clip_mask]
+        values.set(XCB::XCB_GC_CLIP_MASK, mask.respond_to?(:drawable_id) ? mask.drawable_id : mask)
       end
+      @clip = @options[:clip_mask] ? :mask : :none
       
-      XCB.xcb_create_gc(@connection.connection, @gc_id, @window.window_id, mask, values_ptr)
+      # GraphicsExpose/NoExpose events for CopyArea
+      unless @options[:graphics_exposures].nil?
+        values.set(XCB::XCB_GC_GRAPHICS_EXPOSURES, @options[:graphics_exposures] ? 1 : 0)
+      end
+      
+      XCB.xcb_create_gc(@connection.connection, @gc_id, @window.drawable_id, values.mask, values.pointer)
     end
     
     def change_gc(mask, value)
-      values_ptr = FFI::MemoryPointer.new(:uint32, 1)
-      values_ptr.write_uint32(value)
-      
-      XCB.xcb_change_gc(@connection.connection, @gc_id, mask, values_ptr)
+      XCB.xcb_change_gc(@connection.connection, @gc_id, mask, @connection.scratch.uint32(value))
       @connection.flush
     end
     
+    # The server's check (VerifyRectOrder): YX_SORTED rectangles with the
+    # same y must not overlap in x; YX_BANDED ones also share the height
+    # of their band, and a new band starts below the previous one
+    def clip_order?(rectangles, ordering)
+      return true if ordering == XCB::XCB_CLIP_ORDERING_UNSORTED
+      
+      rectangles.each_cons(2).all? do |(ax, ay, aw, ah), (bx, by, _bw, bh)|
+        case ordering
+        when XCB::XCB_CLIP_ORDERING_Y_SORTED
+          by >= ay
+        when XCB::XCB_CLIP_ORDERING_YX_SORTED
+          by > ay || (by == ay && bx >= ax + aw)
+        when XCB::XCB_CLIP_ORDERING_YX_BANDED
+          by == ay ? bh == ah && bx >= ax + aw : by >= ay + ah
+        else
+          false
+        end
+      end
+    end
+    
     def resolve_color(color)
       case color
       when :white then @window.screen.white_pixel
@@ -0,0 +1,179 @@
+require_relative '../xcb_wrapper'
+require_relative '../xcb_xinput'
+
+module XCB
+  # XInput 2 pointer input with its own event queue. Device and raw motion
+  # are selected for a window (raw events on the root, where XI2 delivers
+  # them) and diverted from the core queue as they are read; samples keep
+  # subpixel coordinates and server timestamps and are handed out in
+  # batches, so a drawing app sees every sample while core events such as
+  # Expose and KeyPress are dispatched without waiting behind them.
+  #
+  # libxcb's special event queues (xcb_register_for_special_xge) match on
+  # an event id at byte 12, which XI2 events use for the timestamp, so the
+  # queue is kept here and fed through Connection#add_event_route.
+  #
+  #   input = XCB::Input.new(window, events: [:motion, :button_press, :button_release])
+  #   input.on_batch { |samples| samples.each { |s| p [s.x, s.y, s.time] } }
+  #   app.run { |event| ... }            # batches fire between core events
+  class Input
+    # x/y are window-relative, root_x/root_y root-relative (Float);
+    # dx/dy are unaccelerated deltas of raw motion
+    Sample = Struct.new(:type, :device, :source, :time, :window, :x, :y,
+                        :root_x, :root_y, :dx, :dy, :detail, :flags)
+    
+    EVENTS = {
+      motion: XInput::EVENT_MOTION,
+      button_press: XInput::EVENT_BUTTON_PRESS,
+      button_release: XInput::EVENT_BUTTON_RELEASE,
+      raw_motion: XInput::EVENT_RAW_MOTION,
+      raw_button_press: XInput::EVENT_RAW_BUTTON_PRESS,
+      raw_button_release: XInput::EVENT_RAW_BUTTON_RELEASE
+    }.freeze
+    
+    RAW_EVENTS = %i[raw_motion raw_button_press raw_button_release].freeze
+    
+    attr_reader :connection, :window, :events, :max_batch, :samples_received, :batches
+    
+    def initialize(window, events: [:motion], device: XInput::DEVICE_ALL_MASTER, max_batch: 512)
+      @connection = window.connection
+      @window = window
+      @events = events
+      @device = device
+      @max_batch = max_batch
+      @queue = []
+      @samples_received = 0
+      @batches = 0
+      @types = EVENTS.invert
+      
+      unknown = events - EVENTS.keys
+      raise ArgumentError, "Unknown XInput events: #{unknown.join(', ')}" if unknown.any?
+      
+      @opcode = @connection.require_extension(XInput::ID, "XInputExtension")[:major_opcode]
+      query_version
+      select_events
+      @connection.add_event_route(@opcode, self)
+    end
+    
+    # Called with each batch of samples once the socket has been drained
+    # (or the queue reaches max_batch)
+    def on_batch(&block)
+      @on_batch = block
+      self
+    end
+    
+    # Take every queued sample, for loops that poll instead of on_batch
+    def drain
+      samples = @queue
+      @queue = []
+      samples
+    end
+    
+    def pending?
+      !@queue.empty?
+    end
+    
+    # Event route: parse and free XI2 events, leave others to the core queue
+    def push(event)
+      ptr = event.event_ptr
+      sample = parse(event.generic_event_type, ptr)
+      return false unless sample
+      
+      XCB::LibC.free(ptr)
+      @queue << sample
+      @samples_received += 1
+      flush if @queue.size >= @max_batch
+      true
+    end
+    
+    def flush
+      return if @queue.empty? || !@on_batch
+      
+      @batches += 1
+      @on_batch.call(drain)
+    end
+    
+    def stats
+      { samples: @samples_received, batches: @batches, queued: @queue.size }
+    end
+    
+    def close
+      @connection.remove_event_route(@opcode)
+      @queue.clear
+    end
+    
+    def inspect
+      "#<XCB::Input events=#{@events.inspect} samples=#{@samples_received} batches=#{@batches}>"
+    end
+    
+    private
+    
+    def query_version
+      conn = @connection.connection
+      cookie = XInput.xcb_input_xi_query_version(conn, 2, 2)
+      reply = @connection.wait_for_reply("XIQueryVersion", "XInputExtension:47") do
+        XInput.xcb_input_xi_query_version_reply(conn, cookie, nil)
+      end
+      raise XCBError, "XInput 2 is not supported by the server" if reply.null?
+      
+      XCB::LibC.free(reply)
+    end
+    
+    # One xcb_input_event_mask_t per window: deviceid, mask_len, mask
+    def select_events
+      raw, device = @events.partition { |e| RAW_EVENTS.include?(e) }
+      select_mask(@window.window_id, device) if device.any?
+      select_mask(@window.screen.root_window, raw) if raw.any?
+      @connection.flush
+    end
+    
+    def select_mask(window_id, events)
+      mask = events.sum { |e| 1 << EVENTS[e] }
+      data = [@device, 1, mask].pack('SSL')
+      XInput.xcb_input_xi_select_events(@connection.connection, window_id, 1, data)
+    end
+    
+    def parse(evtype, ptr)
+      type = @types[evtype]
+      return nil unless type && @events.include?(type)
+      
+      if RAW_EVENTS.include?(type)
+        parse_raw(type, ptr)
+      else
+        Sample.new(type, ptr.get_uint16(XInput::DEVICE_ID), ptr.get_uint16(XInput::SOURCE_ID),
+                   ptr.get_uint32(XInput::TIME), ptr.get_uint32(XInput::EVENT_WINDOW),
+                   fp1616(ptr, XInput::EVENT_X), fp1616(ptr, XInput::EVENT_Y),
+                   fp1616(ptr, XInput::ROOT_X), fp1616(ptr, XInput::ROOT_Y),
+                   nil, nil, ptr.get_uint32(XInput::DETAIL), ptr.get_uint32(XInput::FLAGS))
+      end
+    end
+    
+    # Raw events carry a valuator mask followed by the accelerated and the
+    # raw FP3232 values of each set valuator; axes 0 and 1 are x and y
+    def parse_raw(type, ptr)
+      words = ptr.get_uint16(XInput::RAW_VALUATORS_LEN)
+      mask = ptr.get_array_of_uint32(XInput::RAW_VALUATOR_MASK, words)
+      axes = []
+      mask.each_with_index do |bits, word|
+        32.times { |bit| axes << word * 32 + bit if bits[bit] == 1 }
+      end
+      
+      raw_values = XInput::RAW_VALUATOR_MASK + words * 4 + axes.size * 8
+      dx = axes.index(0)
+      dy = axes.index(1)
+      Sample.new(type, ptr.get_uint16(XInput::DEVICE_ID), ptr.get_uint16(XInput::RAW_SOURCE_ID),
+                 ptr.get_uint32(XInput::TIME), nil, nil, nil, nil, nil,
+                 dx ? fp3232(ptr, raw_values + dx * 8) : 0.0,
+                 dy ? fp3232(ptr, raw_values + dy * 8) : 0.0,
+                 ptr.get_uint32(XInput::DETAIL), ptr.get_uint32(XInput::RAW_FLAGS))
+    end
+    
+    def fp1616(ptr, offset)
+      ptr.get_int32(offset) / 65536.0
+    end
+    
+    def fp3232(ptr, offset)
+      ptr.get_int32(offset) + ptr.get_uint32(offset + 4) / 4_294_967_296.0
+    end
+  end
+end
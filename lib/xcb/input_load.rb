@@ -0,0 +1,215 @@
+require_relative '../xcb_wrapper'
+require_relative '../xcb_xtest'
+
+module XCB
+  # Synthetic input load for a window, injected with XTEST FakeInput from
+  # a second connection (meant for a private Xvfb: the real pointer and
+  # keyboard are moved). A plan of motion, button and key events is built
+  # up front; an injector thread sends it at the target rate while the
+  # window's connection reads and handles the events. Every received
+  # event is matched to its injection, so the report has end-to-end
+  # latency (request queued to handler return), throughput and how many
+  # events were coalesced (motion) or dropped.
+  #
+  #   load = XCB::InputLoad.new(window, rate: 5000, count: 20_000)
+  #   report = load.run { |event| app.handle(event) }
+  #   report[:latency_us][:p99]
+  class InputLoad
+    # Event types the plan produces, as Event#type reports them
+    TYPES = %i[motion_notify button_press button_release key_press key_release].freeze
+    
+    FAKE_TYPES = { motion_notify: XTest::MOTION_NOTIFY, button_press: XTest::BUTTON_PRESS,
+                   button_release: XTest::BUTTON_RELEASE, key_press: XTest::KEY_PRESS,
+                   key_release: XTest::KEY_RELEASE }.freeze
+    
+    attr_reader :window, :rate, :count
+    
+    # mix weighs motion / button (press + release) / key (press + release)
+    def initialize(window, rate: 1000, count: 5000, mix: { motion: 8, button: 1, key: 1 },
+                   key: "a", button: 1, seed: 1)
+      @window = window
+      @connection = window.connection
+      @rate = rate.to_f
+      @key = key
+      @button = button
+      build_plan(count, mix, Random.new(seed), [window.width - 2, 1].max, [window.height - 2, 1].max)
+    end
+    
+    # Inject the plan and handle events until every injected event is
+    # accounted for, or timeout seconds after the last injection. The
+    # block is the handler under test; events not from the plan are
+    # passed to it too. Returns the report
+    def run(timeout: 2.0)
+      prepare_window
+      reset
+      io = IO.for_fd(XCB.xcb_get_file_descriptor(@connection.connection), autoclose: false)
+      @started = clock
+      injector = Thread.new { inject }
+      deadline = nil
+      
+      while @next < @count
+        while (event = @connection.poll_for_event)
+          yield event if block_given?
+          record(event)
+        end
+        break if @next >= @count
+        
+        unless injector.alive?
+          deadline ||= clock + timeout
+          break if clock > deadline
+        end
+        IO.select([io], nil, nil, 0.005)
+      end
+      
+      @finished = clock
+      injector.value
+      report
+    end
+    
+    def report
+      matched = @latencies.compact.sort!
+      seconds = @finished - @started
+      { injected: @count, received: matched.size, coalesced: @coalesced,
+        dropped: @count - matched.size - @coalesced,
+        seconds: seconds.round(6),
+        throughput: (matched.size / seconds).round(2),
+        injection_rate: @injected_in ? (@count / @injected_in).round(2) : nil,
+        latency_us: percentiles(matched) }
+    end
+    
+    def inspect
+      "#<XCB::InputLoad #{@count} events at #{@rate.round}/s>"
+    end
+    
+    private
+    
+    def clock
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+    
+    # Parallel arrays indexed by sequence: event type and, for motion,
+    # the window-relative position (unique within a long cycle, so a
+    # motion event identifies its injection)
+    def build_plan(count, mix, random, span_x, span_y)
+      weights = mix.select { |_kind, weight| weight > 0 }
+      total = weights.values.sum.to_f
+      @types = []
+      @xs = []
+      @ys = []
+      motions = 0
+      
+      while @types.size < count
+        pick = random.rand * total
+        kind = weights.find { |_kind, weight| (pick -= weight) < 0 }&.first || weights.keys.last
+        case kind
+        when :motion
+          @types << :motion_notify
+          @xs << 1 + motions % span_x
+          @ys << 1 + (motions / span_x) % span_y
+          motions += 1
+        when :button then plan_pair(:button_press, :button_release)
+        when :key then plan_pair(:key_press, :key_release)
+        end
+      end
+      @count = @types.size
+    end
+    
+    def plan_pair(press, release)
+      @types << press << release
+      @xs << nil << nil
+      @ys << nil << nil
+    end
+    
+    def prepare_window
+      @window.add_events(*TYPES)
+      @window.show unless @window.viewable?
+      @connection.sync
+      @window.refresh_info
+      @origin_x = @window.x + @window.border_width
+      @origin_y = @window.y + @window.border_width
+      @root = @window.screen.root_window
+      # Park the pointer inside the window before the clock starts, so
+      # the buttons and keys planned before the first motion land there
+      @connection.require_extension(XTest::ID, "XTEST")
+      XTest.xcb_test_fake_input(@connection.connection, XTest::MOTION_NOTIFY, 0, 0, @root, @origin_x, @origin_y, 0)
+      @connection.sync
+      nil while @connection.poll_for_event
+    end
+    
+    def reset
+      @sent_at = Array.new(@count, 0.0)
+      @latencies = Array.new(@count)
+      @next = 0
+      @coalesced = 0
+      @injected_in = nil
+    end
+    
+    # Runs on its own thread and connection; sends whatever is due with
+    # one flush per batch. Each event is stamped just before its request
+    # is queued, so waiting for the batch counts as latency
+    def inject
+      conn = Connection.new(@connection.display_name)
+      conn.require_extension(XTest::ID, "XTEST")
+      keycode = conn.keymap.keycodes(@key).first || raise(XCBError, "No keycode for #{@key.inspect}")
+      c = conn.connection
+      started = clock
+      sent = 0
+      
+      while sent < @count
+        due = [((clock - started) * @rate).floor + 1, @count].min
+        while sent < due
+          type = @types[sent]
+          detail = 0
+          detail = @button if type == :button_press || type == :button_release
+          detail = keycode if type == :key_press || type == :key_release
+          x = @xs[sent] ? @origin_x + @xs[sent] : 0
+          y = @ys[sent] ? @origin_y + @ys[sent] : 0
+          @sent_at[sent] = clock
+          XTest.xcb_test_fake_input(c, FAKE_TYPES[type], detail, 0, @root, x, y, 0)
+          sent += 1
+        end
+        
+        conn.flush
+        wait = started + sent / @rate - clock
+        sleep(wait) if wait > 0
+      end
+      @injected_in = clock - started
+    ensure
+      conn&.close
+    end
+    
+    # Match an event to the first outstanding injection of its type (and
+    # position, for motion). Motion skipped on the way was coalesced;
+    # skipped presses and releases were lost
+    def record(event)
+      type = event.type
+      return unless TYPES.include?(type)
+      
+      seq = @next
+      if type == :motion_notify
+        x = event.x
+        y = event.y
+        seq += 1 until seq >= @count || (@types[seq] == type && @xs[seq] == x && @ys[seq] == y)
+      else
+        seq += 1 until seq >= @count || @types[seq] == type
+      end
+      return if seq >= @count
+      
+      skipped = @next
+      while skipped < seq
+        @coalesced += 1 if @types[skipped] == :motion_notify
+        skipped += 1
+      end
+      @latencies[seq] = clock - @sent_at[seq]
+      @next = seq + 1
+    end
+    
+    def percentiles(sorted)
+      return nil if sorted.empty?
+      
+      at = ->(q) { (sorted[(sorted.size * q).floor.clamp(0, sorted.size - 1)] * 1e6).round(1) }
+      { mean: (sorted.sum / sorted.size * 1e6).round(1), p50: at.(0.5), p99: at.(0.99),
+        max: (sorted.last * 1e6).round(1) }
+    end
+  end
+end
@@ -0,0 +1,195 @@
+module XCB
+  # Keycode -> keysym table of the server's keyboard. The whole mapping is
+  # fetched with one GetKeyboardMapping and kept as a flat array indexed
+  # by (keycode - min_keycode) * keysyms_per_keycode + column, so a lookup
+  # is two array reads. MappingNotify marks the changed keycodes stale;
+  # they are fetched again, as one range, on the next lookup.
+  #
+  #   event.keysym      # => 0xff1b
+  #   event.key_name    # => "Escape"
+  #   event.base_key_name  # => "c" for c, C and Shift+c (shortcuts)
+  #   conn.keymap.keycodes("space")  # => [65] (for GrabKey)
+  #
+  # Lookups follow the core protocol rules for group 1 (columns 0 and 1,
+  # Shift and Lock); Mode_switch groups and NumLock keypads are not
+  # interpreted.
+  class Keymap
+    NO_SYMBOL = 0
+    
+    # X keysym names (keysymdef.h) for Latin-1 and the common function keys
+    LATIN1_NAMES = %w[
+      space exclam quotedbl numbersign dollar percent ampersand apostrophe
+      parenleft parenright asterisk plus comma minus period slash
+      0 1 2 3 4 5 6 7 8 9 colon semicolon less equal greater question at
+      A B C D E F G H I J K L M N O P Q R S T U V W X Y Z
+      bracketleft backslash bracketright asciicircum underscore grave
+      a b c d e f g h i j k l m n o p q r s t u v w x y z
+      braceleft bar braceright asciitilde
+    ].freeze
+    
+    FUNCTION_NAMES = {
+      0xff08 => "BackSpace", 0xff09 => "Tab", 0xff0d => "Return", 0xff13 => "Pause",
+      0xff14 => "Scroll_Lock", 0xff1b => "Escape", 0xffff => "Delete",
+      0xff50 => "Home", 0xff51 => "Left", 0xff52 => "Up", 0xff53 => "Right", 0xff54 => "Down",
+      0xff55 => "Prior", 0xff56 => "Next", 0xff57 => "End", 0xff61 => "Print", 0xff63 => "Insert",
+      0xff67 => "Menu", 0xff7f => "Num_Lock", 0xff8d => "KP_Enter", 0xffe1 => "Shift_L",
+      0xffe2 => "Shift_R", 0xffe3 => "Control_L", 0xffe4 => "Control_R", 0xffe5 => "Caps_Lock",
+      0xffe7 => "Meta_L", 0xffe8 => "Meta_R", 0xffe9 => "Alt_L", 0xffea => "Alt_R",
+      0xffeb => "Super_L", 0xffec => "Super_R", 0xff7e => "Mode_switch", 0xfe03 => "ISO_Level3_Shift"
+    }.merge((1..24).to_h { |n| [0xffbd + n, "F#{n}"] }).freeze
+    
+    NAMES = LATIN1_NAMES.each_with_index.to_h { |name, i| [0x20 + i, name] }
+                        .merge(FUNCTION_NAMES).transform_values(&:freeze).freeze
+    KEYSYMS = NAMES.invert.freeze
+    
+    @unicode_names = {}
+    
+    class << self
+      # Keysym name, nil for NoSymbol. Unicode keysyms are "U+XXXX";
+      # names are frozen and built once per keysym
+      def name(keysym)
+        return nil if keysym == NO_SYMBOL
+        
+        NAMES[keysym] || (@unicode_names[keysym] ||= format_name(keysym))
+      end
+      
+      # Keysym for a name from NAMES, "U+XXXX" or a single character
+      def keysym(name)
+        return name if name.is_a?(Integer)
+        
+        KEYSYMS[name] || (name =~ /\AU\+(\h+)\z/ && 0x1000000 | $1.hex) ||
+          (name.size == 1 && char_keysym(name.ord)) ||
+          raise(ArgumentError, "Unknown keysym name #{name.inspect}")
+      end
+      
+      private
+      
+      def format_name(keysym)
+        name = if keysym & 0xff000000 == 0x1000000
+                 format("U+%04X", keysym & 0xffffff)
+               else
+                 format("0x%x", keysym)
+               end
+        name.freeze
+      end
+      
+      # Latin-1 keysyms equal their code point; the rest are Unicode keysyms
+      def char_keysym(codepoint)
+        codepoint < 0x100 ? codepoint : 0x1000000 | codepoint
+      end
+    end
+    
+    attr_reader :connection, :min_keycode, :max_keycode, :keysyms_per_keycode, :fetches
+    
+    def initialize(connection)
+      @connection = connection
+      setup = XCB.xcb_get_setup(connection.connection)
+      @min_keycode = setup.get_uint8(34)
+      @max_keycode = setup.get_uint8(35)
+      @keysyms_per_keycode = 0
+      @keysyms = []
+      @fetches = 0
+      @stale_first = @stale_last = nil
+      fetch(@min_keycode, @max_keycode - @min_keycode + 1)
+    end
+    
+    # Keysym in a column (0: unshifted, 1: shifted, 2/3: Mode_switch group)
+    def keysym(keycode, column = 0)
+      refresh if @stale_first
+      return NO_SYMBOL if keycode < @min_keycode || keycode > @max_keycode || column >= @keysyms_per_keycode
+      
+      @keysyms[(keycode - @min_keycode) * @keysyms_per_keycode + column]
+    end
+    
+    # Keysym of a key event: state is the event's modifier mask
+    def lookup(keycode, state = 0)
+      refresh if @stale_first
+      return NO_SYMBOL if keycode < @min_keycode || keycode > @max_keycode
+      
+      index = (keycode - @min_keycode) * @keysyms_per_keycode
+      lower = @keysyms[index]
+      upper = @keysyms_per_keycode > 1 ? @keysyms[index + 1] : NO_SYMBOL
+      
+      # A lone lowercase letter stands for the lower/upper pair
+      if upper == NO_SYMBOL
+        upper = lowercase?(lower) ? lower - 0x20 : lower
+      end
+      
+      shifted = state & XCB::XCB_MOD_MASK_SHIFT != 0
+      shifted = !shifted if state & XCB::XCB_MOD_MASK_LOCK != 0 && lowercase?(lower) && upper != lower
+      shifted ? upper : lower
+    end
+    
+    # Keycodes that produce keysym (an Integer or a name) in any column
+    def keycodes(keysym)
+      refresh if @stale_first
+      keysym = Keymap.keysym(keysym)
+      codes = []
+      @keysyms.each_with_index do |value, index|
+        next unless value == keysym
+        
+        keycode = @min_keycode + index / @keysyms_per_keycode
+        codes << keycode unless codes.last == keycode
+      end
+      codes
+    end
+    
+    # MappingNotify for the keyboard: remember the changed range
+    def invalidate(event)
+      return self unless event.event_ptr.get_uint8(4) == XCB::XCB_MAPPING_KEYBOARD
+      
+      first = event.event_ptr.get_uint8(5)
+      last = first + event.event_ptr.get_uint8(6) - 1
+      @stale_first = @stale_first ? [@stale_first, first].min : first
+      @stale_last = @stale_last ? [@stale_last, last].max : last
+      self
+    end
+    
+    def stale?
+      !@stale_first.nil?
+    end
+    
+    def inspect
+      "#<XCB::Keymap keycodes=#{@min_keycode}..#{@max_keycode} per_keycode=#{@keysyms_per_keycode} fetches=#{@fetches}>"
+    end
+    
+    private
+    
+    def refresh
+      first = [@stale_first, @min_keycode].max
+      last = [@stale_last, @max_keycode].min
+      @stale_first = @stale_last = nil
+      fetch(first, last - first + 1) if last >= first
+    end
+    
+    # A reply with a different width than the table reloads everything
+    def fetch(first, count)
+      conn = @connection.connection
+      cookie = XCB.xcb_get_keyboard_mapping(conn, first, count)
+      reply = @connection.wait_for_reply("GetKeyboardMapping", 101) { XCB.xcb_get_keyboard_mapping_reply(conn, cookie, nil) }
+      raise XCBError, "GetKeyboardMapping failed" if reply.null?
+      
+      begin
+        per_keycode = reply.get_uint8(1)
+        values = reply.get_array_of_uint32(32, per_keycode * count)
+      ensure
+        XCB::LibC.free(reply)
+      end
+      @fetches += 1
+      
+      if per_keycode == @keysyms_per_keycode
+        @keysyms[(first - @min_keycode) * per_keycode, values.size] = values
+      elsif first == @min_keycode && count == @max_keycode - @min_keycode + 1
+        @keysyms_per_keycode = per_keycode
+        @keysyms = values
+      else
+        @keysyms_per_keycode = 0
+        fetch(@min_keycode, @max_keycode - @min_keycode + 1)
+      end
+    end
+    
+    def lowercase?(keysym)
+      (0x61..0x7a).cover?(keysym) || ((0xe0..0xfe).cover?(keysym) && keysym != 0xf7)
+    end
+  end
+end
@@ -0,0 +1,132 @@
+module XCB
+  # Deferred attach_function for the FFI binding modules. Declaring a
+  # function only records its signature and defines a stub; the stub
+  # resolves the symbol and attaches the real function the first time it
+  # is called, then replaces itself. Short-lived tools that draw a window
+  # and a GC pay for the dozen functions they use, not for every binding.
+  #
+  # Long-running processes can bind up front instead:
+  #   XCB_EAGER_BIND=1            attach everything at require time
+  #   XCB_BINDING_MANIFEST=path   attach the functions listed in path at
+  #                               require time (see write_manifest)
+  #   XCB_BINDING_STATS=1         print metrics at exit
+  #
+  #   XCB::LazyBinding.write_manifest("xcb.bindings")   # after a typical run
+  #   XCB::LazyBinding.metrics  # => { declared: 150, bound: 14, bind_ms: 0.9, ... }
+  module LazyBinding
+    @modules = []
+    @lock = Mutex.new
+    @bound = []
+    @bind_seconds = 0.0
+    @load_seconds = {}
+    
+    class << self
+      attr_reader :modules, :lock
+      
+      def extended(base)
+        @modules << base
+      end
+      
+      def eager?
+        ENV['XCB_EAGER_BIND'] == '1'
+      end
+      
+      def clock
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+      
+      def record_bind(mod, name, seconds)
+        @bound << "#{mod.name}.#{name}"
+        @bind_seconds += seconds
+      end
+      
+      # Time spent requiring a binding file, reported by the file itself
+      def record_load(file, started)
+        @load_seconds[file] = clock - started
+        warm_up(ENV['XCB_BINDING_MANIFEST']) if ENV['XCB_BINDING_MANIFEST']
+      end
+      
+      # Attach every declared function of every binding module
+      def bind_all
+        @modules.each(&:bind_all_functions)
+        self
+      end
+      
+      # Attach the functions named in a manifest ("XCB.xcb_flush" per
+      # line); entries of modules that are not loaded are skipped
+      def warm_up(path)
+        return self unless File.exist?(path)
+        
+        File.foreach(path) do |line|
+          mod_name, name = line.strip.split('.', 2)
+          next unless name
+          
+          mod = @modules.find { |m| m.name == mod_name }
+          mod&.bind_function(name.to_sym)
+        end
+        self
+      end
+      
+      # Functions bound so far in this process, for warm_up on next start
+      def write_manifest(path)
+        File.write(path, @bound.sort.join("\n") + "\n")
+        self
+      end
+      
+      def metrics
+        { declared: @modules.sum(&:declared_function_count),
+          bound: @bound.size,
+          pending: @modules.sum { |m| m.pending_functions.size },
+          bind_ms: (@bind_seconds * 1000).round(3),
+          load_ms: @load_seconds.transform_values { |s| (s * 1000).round(3) } }
+      end
+      
+      def report
+        m = metrics
+        loads = m[:load_ms].map { |file, ms| "#{file} #{ms}ms" }.join(", ")
+        "XCB bindings: #{m[:bound]}/#{m[:declared]} bound in #{m[:bind_ms]}ms; loaded #{loads}"
+      end
+    end
+    
+    def attach_function(name, *signature)
+      @declared_function_count = declared_function_count + 1
+      return super if LazyBinding.eager?
+      
+      name = name.to_sym
+      pending_functions[name] = signature
+      mod = self
+      singleton_class.send(:define_method, name) { |*args, &block| mod.bind_function(name).call(*args, &block) }
+      define_method(name) { |*args, &block| mod.bind_function(name).call(*args, &block) }
+      nil
+    end
+    
+    def pending_functions
+      @pending_functions ||= {}
+    end
+    
+    def declared_function_count
+      @declared_function_count || 0
+    end
+    
+    # Attach one function now (no-op if it already is); returns the
+    # bound singleton method
+    def bind_function(name)
+      LazyBinding.lock.synchronize do
+        signature = pending_functions.delete(name)
+        if signature
+          started = LazyBinding.clock
+          LazyBinding.instance_method(:attach_function).bind(self).super_method.call(name, *signature)
+          LazyBinding.record_bind(self, name, LazyBinding.clock - started)
+        end
+      end
+      method(name)
+    end
+    
+    def bind_all_functions
+      pending_functions.keys.each { |name| bind_function(name) }
+      self
+    end
+  end
+end
+
+at_exit { warn XCB::LazyBinding.report } if ENV['XCB_BINDING_STATS'] == '1'
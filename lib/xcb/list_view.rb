@@ -0,0 +1,251 @@
+module XCB
+  # Scrolling list widget core. Rendered rows are kept in an offscreen
+  # pixmap cache; scrolling shifts the visible rows with one CopyArea inside
+  # the window and only the newly revealed rows are blitted from the cache
+  # (or rendered into it first). Parts the server could not copy arrive as
+  # GraphicsExposure events and are repainted from the cache as well.
+  #
+  #   list = XCB::ListView.new(window, x: 0, y: 60, width: 480, height: 288, row_height: 16) do |row|
+  #     row.gc.fill_rectangle(0, row.y, row.width, row.height)
+  #     text_gc.draw_texts([[4, row.baseline, row.item.to_s]])
+  #   end
+  #   list.items = entries
+  #   list.handle_event(event)   # expose / graphics_exposure
+  class ListView
+    # Passed to the render block; y is the row's top inside the cache pixmap
+    Row = Struct.new(:item, :index, :selected, :pixmap, :y, :width, :height, :gc) do
+      alias_method :selected?, :selected
+      
+      def baseline(descent = 4)
+        y + height - descent
+      end
+    end
+    
+    # Cache rows are addressed with signed 16-bit y inside the pixmap
+    MAX_CACHE_HEIGHT = 32_767
+    
+    attr_reader :window, :items, :scroll_offset, :selected_index, :row_height,
+                :visible_rows, :pixmap, :stats
+    
+    def initialize(window, x:, y:, width:, height:, row_height:, background: :white, cache_rows: nil, &render_row)
+      @window = window
+      @connection = window.connection
+      @x = x
+      @y = y
+      @width = width
+      @row_height = row_height
+      @visible_rows = height / row_height
+      @render_row = render_row
+      @items = []
+      @scroll_offset = 0
+      @selected_index = nil
+      
+      # Ring of cached rows: item index => slot, least recently used first
+      # (at least one screenful, at most what 16-bit coordinates reach)
+      @capacity = [cache_rows || @visible_rows * 4, @visible_rows + 1].max
+      @capacity = [@capacity, MAX_CACHE_HEIGHT / row_height].min
+      @slots = {}
+      @free_slots = (0...@capacity).to_a
+      @pixmap = XCB::Pixmap.new(@connection, window.window_id, width, @capacity * row_height)
+      
+      @background_gc = @pixmap.create_graphics_context(foreground: background, graphics_exposures: false)
+      @clear_gc = window.create_graphics_context(foreground: background, graphics_exposures: false)
+      @blit_gc = window.create_graphics_context(graphics_exposures: false)
+      @scroll_gc = window.create_graphics_context(graphics_exposures: true)
+      @stats = Hash.new(0)
+    end
+    
+    # GC that draws into the row cache (use it from the render block)
+    def create_graphics_context(options = {})
+      @pixmap.create_graphics_context({ graphics_exposures: false }.merge(options))
+    end
+    
+    def items=(items)
+      @items = items
+      @scroll_offset = 0
+      @selected_index = items.empty? ? nil : 0
+      invalidate
+    end
+    
+    def height
+      @visible_rows * @row_height
+    end
+    
+    # Drop cached rows (all, or one item index) and repaint what is visible
+    def invalidate(index = nil)
+      if index
+        slot = @slots.delete(index)
+        @free_slots << slot if slot
+        paint_rows(index - @scroll_offset, 1) if visible?(index)
+      else
+        @free_slots.concat(@slots.values)
+        @slots.clear
+        paint_rows(0, @visible_rows)
+      end
+      @connection.flush
+      self
+    end
+    
+    def select(index)
+      return self if @items.empty?
+      
+      index = index.clamp(0, @items.size - 1)
+      previous = @selected_index
+      @selected_index = index
+      
+      if previous != index
+        scroll_into_view(index)
+        invalidate(previous) if previous
+        invalidate(index)
+      end
+      self
+    end
+    
+    def move_selection(delta)
+      select((@selected_index || 0) + delta)
+    end
+    
+    def scroll_into_view(index)
+      if index < @scroll_offset
+        scroll_to(index)
+      elsif index >= @scroll_offset + @visible_rows
+        scroll_to(index - @visible_rows + 1)
+      end
+      self
+    end
+    
+    def scroll_by(delta)
+      scroll_to(@scroll_offset + delta)
+    end
+    
+    # Work is proportional to the rows revealed: one CopyArea shifts what
+    # is still visible, then only the new rows are painted
+    def scroll_to(offset)
+      offset = offset.clamp(0, [@items.size - @visible_rows, 0].max)
+      delta = offset - @scroll_offset
+      return self if delta.zero?
+      
+      @scroll_offset = offset
+      encoder = @connection.encoder
+      
+      if delta.abs >= @visible_rows
+        paint_rows(0, @visible_rows)
+      elsif delta > 0
+        kept = @visible_rows - delta
+        encoder.copy_area(@window, @window, @scroll_gc, @x, @y + delta * @row_height,
+                          @x, @y, @width, kept * @row_height)
+        @stats[:scroll_blits] += 1
+        paint_rows(kept, delta)
+      else
+        kept = @visible_rows + delta
+        encoder.copy_area(@window, @window, @scroll_gc, @x, @y,
+                          @x, @y - delta * @row_height, @width, kept * @row_height)
+        @stats[:scroll_blits] += 1
+        paint_rows(0, -delta)
+      end
+      
+      @connection.flush
+      self
+    end
+    
+    # Repaint the part of the view inside a window-relative rectangle
+    def paint_area(x, y, width, height)
+      return self if x >= @x + @width || x + width <= @x
+      
+      first = ((y - @y) / @row_height).clamp(0, @visible_rows)
+      last = ((y + height - 1 - @y) / @row_height).clamp(-1, @visible_rows - 1)
+      paint_rows(first, last - first + 1) if last >= first
+      @connection.flush
+      self
+    end
+    
+    def paint
+      paint_area(@x, @y, @width, height)
+    end
+    
+    # Handles Expose and GraphicsExposure for the window; true if handled
+    def handle_event(event)
+      return false unless event.window_id == @window.window_id
+      
+      case event.type
+      when :expose, :graphics_exposure
+        @stats[:graphics_exposures] += 1 if event.graphics_exposure?
+        paint_area(*event.expose_rect)
+        true
+      when :no_exposure
+        true
+      else
+        false
+      end
+    end
+    
+    # Item index at a window-relative y, or nil
+    def index_at(y)
+      return nil if y < @y || y >= @y + height
+      
+      index = @scroll_offset + (y - @y) / @row_height
+      index < @items.size ? index : nil
+    end
+    
+    def cleanup
+      @pixmap.cleanup
+    end
+    
+    def inspect
+      "#<XCB::ListView items=#{@items.size} offset=#{@scroll_offset} cached=#{@slots.size}/#{@capacity}>"
+    end
+    
+    private
+    
+    def visible?(index)
+      index >= @scroll_offset && index < @scroll_offset + @visible_rows
+    end
+    
+    # Blit rows [first, first + count) of the view from the cache
+    def paint_rows(first, count)
+      encoder = @connection.encoder
+      
+      count.times do |i|
+        position = first + i
+        next if position < 0 || position >= @visible_rows
+        
+        index = @scroll_offset + position
+        y = @y + position * @row_height
+        
+        if index >= @items.size
+          encoder.fill_rectangle(@window, @clear_gc, @x, y, @width, @row_height)
+          next
+        end
+        
+        slot = cached_slot(index)
+        encoder.copy_area(@pixmap, @window, @blit_gc, 0, slot * @row_height, @x, y, @width, @row_height)
+        @stats[:blitted_rows] += 1
+      end
+    end
+    
+    def cached_slot(index)
+      if (slot = @slots.delete(index))
+        @slots[index] = slot
+        return slot
+      end
+      
+      slot = @free_slots.pop
+      unless slot
+        evicted, slot = @slots.first
+        @slots.delete(evicted)
+      end
+      @slots[index] = slot
+      
+      render(index, slot)
+      slot
+    end
+    
+    def render(index, slot)
+      y = slot * @row_height
+      @connection.encoder.fill_rectangle(@pixmap, @background_gc, 0, y, @width, @row_height)
+      row = Row.new(@items[index], index, index == @selected_index, @pixmap, y, @width, @row_height, @background_gc)
+      @render_row&.call(row)
+      @stats[:rendered_rows] += 1
+    end
+  end
+end
@@ -0,0 +1,130 @@
+require_relative '../xcb_wrapper'
+require_relative '../xcb_render'
+
+module XCB
+  # RENDER picture bound to a window or pixmap, or a solid-fill source
+  class Picture
+    attr_reader :connection, :picture_id, :drawable
+    
+    def initialize(drawable, format: nil, repeat: false)
+      @connection = drawable.connection
+      @drawable = drawable
+      @connection.require_extension(Render::ID, "RENDER")
+      @picture_id = @connection.generate_id
+      
+      format ||= Picture.format_for(drawable)
+      values = @connection.scratch.value_list
+      values.set(Render::CP_REPEAT, 1) if repeat
+      
+      Render.xcb_render_create_picture(@connection.connection, @picture_id, drawable.drawable_id,
+                                       format, values.mask, values.pointer)
+      @connection.send(:register_resource, self)
+    end
+    
+    # Solid color source; color is 0xRRGGBB or [r, g, b, a] with 16-bit channels
+    def self.solid(connection, color)
+      picture = allocate
+      picture.send(:initialize_solid, connection, color)
+      picture
+    end
+    
+    def composite(src, x, y, width, height, mask: nil, src_x: 0, src_y: 0, mask_x: 0, mask_y: 0,
+                  op: Render::PICT_OP_OVER)
+      Render.xcb_render_composite(@connection.connection, op, picture_id_of(src), picture_id_of(mask),
+                                  @picture_id, src_x, src_y, mask_x, mask_y, x, y, width, height)
+      self
+    end
+    
+    def fill_rectangle(x, y, width, height, color, op: Render::PICT_OP_OVER)
+      rect = XCB::Rectangle.new
+      rect[:x] = x
+      rect[:y] = y
+      rect[:width] = width
+      rect[:height] = height
+      Render.xcb_render_fill_rectangles(@connection.connection, op, @picture_id,
+                                        Picture.color(color), 1, rect)
+      self
+    end
+    
+    def cleanup
+      Render.xcb_render_free_picture(@connection.connection, @picture_id) rescue nil
+    end
+    
+    def inspect
+      "#<XCB::Picture id=#{@picture_id}>"
+    end
+    
+    class << self
+      # render-util caches the QueryPictFormats reply per connection
+      def formats(connection)
+        formats = Render.xcb_render_util_query_formats(connection.connection)
+        raise XCBError, "RENDER QueryPictFormats failed" if formats.null?
+        
+        formats
+      end
+      
+      def standard_format(connection, standard)
+        info = Render.xcb_render_util_find_standard_format(formats(connection), standard)
+        raise XCBError, "No standard picture format #{standard}" if info.null?
+        
+        info.get_uint32(0)
+      end
+      
+      def visual_format(connection, visual)
+        info = Render.xcb_render_util_find_visual_format(formats(connection), visual)
+        raise XCBError, "No picture format for visual #{visual}" if info.null?
+        
+        info.get_uint32(4)
+      end
+      
+      # Windows use the screen's root visual; pixmaps are matched by depth
+      def format_for(drawable)
+        connection = drawable.connection
+        return visual_format(connection, connection.default_screen.root_visual) if drawable.is_a?(Window)
+        
+        case drawable.depth
+        when 32 then standard_format(connection, Render::PICT_STANDARD_ARGB_32)
+        when 8 then standard_format(connection, Render::PICT_STANDARD_A_8)
+        when 1 then standard_format(connection, Render::PICT_STANDARD_A_1)
+        else standard_format(connection, Render::PICT_STANDARD_RGB_24)
+        end
+      end
+      
+      def color(color)
+        red, green, blue, alpha = case color
+                                  when Integer
+                                    [(color >> 16 & 0xff) * 257, (color >> 8 & 0xff) * 257, (color & 0xff) * 257, 0xffff]
+                                  when Array
+                                    color.size == 4 ? color : color + [0xffff]
+                                  else
+                                    raise ArgumentError, "Unsupported color: #{color.inspect}"
+                                  end
+        value = Render::Color.new
+        value[:red] = red
+        value[:green] = green
+        value[:blue] = blue
+        value[:alpha] = alpha
+        value
+      end
+    end
+    
+    private
+    
+    def initialize_solid(connection, color)
+      @connection = connection
+      @drawable = nil
+      @connection.require_extension(Render::ID, "RENDER")
+      @picture_id = connection.generate_id
+      Render.xcb_render_create_solid_fill(connection.connection, @picture_id, Picture.color(color))
+      connection.send(:register_resource, self)
+    end
+    
+    def picture_id_of(picture)
+      case picture
+      when nil then XCB::XCB_NONE
+      when Integer then picture
+      else picture.picture_id
+      end
+    end
+  end
+end
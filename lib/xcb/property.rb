@@ -0,0 +1,114 @@
+module XCB
+  # Chunked reads and writes of window properties. Values are read with
+  # GetProperty long_offset/long_length windows of chunk_size bytes, the
+  # request for the next chunk going out before the current one is
+  # yielded, so at most two chunks are held at a time. Writes are split
+  # into Replace + Append requests that fit the maximum request length.
+  module Property
+    CHUNK_SIZE = 64 * 1024
+    
+    # type is an atom, format 8/16/32, size the value length in bytes
+    Info = Struct.new(:type, :format, :size)
+    
+    REPLY_TYPE = 8
+    REPLY_BYTES_AFTER = 12
+    REPLY_VALUE_LEN = 16
+    REPLY_VALUE = 32
+    
+    module_function
+    
+    # Type, format and size without transferring the value; nil if unset
+    def info(connection, window_id, property)
+      reply = get(connection, window_id, property, XCB_GET_PROPERTY_TYPE_ANY, 0, 0, false)
+      return nil if reply.nil?
+      
+      begin
+        type = reply.get_uint32(REPLY_TYPE)
+        type.zero? ? nil : Info.new(type, reply.get_uint8(1), reply.get_uint32(REPLY_BYTES_AFTER))
+      ensure
+        XCB::LibC.free(reply)
+      end
+    end
+    
+    # Enumerator over binary chunks of the value. With delete: true the
+    # server removes the property once its last chunk has been read
+    def chunks(connection, window_id, property, type: XCB_GET_PROPERTY_TYPE_ANY,
+               chunk_size: CHUNK_SIZE, delete: false)
+      longs = [chunk_size / 4, 1].max
+      
+      Enumerator.new do |yielder|
+        conn = connection.connection
+        offset = 0
+        cookie = XCB.xcb_get_property(conn, delete ? 1 : 0, window_id, property, type, offset, longs)
+        
+        while cookie
+          reply = connection.wait_for_reply("GetProperty", 20) { XCB.xcb_get_property_reply(conn, cookie, nil) }
+          break if reply.null?
+          
+          begin
+            bytes_after = reply.get_uint32(REPLY_BYTES_AFTER)
+            length = reply.get_uint32(REPLY_VALUE_LEN) * reply.get_uint8(1) / 8
+            
+            # Ask for the next window while this one is consumed
+            offset += longs
+            cookie = if bytes_after > 0
+                       XCB.xcb_get_property(conn, delete ? 1 : 0, window_id, property, type, offset, longs)
+                     end
+            
+            yielder << reply.get_bytes(REPLY_VALUE, length) if length > 0
+          ensure
+            XCB::LibC.free(reply)
+          end
+        end
+      end
+    end
+    
+    # Whole value as one binary string (for small properties)
+    def read(connection, window_id, property, **options)
+      chunks(connection, window_id, property, **options).each_with_object(String.new(encoding: Encoding::BINARY)) do |chunk, data|
+        data << chunk
+      end
+    end
+    
+    # data is a String, or an Array of integers for format 16/32
+    def write(connection, window_id, property, type, data, format: 8, mode: XCB_PROP_MODE_REPLACE)
+      data = pack(data, format)
+      unit = format / 8
+      limit = (connection.maximum_request_length - 24) / 4 * 4
+      
+      offset = 0
+      loop do
+        slice = data.byteslice(offset, limit) || ""
+        XCB.xcb_change_property(connection.connection, mode, window_id, property, type, format,
+                                slice.bytesize / unit, slice)
+        offset += slice.bytesize
+        break if offset >= data.bytesize
+        
+        mode = XCB_PROP_MODE_APPEND
+      end
+      self
+    end
+    
+    def append(connection, window_id, property, type, data, format: 8)
+      write(connection, window_id, property, type, data, format: format, mode: XCB_PROP_MODE_APPEND)
+    end
+    
+    def delete(connection, window_id, property)
+      XCB.xcb_delete_property(connection.connection, window_id, property)
+      self
+    end
+    
+    def pack(data, format)
+      return data if data.is_a?(String)
+      
+      data.pack(format == 32 ? 'L*' : format == 16 ? 'S*' : 'C*')
+    end
+    
+    def get(connection, window_id, property, type, offset, longs, delete)
+      conn = connection.connection
+      cookie = XCB.xcb_get_property(conn, delete ? 1 : 0, window_id, property, type, offset, longs)
+      reply = connection.wait_for_reply("GetProperty", 20) { XCB.xcb_get_property_reply(conn, cookie, nil) }
+      reply.null? ? nil : reply
+    end
+  end
+end
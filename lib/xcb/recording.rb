@@ -0,0 +1,610 @@
+require 'socket'
+require 'zlib'
+
+module XCB
+  # Wire-level record and replay of a connection, so a real session
+  # (simple_paint.rb, file_browser.rb ...) becomes a benchmark fixture.
+  #
+  # Recording puts a small proxy process between libxcb and the server:
+  # libxcb is connected with xcb_connect_to_fd to one end of a socket
+  # pair, the proxy forwards both directions and logs every request and
+  # every reply, event and error with its timestamp. The log is binary
+  # (9 bytes per message plus the message), gzipped when the path ends
+  # in .gz. Anything libxcb or the RequestEncoder sends is recorded the
+  # same way, as raw protocol bytes.
+  #
+  #   XCB_RECORD=paint.xrec.gz ruby examples/demos/simple_paint.rb
+  #   XCB::Connection.new(nil, nil, record: "session.xrec")
+  #
+  # Replaying pushes the recorded requests into another server (a fresh
+  # Xvfb) as fast as possible or at the recorded pace, and reports
+  # throughput and reply latency:
+  #
+  #   XCB::Recording::Replayer.new("paint.xrec.gz", display: ":99").run
+  #
+  # The recording connection sends no authorization (a server with
+  # cookie auth needs xhost +si:localuser:$USER) and file descriptors
+  # passed over the socket are not forwarded.
+  module Recording
+    MAGIC = "XCBREC1\n".b.freeze
+    
+    # Log record kinds
+    CLIENT_SETUP = 0
+    SERVER_SETUP = 1
+    REQUEST = 2
+    SERVER = 3                          # reply, event or error
+    
+    # Core opcodes the replayer builds or looks into
+    GET_INPUT_FOCUS = 43
+    PUT_IMAGE = 72
+    QUERY_EXTENSION = 98
+    GENERIC_EVENT = 35
+    
+    # Request fields holding client XIDs, remapped when the replay server
+    # hands out another resource id base. An Integer is the byte offset
+    # of one id; [:values, mask_offset, mask_bytes, id_bits] a value list
+    # (values follow the mask word) with ids at the given mask bits;
+    # [:list, offset, stride] ids up to the end of the request;
+    # [:text, offset, char_bytes] PolyText items (font switches);
+    # [:glyphs, offset, glyph_bytes] CompositeGlyphs items (glyphset
+    # switches). Values that do not carry the recorded base (None, root,
+    # atoms, visuals) are left alone.
+    WINDOW_VALUE_IDS = (1 << 0) | (1 << 2) | (1 << 13) | (1 << 14)   # pixmaps, colormap, cursor
+    GC_VALUE_IDS = (1 << 10) | (1 << 11) | (1 << 14) | (1 << 19)     # tile, stipple, font, clip mask
+    PICTURE_VALUE_IDS = (1 << 1) | (1 << 6)                          # alpha map, clip mask
+    
+    CORE_XIDS = [3, 4, 5, 6, 8, 9, 10, 11, 13, 14, 15, 18, 19, 20, 21, 22, 24, 25, 29, 30, 31, 33, 34,
+                 38, 39, 42, 45, 46, 47, 48, 54, 58, 59, 60, 61, 73, 79, 81, 82, 83, 84, 85, 86, 87,
+                 88, 89, 90, 91, 92, 95, 96, 97, 113, 114].to_h { |opcode| [opcode, [4]] }
+      .merge([7, 40, 41, 53, 57, 64, 65, 66, 67, 68, 69, 70, 71, 72, 76, 77, 78, 80].to_h { |opcode| [opcode, [4, 8]] })
+      .merge(1 => [4, 8, [:values, 28, 4, WINDOW_VALUE_IDS]],
+             2 => [4, [:values, 8, 4, WINDOW_VALUE_IDS]],
+             12 => [4, [:values, 8, 2, 1 << 5]],                       # sibling
+             26 => [4, 12, 16], 28 => [4, 12, 16],
+             55 => [4, 8, [:values, 12, 4, GC_VALUE_IDS]],
+             56 => [4, [:values, 8, 4, GC_VALUE_IDS]],
+             62 => [4, 8, 12], 63 => [4, 8, 12], 93 => [4, 8, 12], 94 => [4, 8, 12],
+             74 => [4, 8, [:text, 16, 1]], 75 => [4, 8, [:text, 16, 2]])
+      .freeze
+    
+    # Extension requests by QueryExtension name and minor opcode; the
+    # requests of other extensions are replayed unchanged
+    EXTENSION_XIDS = {
+      "RENDER" => { 4 => [4, 8, [:values, 16, 4, PICTURE_VALUE_IDS]], 5 => [4, [:values, 8, 4, PICTURE_VALUE_IDS]],
+                    6 => [4], 7 => [4], 8 => [8, 12, 16], 10 => [8, 12], 11 => [8, 12], 12 => [8, 12],
+                    13 => [8, 12], 17 => [4], 18 => [4, 8], 19 => [4], 20 => [4], 22 => [4],
+                    23 => [8, 12, 20, [:glyphs, 28, 1]], 24 => [8, 12, 20, [:glyphs, 28, 2]],
+                    25 => [8, 12, 20, [:glyphs, 28, 4]], 26 => [8], 27 => [4, 8], 28 => [4], 30 => [4],
+                    31 => [4, [:list, 8, 8]], 32 => [4], 33 => [4], 34 => [4], 35 => [4], 36 => [4] },
+      "MIT-SHM" => { 1 => [4], 2 => [4], 3 => [4, 8, 32], 4 => [4, 24], 5 => [4, 8, 20], 6 => [4], 7 => [4] },
+      "XFIXES" => { 2 => [8], 3 => [4], 4 => [4], 5 => [4], 6 => [4, 8], 7 => [4, 8], 8 => [4, 8], 9 => [4, 8],
+                    10 => [4], 11 => [4], 12 => [4, 8], 13 => [4, 8, 12], 14 => [4, 8, 12], 15 => [4, 8, 12],
+                    16 => [4, 16], 17 => [4], 18 => [4, 8], 19 => [4], 20 => [4, 8], 21 => [4, 16], 22 => [4, 8] },
+      "DAMAGE" => { 1 => [4, 8], 2 => [4], 3 => [4, 8, 12], 4 => [4, 8] },
+      "Composite" => { 1 => [4], 2 => [4], 3 => [4], 4 => [4], 5 => [4, 8], 6 => [4, 8], 7 => [4], 8 => [4] },
+      "Present" => { 1 => [4, 8, 16, 20, 32, 36], 2 => [4], 3 => [4, 8] },
+      "XInputExtension" => { 46 => [4] }                               # XISelectEvents
+    }.freeze
+    
+    class << self
+      # Socket to the server of a display name (":1", ":1.0", "host:1")
+      def open_display(display_name)
+        host, number = parse_display(display_name)
+        if host.empty? || host == "unix"
+          UNIXSocket.new("/tmp/.X11-unix/X#{number}")
+        else
+          TCPSocket.new(host, 6000 + number)
+        end
+      end
+      
+      def screen_number(display_name)
+        parse_display(display_name).last
+      end
+      
+      private
+      
+      def parse_display(display_name)
+        name = display_name || ENV['DISPLAY'] || raise(XCBError, "No display to record")
+        host, rest = name.split(':', 2)
+        raise XCBError, "Bad display name: #{name}" unless rest
+        
+        number, screen = rest.split('.', 2)
+        [host, number.to_i, screen.to_i]
+      end
+    end
+    
+    # Splits one direction of a byte stream into protocol messages: the
+    # connection setup first, then requests (client side) or replies,
+    # events and errors (server side)
+    class Framer
+      attr_accessor :little_endian
+      
+      def initialize(client)
+        @client = client
+        @buffer = String.new(encoding: Encoding::BINARY)
+        @setup = true
+        @little_endian = true
+      end
+      
+      # Yields (message, setup?) for every complete message
+      def feed(data)
+        @buffer << data
+        offset = 0
+        while (size = message_size(offset)) && @buffer.bytesize - offset >= size
+          yield @buffer.byteslice(offset, size), @setup
+          @setup = false
+          offset += size
+        end
+        @buffer = @buffer.byteslice(offset, @buffer.bytesize - offset) if offset > 0
+      end
+      
+      private
+      
+      def message_size(offset)
+        available = @buffer.bytesize - offset
+        if @setup && @client
+          return nil if available < 12
+          
+          @little_endian = @buffer.getbyte(offset) == 0x6c # 'l'
+          12 + padded(u16(offset + 6)) + padded(u16(offset + 8))
+        elsif @setup
+          available < 8 ? nil : 8 + 4 * u16(offset + 6)
+        elsif @client
+          return nil if available < 4
+          
+          units = u16(offset + 2)
+          # BIG-REQUESTS form: zero, then a 32-bit length
+          units = available < 8 ? nil : u32(offset + 4) if units.zero?
+          units && 4 * units
+        else
+          return nil if available < 32
+          
+          type = @buffer.getbyte(offset) & 0x7f
+          type == 1 || type == GENERIC_EVENT ? 32 + 4 * u32(offset + 4) : 32
+        end
+      end
+      
+      def padded(length)
+        (length + 3) & ~3
+      end
+      
+      def u16(offset)
+        @buffer.unpack1(@little_endian ? 'v' : 'n', offset: offset)
+      end
+      
+      def u32(offset)
+        @buffer.unpack1(@little_endian ? 'V' : 'N', offset: offset)
+      end
+    end
+    
+    # The binary log: MAGIC, then per message its kind (u8), microseconds
+    # since the previous message (u32) and length (u32), little-endian
+    class Log
+      def self.create(path)
+        new(path.end_with?(".gz") ? Zlib::GzipWriter.open(path) : File.open(path, "wb"))
+      end
+      
+      # Yields (kind, seconds since the first message, bytes)
+      def self.read(path)
+        io = path.end_with?(".gz") ? Zlib::GzipReader.open(path) : File.open(path, "rb")
+        raise XCBError, "#{path}: not an XCB recording" unless io.read(MAGIC.bytesize) == MAGIC
+        
+        micros = 0
+        while (header = io.read(9))
+          kind, delta, length = header.unpack('CVV')
+          micros += delta
+          yield kind, micros / 1e6, io.read(length)
+        end
+      ensure
+        io&.close
+      end
+      
+      def initialize(io)
+        @io = io
+        @io.write(MAGIC)
+        @started = nil
+        @micros = 0
+      end
+      
+      def write(kind, time, bytes)
+        @started ||= time
+        micros = ((time - @started) * 1e6).round
+        delta = (micros - @micros).clamp(0, 0xffffffff)
+        @micros += delta
+        @io.write([kind, delta, bytes.bytesize].pack('CVV'), bytes)
+      end
+      
+      def close
+        @io.close
+      end
+    end
+    
+    # Forked proxy between libxcb and the server. Logging happens in the
+    # child, after each chunk is forwarded, so the recorded application
+    # only pays for the extra hop
+    class Recorder
+      attr_reader :path, :pid
+      
+      def initialize(display_name, path)
+        @path = path
+        server = Recording.open_display(display_name)
+        @client, proxy = UNIXSocket.pair
+        @pid = Process.fork do
+          @client.close
+          proxy_loop(proxy, server)
+        ensure
+          exit!(0)
+        end
+        proxy.close
+        server.close
+        # xcb_disconnect closes the descriptor
+        @client.autoclose = false
+      end
+      
+      # Descriptor for xcb_connect_to_fd
+      def fd
+        @client.fileno
+      end
+      
+      # Wait for the proxy to write out the log (after xcb_disconnect)
+      def finish
+        return unless @pid
+        
+        Process.wait(@pid) rescue nil
+        @pid = nil
+      end
+      
+      def inspect
+        "#<XCB::Recording::Recorder #{@path} pid=#{@pid}>"
+      end
+      
+      private
+      
+      def proxy_loop(client, server)
+        log = Log.create(@path)
+        requests = Framer.new(true)
+        messages = Framer.new(false)
+        
+        loop do
+          IO.select([client, server]).first.each do |io|
+            data = io.read_nonblock(1 << 16, exception: false)
+            next if data == :wait_readable
+            return if data.nil?
+            
+            now = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+            if io.equal?(client)
+              server.write(data)
+              requests.feed(data) { |message, setup| log.write(setup ? CLIENT_SETUP : REQUEST, now, message) }
+              messages.little_endian = requests.little_endian
+            else
+              client.write(data)
+              messages.feed(data) { |message, setup| log.write(setup ? SERVER_SETUP : SERVER, now, message) }
+            end
+          end
+        end
+      rescue IOError, SystemCallError
+        nil
+      ensure
+        log&.close
+      end
+    end
+    
+    # Pushes a recording into a server over a raw socket. Resource ids
+    # are moved to the new connection's id range (any aligned request
+    # word inside the recorded range; PutImage data is left alone) and
+    # extension major opcodes are looked up again by name, so the replay
+    # works on a server with a different extension layout. Everything is
+    # prepared before the clock starts; replies, events and errors are
+    # read on a second thread, and a final GetInputFocus marks the point
+    # where the server has processed the whole stream.
+    #
+    # Requests that depend on the recording process (MIT-SHM segments,
+    # interned atoms that differ) may fail on replay: they show up in
+    # :errors, the stream goes on.
+    class Replayer
+      attr_reader :path, :display, :speed
+      
+      # speed: nil replays as fast as the server takes it, 1.0 at the
+      # recorded pace, 2.0 twice as fast
+      def initialize(path, display: nil, speed: nil, timeout: 60)
+        @path = path
+        @display = display
+        @speed = speed
+        @timeout = timeout
+        load
+      end
+      
+      def size
+        @requests.size
+      end
+      
+      def recorded_seconds
+        @times.empty? ? 0.0 : @times.last - @times.first
+      end
+      
+      def run
+        socket = Recording.open_display(@display)
+        base, mask = connect(socket)
+        opcodes = lookup_extensions(socket)
+        requests = prepare(opcodes, base, mask)
+        replay(socket, requests)
+      ensure
+        socket&.close
+      end
+      
+      def inspect
+        "#<XCB::Recording::Replayer #{@path} requests=#{size} recorded=#{recorded_seconds.round(3)}s>"
+      end
+      
+      private
+      
+      def clock
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+      
+      def load
+        @times = []
+        @requests = []
+        @server = []
+        Log.read(@path) do |kind, time, bytes|
+          case kind
+          when CLIENT_SETUP then @client_setup = bytes
+          when SERVER_SETUP then @server_setup = bytes
+          when REQUEST
+            @times << time
+            @requests << bytes
+          when SERVER then @server << bytes
+          end
+        end
+        raise XCBError, "#{@path}: no connection setup recorded" unless @client_setup && @server_setup
+        
+        @little_endian = @client_setup.getbyte(0) == 0x6c
+        @short = @little_endian ? 'v' : 'n'
+        @word = @little_endian ? 'V' : 'N'
+        @base, @mask = @server_setup.unpack("#{@word}2", offset: 12)
+        @recorded_events = @server.count { |message| message.getbyte(0) & 0x7f > 1 }
+      end
+      
+      # Recorded name => major opcode, from the QueryExtension requests and
+      # the replies with their sequence numbers
+      def recorded_extensions
+        return @recorded_extensions if @recorded_extensions
+        
+        names = {}
+        @requests.each_with_index do |request, index|
+          next unless request.getbyte(0) == QUERY_EXTENSION
+          
+          names[(index + 1) & 0xffff] = request.byteslice(8, request.unpack1(@short, offset: 4))
+        end
+        
+        extensions = {}
+        @server.each do |message|
+          next unless message.getbyte(0) == 1
+          
+          name = names.delete(message.unpack1(@short, offset: 2))
+          extensions[name] = message.getbyte(9) if name && message.getbyte(8) == 1
+        end
+        @recorded_extensions = extensions
+      end
+      
+      # Same byte order and protocol version, no authorization
+      def connect(socket)
+        socket.write(@client_setup.byteslice(0, 6) + "\0".b * 6)
+        head = read_exactly(socket, 8)
+        body = read_exactly(socket, 4 * head.unpack1(@short, offset: 6))
+        unless head.getbyte(0) == 1
+          raise XCBError, "Replay server refused the connection: #{body.byteslice(0, head.getbyte(1))}"
+        end
+        
+        (head + body).unpack("#{@word}2", offset: 12)
+      end
+      
+      # Recorded major opcode => major opcode on this server (nil: missing)
+      def lookup_extensions(socket)
+        recorded = recorded_extensions
+        @sequence = 0
+        recorded.each_key do |name|
+          socket.write([QUERY_EXTENSION, 0].pack('CC') + [2 + (name.bytesize + 3) / 4].pack(@short) +
+                       [name.bytesize, 0].pack("#{@short}2") + name + "\0".b * (-name.bytesize % 4))
+          @sequence += 1
+        end
+        recorded.to_h do |name, major|
+          reply = read_message(socket)
+          [major, reply.getbyte(8) == 1 ? reply.getbyte(9) : nil]
+        end
+      end
+      
+      # Remapped copies of the requests; nil for those of missing extensions
+      def prepare(opcodes, base, mask)
+        names = recorded_extensions.invert
+        @unmapped = 0
+        @requests.map do |request|
+          opcode = request.getbyte(0)
+          fields = CORE_XIDS[opcode]
+          if opcode >= 128
+            next nil unless opcodes[opcode]
+            
+            fields = EXTENSION_XIDS.dig(names[opcode], request.getbyte(1))
+            request = request.dup
+            request.setbyte(0, opcodes[opcode])
+          end
+          next request if base == @base
+          
+          @unmapped += 1 if opcode >= 128 && fields.nil?
+          fields ? remap_ids(request, fields, base, mask) : request
+        end
+      end
+      
+      # Rewrites only the XID fields listed for the request; a
+      # BIG-REQUESTS length word shifts the body by 4 bytes
+      def remap_ids(request, fields, base, mask)
+        request = request.dup
+        shift = request.unpack1(@short, offset: 2).zero? ? 4 : 0
+        remap = lambda do |offset, pack = @word|
+          return if offset + 4 > request.bytesize
+          
+          id = request.unpack1(pack, offset: offset)
+          return unless id & ~@mask & 0xffffffff == @base
+          
+          request[offset, 4] = [base | (id & mask)].pack(pack)
+        end
+        
+        fields.each do |field|
+          next remap.(field + shift) if field.is_a?(Integer)
+          
+          kind, offset, size, bits = field
+          offset += shift
+          case kind
+          when :values
+            value_mask = request.unpack1(size == 2 ? @short : @word, offset: offset)
+            slot = 0
+            32.times do |bit|
+              next if value_mask[bit].zero?
+              
+              remap.(offset + 4 + 4 * slot) if bits[bit] == 1
+              slot += 1
+            end
+          when :list
+            offset.step(request.bytesize - 4, size) { |at| remap.(at) }
+          when :text
+            while offset + 2 <= request.bytesize
+              length = request.getbyte(offset)
+              if length == 255
+                remap.(offset + 1, 'N')                   # font ids in items are MSB first
+                offset += 5
+              else
+                offset += 2 + length * size
+              end
+            end
+          when :glyphs
+            while offset + 8 <= request.bytesize
+              length = request.getbyte(offset)
+              if length == 255
+                remap.(offset + 8)
+                offset += 12
+              else
+                offset += 8 + (length * size + 3) / 4 * 4
+              end
+            end
+          end
+        end
+        request
+      end
+      
+      def replay(socket, requests)
+        sent_at = Array.new(@sequence + requests.size + 2)
+        @sentinel = nil
+        reader = Thread.new { read_loop(socket, sent_at) }
+        
+        buffer = String.new(capacity: 1 << 16, encoding: Encoding::BINARY)
+        pending = []
+        bytes = skipped = 0
+        started = clock
+        write = lambda do
+          now = clock
+          pending.each { |sequence| sent_at[sequence] = now }
+          pending.clear
+          socket.write(buffer)
+          buffer.clear
+        end
+        
+        requests.each_with_index do |request, index|
+          unless request
+            skipped += 1
+            next
+          end
+          if @speed
+            due = started + (@times[index] - @times.first) / @speed
+            if due > clock
+              write.call unless buffer.empty?
+              wait = due - clock
+              sleep(wait) if wait > 0
+            end
+          end
+          
+          @sequence += 1
+          pending << @sequence
+          buffer << request
+          bytes += request.bytesize
+          write.call if buffer.bytesize >= 1 << 16
+        end
+        
+        @sentinel = @sequence + 1
+        pending << @sentinel
+        buffer << [GET_INPUT_FOCUS, 0].pack('CC') << [1].pack(@short)
+        write.call
+        stats = reader.join(@timeout)&.value
+        reader.kill unless stats
+        report(stats, started, requests.size - skipped, skipped, bytes)
+      end
+      
+      # Replies and errors are matched to their request by sequence number
+      # (widened from the 16 bits on the wire); events are counted
+      def read_loop(socket, sent_at)
+        stats = { replies: 0, errors: 0, events: 0, latencies: [], finished: nil }
+        last = @sequence
+        while (message = read_message(socket))
+          type = message.getbyte(0) & 0x7f
+          if type > 1
+            stats[:events] += 1
+            next
+          end
+          
+          sequence = (last & ~0xffff) | message.unpack1(@short, offset: 2)
+          sequence += 0x10000 if sequence < last
+          last = sequence
+          if sequence == @sentinel
+            stats[:finished] = clock
+            break
+          end
+          
+          stats[type.zero? ? :errors : :replies] += 1
+          stats[:latencies] << clock - sent_at[sequence] if sent_at[sequence]
+        end
+        stats
+      end
+      
+      def read_message(socket)
+        message = socket.read(32)
+        return nil unless message && message.bytesize == 32
+        
+        type = message.getbyte(0) & 0x7f
+        if type == 1 || type == GENERIC_EVENT
+          extra = 4 * message.unpack1(@word, offset: 4)
+          message << read_exactly(socket, extra) if extra > 0
+        end
+        message
+      end
+      
+      def read_exactly(socket, length)
+        data = length.zero? ? "".b : socket.read(length)
+        raise XCBError, "Replay server closed the connection" unless data && data.bytesize == length
+        
+        data
+      end
+      
+      def report(stats, started, sent, skipped, bytes)
+        finished = stats&.dig(:finished)
+        seconds = (finished || clock) - started
+        latencies = stats ? stats[:latencies].sort! : []
+        { requests: sent, skipped: skipped, bytes: bytes, completed: !finished.nil?,
+          seconds: seconds.round(6),
+          requests_per_second: (sent / seconds).round(2),
+          megabytes_per_second: (bytes / seconds / 1e6).round(3),
+          recorded_seconds: recorded_seconds.round(6), speed: @speed,
+          replies: stats&.dig(:replies), errors: stats&.dig(:errors), events: stats&.dig(:events),
+          unmapped: @unmapped,
+          recorded_events: @recorded_events,
+          latency_us: percentiles(latencies) }
+      end
+      
+      def percentiles(sorted)
+        return nil if sorted.empty?
+        
+        at = ->(q) { (sorted[(sorted.size * q).floor.clamp(0, sorted.size - 1)] * 1e6).round(1) }
+        { mean: (sorted.sum / sorted.size * 1e6).round(1), p50: at.(0.5), p99: at.(0.99),
+          max: (sorted.last * 1e6).round(1) }
+      end
+    end
+  end
+end
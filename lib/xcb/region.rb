@@ -0,0 +1,194 @@
+require_relative '../xcb_wrapper'
+require_relative '../xcb_xfixes'
+
+module XCB
+  # XFixes region kept on the server. Union, intersection, subtraction
+  # and translation are single requests with no reply, so a repaint area
+  # can be built from Expose rectangles, damage and window shapes without
+  # its rectangles ever coming back to Ruby; only rectangles/extents
+  # read it (one round trip).
+  #
+  #   dirty = XCB::Region.new(conn, exposed_rectangles)
+  #   dirty.intersect!(XCB::Region.new(conn, [[0, 60, 600, 340]]))
+  #   gc.with_clip(dirty) { display_list.each { |op| op.call(gc) } }
+  #   window.set_shape_region(XCB::Region.new(conn, [[0, 0, 200, 200], [50, 200, 100, 40]]))
+  #
+  # version changes with every modification; GraphicsContext uses it to
+  # tell whether its clip is still current (SetGCClipRegion copies the
+  # region, later changes do not reach the GC).
+  class Region
+    attr_reader :connection, :region_id, :version
+    
+    class << self
+      # The shape of a window (kind :bounding, :clip or :input)
+      def from_window(window, kind: :bounding)
+        region = allocate
+        region.send(:initialize_from_window, window, kind)
+        region
+      end
+      
+      # XFixes needs a QueryVersion before its other requests; once per
+      # connection
+      def negotiate(connection)
+        @negotiated ||= ObjectSpace::WeakMap.new
+        return if @negotiated.key?(connection)
+        
+        connection.require_extension(XFixes::ID, "XFIXES")
+        conn = connection.connection
+        cookie = XFixes.xcb_xfixes_query_version(conn, 2, 0)
+        reply = connection.wait_for_reply("XFixesQueryVersion", "XFIXES:0") { XFixes.xcb_xfixes_query_version_reply(conn, cookie, nil) }
+        XCB::LibC.free(reply) unless reply.null?
+        @negotiated[connection] = true
+      end
+      
+      # Reusable region for operands given as rectangles
+      def scratch(connection)
+        @scratch ||= ObjectSpace::WeakMap.new
+        @scratch[connection] ||= new(connection)
+      end
+      
+      def shape_kind(kind)
+        case kind
+        when :bounding then XFixes::SHAPE_BOUNDING
+        when :clip then XFixes::SHAPE_CLIP
+        when :input then XFixes::SHAPE_INPUT
+        else kind
+        end
+      end
+    end
+    
+    # rectangles are [x, y, width, height] arrays
+    def initialize(connection, rectangles = [])
+      setup(connection)
+      XFixes.xcb_xfixes_create_region(connection.connection, @region_id, rectangles.size,
+                                      connection.scratch.rectangles(rectangles))
+    end
+    
+    # === IN PLACE (no round trip) ===
+    # other is a Region or a list of rectangles
+    
+    def set(rectangles)
+      XFixes.xcb_xfixes_set_region(@connection.connection, @region_id, rectangles.size,
+                                   @connection.scratch.rectangles(rectangles))
+      changed
+    end
+    
+    def union!(other)
+      XFixes.xcb_xfixes_union_region(@connection.connection, @region_id, operand(other), @region_id)
+      changed
+    end
+    
+    def intersect!(other)
+      XFixes.xcb_xfixes_intersect_region(@connection.connection, @region_id, operand(other), @region_id)
+      changed
+    end
+    
+    def subtract!(other)
+      XFixes.xcb_xfixes_subtract_region(@connection.connection, @region_id, operand(other), @region_id)
+      changed
+    end
+    
+    def translate!(dx, dy)
+      XFixes.xcb_xfixes_translate_region(@connection.connection, @region_id, dx, dy)
+      changed
+    end
+    
+    def add(x, y, width, height)
+      union!([[x, y, width, height]])
+    end
+    
+    # === NEW REGIONS ===
+    
+    def dup
+      copy = Region.new(@connection)
+      XFixes.xcb_xfixes_copy_region(@connection.connection, @region_id, copy.region_id)
+      copy
+    end
+    
+    def |(other)
+      dup.union!(other)
+    end
+    
+    def &(other)
+      dup.intersect!(other)
+    end
+    
+    def -(other)
+      dup.subtract!(other)
+    end
+    
+    # === READING (one round trip) ===
+    
+    # [x, y, width, height] arrays, y-x banded
+    def rectangles
+      fetch { |reply, count| reply.get_bytes(XFixes::FETCH_REGION_RECTANGLES, count * 8).unpack('s2S2' * count).each_slice(4).to_a }
+    end
+    
+    # Bounding box as [x, y, width, height]
+    def extents
+      fetch { |reply, _count| reply.get_bytes(XFixes::FETCH_REGION_EXTENTS, 8).unpack('s2S2') }
+    end
+    
+    def empty?
+      _x, _y, width, height = extents
+      width.zero? || height.zero?
+    end
+    
+    def destroy
+      return if @region_id.nil?
+      
+      cleanup
+      @connection.send(:unregister_resource, self)
+      @connection.flush
+    end
+    
+    def cleanup
+      XFixes.xcb_xfixes_destroy_region(@connection.connection, @region_id) rescue nil
+      @region_id = nil
+    end
+    
+    def inspect
+      "#<XCB::Region id=#{@region_id} version=#{@version}>"
+    end
+    
+    private
+    
+    def setup(connection)
+      Region.negotiate(connection)
+      @connection = connection
+      @region_id = connection.generate_id
+      @version = 0
+      connection.send(:register_resource, self)
+    end
+    
+    def initialize_from_window(window, kind)
+      setup(window.connection)
+      XFixes.xcb_xfixes_create_region_from_window(@connection.connection, @region_id, window.window_id,
+                                                  Region.shape_kind(kind))
+    end
+    
+    def changed
+      @version += 1
+      self
+    end
+    
+    def operand(other)
+      return other.region_id if other.is_a?(Region)
+      
+      Region.scratch(@connection).set(other).region_id
+    end
+    
+    def fetch
+      conn = @connection.connection
+      cookie = XFixes.xcb_xfixes_fetch_region(conn, @region_id)
+      reply = @connection.wait_for_reply("XFixesFetchRegion", "XFIXES:19") { XFixes.xcb_xfixes_fetch_region_reply(conn, cookie, nil) }
+      raise XCBError, "FetchRegion failed for region #{@region_id}" if reply.null?
+      
+      begin
+        yield reply, reply.get_uint32(4) / 2
+      ensure
+        XCB::LibC.free(reply)
+      end
+    end
+  end
+end
@@ -0,0 +1,321 @@
+module XCB
+  # Optional fast path for high-volume drawing. Core requests are encoded
+  # straight into a Ruby-side byte buffer and the whole batch is handed to
+  # libxcb with one xcb_writev call.
+  #
+  # The write side of the socket is taken with xcb_take_socket on first use
+  # and kept until libxcb asks for it back; the return callback writes out
+  # whatever is buffered first, so encoded requests stay ordered with
+  # regular xcb_* calls. Sequence numbers continue from libxcb's counter.
+  class RequestEncoder
+    # Core protocol opcodes
+    CREATE_WINDOW = 1
+    MAP_WINDOW = 8
+    MAP_SUBWINDOWS = 9
+    CREATE_PIXMAP = 53
+    FREE_PIXMAP = 54
+    CHANGE_GC = 56
+    COPY_AREA = 62
+    POLY_SEGMENT = 66
+    POLY_FILL_RECTANGLE = 70
+    PUT_IMAGE = 72
+    POLY_TEXT_8 = 74
+    POLY_TEXT_16 = 75
+    GET_INPUT_FOCUS = 43
+    
+    # RENDER minor opcodes
+    RENDER_COMPOSITE = 8
+    
+    # libxcb detects sequence wraps only if a reply-generating request is
+    # sent first and at least every 65535 requests
+    SYNC_INTERVAL = (1 << 16) - 2
+    
+    LITTLE_ENDIAN = [1].pack('S') == "\x01\x00".b
+    PADDING = ["", "\0", "\0\0", "\0\0\0"].map(&:b).freeze
+    
+    attr_reader :connection, :last_sequence, :pending_requests
+    
+    def initialize(connection)
+      @connection = connection
+      @buffer = String.new(capacity: 64 * 1024, encoding: Encoding::BINARY)
+      @native = FFI::MemoryPointer.new(:uint8, 64 * 1024)
+      @iovec = XCB::Iovec.new
+      @sent = FFI::MemoryPointer.new(:uint64)
+      @return_socket = FFI::Function.new(:void, [:pointer]) { |_closure| return_socket }
+      
+      # Coalesced requests are kept in the 16-bit length form
+      @max_units = [connection.maximum_request_length / 4, 0xffff].min
+      
+      @owned = false
+      @pending_requests = 0
+      @since_sync = 0
+      @last_sequence = 0
+      @discard = []
+      @open_opcode = nil
+    end
+    
+    # Rectangles are appended to the previous PolyFillRectangle when it
+    # targets the same drawable and GC
+    def fill_rectangle(drawable, gc, x, y, width, height)
+      append_item(POLY_FILL_RECTANGLE, drawable, gc)
+      [x, y, width, height].pack('s2S2', buffer: @buffer)
+      self
+    end
+    
+    def poly_fill_rectangle(drawable, gc, rectangles)
+      rectangles.each { |x, y, width, height| fill_rectangle(drawable, gc, x, y, width, height) }
+      self
+    end
+    
+    def segment(drawable, gc, x1, y1, x2, y2)
+      append_item(POLY_SEGMENT, drawable, gc)
+      [x1, y1, x2, y2].pack('s4', buffer: @buffer)
+      self
+    end
+    
+    def poly_segment(drawable, gc, segments)
+      segments.each { |x1, y1, x2, y2| segment(drawable, gc, x1, y1, x2, y2) }
+      self
+    end
+    
+    # values are given in mask bit order, as for xcb_create_window
+    def create_window(depth, window, parent, x, y, width, height, border_width, window_class,
+                      visual, mask, values)
+      start_request(CREATE_WINDOW, depth, 28 + values.size * 4)
+      [window, resource_id(parent), x, y, width, height, border_width, window_class,
+       visual, mask].pack('L2s2S4L2', buffer: @buffer)
+      values.pack('L*', buffer: @buffer)
+      self
+    end
+    
+    def map_window(window)
+      start_request(MAP_WINDOW, 0, 4)
+      [resource_id(window)].pack('L', buffer: @buffer)
+      self
+    end
+    
+    # Map every unmapped child of window with one request
+    def map_subwindows(window)
+      start_request(MAP_SUBWINDOWS, 0, 4)
+      [resource_id(window)].pack('L', buffer: @buffer)
+      self
+    end
+    
+    def create_pixmap(depth, pixmap, drawable, width, height)
+      start_request(CREATE_PIXMAP, depth, 12)
+      [pixmap, resource_id(drawable), width, height].pack('L2S2', buffer: @buffer)
+      self
+    end
+    
+    def free_pixmap(pixmap)
+      start_request(FREE_PIXMAP, 0, 4)
+      [resource_id(pixmap)].pack('L', buffer: @buffer)
+      self
+    end
+    
+    def copy_area(src, dst, gc, src_x, src_y, dst_x, dst_y, width, height)
+      start_request(COPY_AREA, 0, 24)
+      [resource_id(src), resource_id(dst), resource_id(gc),
+       src_x, src_y, dst_x, dst_y, width, height].pack('L3s4S2', buffer: @buffer)
+      self
+    end
+    
+    # Values are given in mask bit order, as for xcb_change_gc
+    def change_gc(gc, mask, values)
+      start_request(CHANGE_GC, 0, 8 + values.size * 4)
+      [resource_id(gc), mask].pack('L2', buffer: @buffer)
+      values.pack('L*', buffer: @buffer)
+      self
+    end
+    
+    # Move a GC's clip mask (sprite blits: one per instance)
+    def clip_origin(gc, x, y)
+      start_request(CHANGE_GC, 0, 16)
+      [resource_id(gc), XCB::XCB_GC_CLIP_ORIGIN_X | XCB::XCB_GC_CLIP_ORIGIN_Y, x, y].pack('L2l2', buffer: @buffer)
+      self
+    end
+    
+    # RENDER Composite; major_opcode is the extension's, from
+    # Connection#extension. Pictures are ids or Picture objects
+    def render_composite(major_opcode, op, src, mask, dst, src_x, src_y, mask_x, mask_y,
+                         dst_x, dst_y, width, height)
+      start_request(major_opcode, RENDER_COMPOSITE, 32)
+      [op, picture_id(src), picture_id(mask), picture_id(dst),
+       src_x, src_y, mask_x, mask_y, dst_x, dst_y, width, height].pack('Cx3L3s6S2', buffer: @buffer)
+      self
+    end
+    
+    # ZPixmap data is split into row strips that fit one request each
+    def put_image(drawable, gc, width, height, x, y, depth, data,
+                  format: XCB::XCB_IMAGE_FORMAT_Z_PIXMAP, left_pad: 0)
+      drawable = resource_id(drawable)
+      gc = resource_id(gc)
+      stride = data.bytesize / height
+      # Header and fixed fields are 6 units, plus the extended length
+      # word of the BIG-REQUESTS form once a strip passes 0xffff units
+      overhead = max_request_units > 0xffff ? 7 : 6
+      rows_per_request = if format == XCB::XCB_IMAGE_FORMAT_Z_PIXMAP
+                           [((max_request_units - overhead) * 4) / stride, 1].max
+                         else
+                           height
+                         end
+      
+      row = 0
+      while row < height
+        rows = [rows_per_request, height - row].min
+        bytes = stride * rows
+        padding = -bytes % 4
+        start_request(PUT_IMAGE, format, 20 + bytes + padding)
+        [drawable, gc, width, rows, x, y + row, left_pad, depth].pack('L2S2s2C2x2', buffer: @buffer)
+        @buffer << data.byteslice(stride * row, bytes).force_encoding(Encoding::BINARY)
+        @buffer << PADDING[padding]
+        row += rows
+      end
+      self
+    end
+    
+    # items is a TextItems list (or its pre-encoded bytes)
+    def poly_text(drawable, gc, x, y, items, wide: items.respond_to?(:wide?) && items.wide?)
+      bytes = items.respond_to?(:bytes) ? items.bytes : items
+      padding = -bytes.bytesize % 4
+      start_request(wide ? POLY_TEXT_16 : POLY_TEXT_8, 0, 12 + bytes.bytesize + padding)
+      [resource_id(drawable), resource_id(gc), x, y].pack('L2s2', buffer: @buffer)
+      @buffer << bytes
+      @buffer << PADDING[padding]
+      self
+    end
+    
+    # Hand everything buffered to libxcb in one native call
+    def flush
+      return self if @buffer.empty?
+      
+      tracer = @connection.tracer
+      started = tracer.now if tracer
+      bytes = @buffer.bytesize
+      @native = FFI::MemoryPointer.new(:uint8, bytes * 2) if @native.size < bytes
+      @native.put_bytes(0, @buffer)
+      @iovec[:base] = @native
+      @iovec[:len] = bytes
+      
+      requests = @pending_requests
+      @buffer.clear
+      @pending_requests = 0
+      @open_opcode = nil
+      
+      raise XCBError, "xcb_writev failed" if XCB.xcb_writev(@connection.connection, @iovec, 1, requests) == 0
+      
+      @discard.each { |sequence| XCB.xcb_discard_reply(@connection.connection, sequence) }
+      @discard.clear
+      tracer.complete("xcb_writev", :io, started, { requests: requests, bytes: bytes }) if tracer
+      self
+    end
+    
+    def owns_socket?
+      @owned
+    end
+    
+    def inspect
+      "#<XCB::RequestEncoder pending=#{@pending_requests} bytes=#{@buffer.bytesize} last_sequence=#{@last_sequence}>"
+    end
+    
+    private
+    
+    def max_request_units
+      @max_request_units ||= @connection.maximum_request_length / 4
+    end
+    
+    def resource_id(resource)
+      case resource
+      when Integer then resource
+      when GraphicsContext then resource.gc_id
+      else resource.drawable_id
+      end
+    end
+    
+    def picture_id(picture)
+      case picture
+      when nil then XCB::XCB_NONE
+      when Integer then picture
+      else picture.picture_id
+      end
+    end
+    
+    # Called by libxcb (via get_socket_back) before it writes again
+    def return_socket
+      flush
+    rescue StandardError => e
+      warn "XCB::RequestEncoder: #{e.message}"
+    ensure
+      @owned = false
+    end
+    
+    def take_socket
+      if XCB.xcb_take_socket(@connection.connection, @return_socket, nil, 0, @sent) == 0
+        raise XCBError, "xcb_take_socket failed"
+      end
+      
+      @owned = true
+      @last_sequence = @sent.read_uint64 & 0xffffffff
+      @since_sync = SYNC_INTERVAL
+    end
+    
+    def start_request(opcode, data, body_bytes)
+      take_socket unless @owned
+      insert_sync if @since_sync >= SYNC_INTERVAL
+      
+      units = (body_bytes + 4) / 4
+      if units > 0xffff
+        [opcode, data, 0, units + 1].pack('CCSL', buffer: @buffer)
+      else
+        [opcode, data, units].pack('CCS', buffer: @buffer)
+      end
+      
+      @open_opcode = nil
+      count_request
+    end
+    
+    # Poly* items are 8 bytes each; extend the open request when possible
+    def append_item(opcode, drawable, gc)
+      drawable = resource_id(drawable)
+      gc = resource_id(gc)
+      
+      if @open_opcode == opcode && @open_drawable == drawable && @open_gc == gc &&
+         @open_units + 2 <= @max_units && @owned
+        @open_units += 2
+        write_length(@open_offset, @open_units)
+        return
+      end
+      
+      start_request(opcode, 0, 8)
+      [drawable, gc].pack('L2', buffer: @buffer)
+      @open_opcode = opcode
+      @open_drawable = drawable
+      @open_gc = gc
+      @open_offset = @buffer.bytesize - 12
+      @open_units = 3
+      
+      # Make room for the item that follows
+      @open_units += 2
+      write_length(@open_offset, @open_units)
+    end
+    
+    def write_length(offset, units)
+      low, high = LITTLE_ENDIAN ? [units & 0xff, units >> 8] : [units >> 8, units & 0xff]
+      @buffer.setbyte(offset + 2, low)
+      @buffer.setbyte(offset + 3, high)
+    end
+    
+    def insert_sync
+      [GET_INPUT_FOCUS, 0, 1].pack('CCS', buffer: @buffer)
+      count_request
+      @discard << @last_sequence
+      @since_sync = 0
+    end
+    
+    def count_request
+      @pending_requests += 1
+      @since_sync += 1
+      @last_sequence = (@last_sequence + 1) & 0xffffffff
+    end
+  end
+end
@@ -0,0 +1,140 @@
+module XCB
+  # Reusable native memory for request arguments. xcb_* functions copy
+  # value lists, points and rectangles into libxcb's output buffer before
+  # they return, so one buffer per connection can serve every request:
+  # it is allocated once, grows by doubling when a request needs more and
+  # is never freed per call. Not for use from several threads at once.
+  #
+  #   list = connection.scratch.value_list
+  #   list.set(XCB::XCB_GC_LINE_WIDTH, 3)
+  #   list.set(XCB::XCB_GC_FOREGROUND, pixel)      # any order
+  #   XCB.xcb_change_gc(conn, gc_id, list.mask, list.pointer)
+  class ScratchArena
+    INITIAL_SIZE = 256
+    
+    # Mask + values for xcb_create_gc, xcb_change_window_attributes,
+    # xcb_configure_window, ... Values are kept by bit position and
+    # written out in mask bit order, whatever order they were set in
+    class ValueList
+      attr_reader :mask
+      
+      def initialize(arena)
+        @arena = arena
+        @values = Array.new(32, 0)
+        @mask = 0
+      end
+      
+      def clear
+        @mask = 0
+        self
+      end
+      
+      def set(bit, value)
+        @mask |= bit
+        @values[bit.bit_length - 1] = value
+        self
+      end
+      
+      def empty?
+        @mask.zero?
+      end
+      
+      def size
+        @mask.to_s(2).count('1')
+      end
+      
+      # Values in mask order, for the RequestEncoder
+      def to_a
+        values = []
+        mask = @mask
+        bit = 0
+        while mask != 0
+          values << (@values[bit] & 0xffffffff) if mask & 1 == 1
+          mask >>= 1
+          bit += 1
+        end
+        values
+      end
+      
+      # Native array of the values in mask order (nil when empty)
+      def pointer
+        return nil if @mask.zero?
+        
+        buffer = @arena.buffer(128)
+        mask = @mask
+        index = 0
+        bit = 0
+        while mask != 0
+          if mask & 1 == 1
+            buffer.put_uint32(index * 4, @values[bit] & 0xffffffff)
+            index += 1
+          end
+          mask >>= 1
+          bit += 1
+        end
+        buffer
+      end
+    end
+    
+    attr_reader :size, :grows
+    
+    def initialize(size = INITIAL_SIZE)
+      @size = size
+      @grows = 0
+      @memory = FFI::MemoryPointer.new(:uint8, size)
+      @value_list = ValueList.new(self)
+    end
+    
+    # At least bytes of native memory; contents are not preserved
+    # between calls
+    def buffer(bytes)
+      if bytes > @size
+        @size *= 2 while @size < bytes
+        @memory = FFI::MemoryPointer.new(:uint8, @size)
+        @grows += 1
+      end
+      @memory
+    end
+    
+    # The arena's value list, emptied
+    def value_list
+      @value_list.clear
+    end
+    
+    # One uint32 (single-value masks: event mask, cursor, GC foreground)
+    def uint32(value)
+      buffer(4).put_uint32(0, value & 0xffffffff)
+    end
+    
+    # xcb_point_t[2] for a line
+    def points(x1, y1, x2, y2)
+      buffer(8).put_int16(0, x1).put_int16(2, y1).put_int16(4, x2).put_int16(6, y2)
+    end
+    
+    # xcb_point_t
+    def point(x, y)
+      buffer(4).put_int16(0, x).put_int16(2, y)
+    end
+    
+    # xcb_rectangle_t
+    def rectangle(x, y, width, height)
+      buffer(8).put_int16(0, x).put_int16(2, y).put_uint16(4, width).put_uint16(6, height)
+    end
+    
+    # An array of uint32 (ids, pixels)
+    def uint32_array(values)
+      memory = buffer(values.size * 4)
+      memory.put_array_of_uint32(0, values)
+    end
+    
+    # xcb_rectangle_t[] from [x, y, width, height] arrays
+    def rectangles(list)
+      memory = buffer([list.size * 8, 8].max)
+      memory.put_bytes(0, list.flatten.pack('s2S2' * list.size))
+    end
+    
+    def inspect
+      "#<XCB::ScratchArena #{@size} bytes grows=#{@grows}>"
+    end
+  end
+end
@@ -40,6 +40,37 @@ module XCB
       @screen_data[:default_colormap]
     end
     
+    # Visual description from the screen's allowed depths:
+    # { visual_id:, depth:, class:, red_mask:, green_mask:, blue_mask: }
+    def visual_type(visual_id = root_visual)
+      visual_types.find { |v| v[:visual_id] == visual_id }
+    end
+    
+    # First TrueColor visual of a depth (e.g. 32 for ARGB pixmaps)
+    def visual_for_depth(depth)
+      visual_types.find { |v| v[:depth] == depth && v[:class] == 4 }
+    end
+    
+    # xcb_depth_t records (8 bytes) each followed by 24-byte xcb_visualtype_t
+    def visual_types
+      @visual_types ||= begin
+        ptr = @screen_data.pointer
+        offset = ::XCB::Screen.size
+        types = []
+        @screen_data[:allowed_depths_len].times do
+          depth, visuals = ptr.get_bytes(offset, 4).unpack('CxS')
+          offset += 8
+          visuals.times do
+            id, klass, red, green, blue = ptr.get_bytes(offset, 20).unpack('LCx3L3')
+            types << { visual_id: id, depth: depth, class: klass,
+                       red_mask: red, green_mask: green, blue_mask: blue }
+            offset += 24
+          end
+        end
+        types
+      end
+    end
+    
     # Convenience methods
     def dimensions
       [width, height]
@@ -53,6 +84,12 @@ module XCB
       Window.new(@connection, self, options)
     end
     
+    # Top-level windows (and their :children) in one batch, see
+    # Window.create_many
+    def create_windows(specs, map: false)
+      Window.create_many(@connection, self, specs, map: map)
+    end
+    
     def create_colormap(visual = nil)
       Colormap.new(@connection, self, visual || root_visual)
     end
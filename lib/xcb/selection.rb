@@ -0,0 +1,261 @@
+module XCB
+  # ICCCM selection transfers (CLIPBOARD, PRIMARY) in both directions,
+  # driven by the application's event loop through handle_event.
+  #
+  # Values larger than chunk_size move with the INCR protocol: the owner
+  # writes one chunk per PropertyNotify(Delete) from the requestor and
+  # the requestor reads and deletes each chunk as its PropertyNotify
+  # arrives, so neither side holds more than a chunk of the payload (an
+  # IO source is read with pread, an IO sink is written as chunks arrive).
+  #
+  #   clipboard = XCB::Selection.new(window)              # CLIPBOARD
+  #   clipboard.own(File.open("big.png"), targets: ["image/png"])
+  #   clipboard.request("UTF8_STRING", on_complete: ->(ok, size) { ... }) { |chunk| ... }
+  #   app.run { |event| next if clipboard.handle_event(event); ... }
+  class Selection
+    # Outgoing INCR transfer to one requestor property
+    Transfer = Struct.new(:requestor, :property, :type, :source, :offset)
+    # Incoming value for the pending request
+    Incoming = Struct.new(:target, :on_chunk, :on_complete, :incremental, :size)
+    
+    attr_reader :connection, :window, :atom, :chunk_size
+    
+    def initialize(window, name = :CLIPBOARD, chunk_size: Property::CHUNK_SIZE)
+      @window = window
+      @connection = window.connection
+      @chunk_size = chunk_size
+      @atom, @incr_atom, @targets_atom, @property = @connection.atoms(name, 'INCR', 'TARGETS', 'XCB_SELECTION')
+      @transfers = {}
+      @source = nil
+      
+      # INCR chunks addressed to us are announced by PropertyNotify
+      window.add_events(:property_change)
+    end
+    
+    # === REQUESTOR ===
+    
+    # Ask the current owner for target. Chunks are yielded as they arrive;
+    # on_complete gets (success, total_bytes) at the end
+    def request(target = 'UTF8_STRING', on_complete: nil, &on_chunk)
+      raise XCBError, "Selection transfer already in progress" if @incoming
+      
+      target_atom = target.is_a?(Integer) ? target : @connection.atom(target)
+      @incoming = Incoming.new(target_atom, on_chunk, on_complete, false, 0)
+      XCB.xcb_convert_selection(@connection.connection, @window.window_id, @atom, target_atom,
+                                @property, XCB::XCB_CURRENT_TIME)
+      @connection.flush
+      self
+    end
+    
+    # Blocking read for scripts: runs the event loop until the transfer
+    # finishes. Chunks are appended to sink (a String or IO); unrelated
+    # events are passed to the block. Returns sink, or nil on failure
+    def read(target = 'UTF8_STRING', sink: String.new(encoding: Encoding::BINARY))
+      result = nil
+      request(target, on_complete: ->(ok, _size) { result = ok }) { |chunk| sink << chunk }
+      
+      while result.nil?
+        event = @connection.wait_for_event
+        break unless event
+        next if handle_event(event)
+        
+        yield event if block_given?
+      end
+      result ? sink : nil
+    end
+    
+    def receiving?
+      !@incoming.nil?
+    end
+    
+    # === OWNER ===
+    
+    # Serve data (String or IO) for targets until another client takes
+    # the selection. Returns false if the server did not make us owner
+    def own(data, targets: %w[UTF8_STRING STRING TEXT])
+      conn = @connection.connection
+      XCB.xcb_set_selection_owner(conn, @window.window_id, @atom, XCB::XCB_CURRENT_TIME)
+      cookie = XCB.xcb_get_selection_owner(conn, @atom)
+      reply = @connection.wait_for_reply("GetSelectionOwner", 23) { XCB.xcb_get_selection_owner_reply(conn, cookie, nil) }
+      return false if reply.null?
+      
+      owner = reply.get_uint32(8)
+      XCB::LibC.free(reply)
+      return false unless owner == @window.window_id
+      
+      @source = data
+      @source_targets = @connection.atoms(*targets)
+      true
+    end
+    
+    def owner?
+      !@source.nil?
+    end
+    
+    def disown
+      XCB.xcb_set_selection_owner(@connection.connection, XCB::XCB_NONE, @atom, XCB::XCB_CURRENT_TIME) if owner?
+      @source = nil
+      @connection.flush
+      self
+    end
+    
+    def transfers
+      @transfers.size
+    end
+    
+    # === EVENTS ===
+    
+    # Returns true when the event belonged to a selection transfer
+    def handle_event(event)
+      case event.type
+      when :selection_notify
+        return false unless @incoming && event.requestor == @window.window_id && event.selection == @atom
+        
+        receive(event)
+      when :selection_request
+        return false unless event.window_id == @window.window_id && event.selection == @atom
+        
+        serve(event)
+      when :selection_clear
+        return false unless event.window_id == @window.window_id && event.selection == @atom
+        
+        # Running INCR transfers keep their own reference to the data
+        @source = nil
+      when :property_notify
+        handled = false
+        if @incoming&.incremental && event.window_id == @window.window_id && event.property_atom == @property
+          handled = true
+          receive_chunk unless event.property_deleted?
+        end
+        if (transfer = @transfers[[event.window_id, event.property_atom]])
+          handled = true
+          send_chunk(transfer) if event.property_deleted?
+        end
+        return handled
+      else
+        return false
+      end
+      true
+    end
+    
+    def inspect
+      "#<XCB::Selection atom=#{@atom} owner=#{owner?} transfers=#{@transfers.size}>"
+    end
+    
+    private
+    
+    def receive(event)
+      if event.property_atom == XCB::XCB_NONE
+        finish(false)
+        return
+      end
+      
+      info = Property.info(@connection, @window.window_id, @property)
+      if info.nil?
+        finish(false)
+      elsif info.type == @incr_atom
+        # Deleting the INCR property asks the owner for the first chunk
+        @incoming.incremental = true
+        Property.delete(@connection, @window.window_id, @property)
+        @connection.flush
+      else
+        read_chunks
+        finish(true)
+      end
+    end
+    
+    # An empty INCR chunk marks the end of the transfer
+    def receive_chunk
+      finish(true) if read_chunks.zero?
+    end
+    
+    def read_chunks
+      received = 0
+      Property.chunks(@connection, @window.window_id, @property, chunk_size: @chunk_size, delete: true).each do |chunk|
+        received += chunk.bytesize
+        @incoming.on_chunk&.call(chunk)
+      end
+      @incoming.size += received
+      @connection.flush
+      received
+    end
+    
+    def finish(success)
+      incoming = @incoming
+      @incoming = nil
+      incoming.on_complete&.call(success, incoming.size)
+    end
+    
+    def serve(event)
+      requestor = event.requestor
+      target = event.selection_target
+      # Obsolete clients leave property None and expect the target name
+      property = event.property_atom == XCB::XCB_NONE ? target : event.property_atom
+      
+      if @source.nil?
+        property = XCB::XCB_NONE
+      elsif target == @targets_atom
+        Property.write(@connection, requestor, property, XCB::XCB_ATOM_ATOM,
+                       [@targets_atom, *@source_targets], format: 32)
+      elsif @source_targets.include?(target)
+        size = source_size(@source)
+        if size > @chunk_size
+          start_incr(requestor, property, target, size)
+        else
+          Property.write(@connection, requestor, property, target, source_read(@source, 0, size))
+        end
+      else
+        property = XCB::XCB_NONE
+      end
+      
+      notify(requestor, target, property, event.time)
+    end
+    
+    # The requestor's deletion of the INCR property asks for each chunk
+    def start_incr(requestor, property, target, size)
+      select_property_events(requestor, XCB::XCB_EVENT_MASK_PROPERTY_CHANGE)
+      Property.write(@connection, requestor, property, @incr_atom, [size], format: 32)
+      @transfers[[requestor, property]] = Transfer.new(requestor, property, target, @source, 0)
+    end
+    
+    def send_chunk(transfer)
+      chunk = source_read(transfer.source, transfer.offset, @chunk_size) || ""
+      Property.write(@connection, transfer.requestor, transfer.property, transfer.type, chunk)
+      transfer.offset += chunk.bytesize
+      
+      # The zero-length write above ended the transfer
+      if chunk.empty?
+        @transfers.delete([transfer.requestor, transfer.property])
+        unless @transfers.each_key.any? { |requestor, _| requestor == transfer.requestor }
+          select_property_events(transfer.requestor, 0)
+        end
+      end
+      @connection.flush
+    end
+    
+    def notify(requestor, target, property, time)
+      event = [XCB::XCB_SELECTION_NOTIFY, 0, time, requestor, @atom, target, property].pack('CxSL5x8')
+      XCB.xcb_send_event(@connection.connection, 0, requestor, 0, event)
+      @connection.flush
+    end
+    
+    # Our own window keeps the event mask it was created with
+    def select_property_events(window_id, mask)
+      return if window_id == @window.window_id
+      
+      XCB.xcb_change_window_attributes(@connection.connection, window_id, XCB::XCB_CW_EVENT_MASK,
+                                       @connection.scratch.uint32(mask))
+    end
+    
+    def source_size(source)
+      source.is_a?(String) ? source.bytesize : source.size
+    end
+    
+    def source_read(source, offset, length)
+      return source.byteslice(offset, length) if source.is_a?(String)
+      return nil if offset >= source.size
+      
+      source.pread(length, offset)
+    end
+  end
+end
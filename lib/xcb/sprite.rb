@@ -0,0 +1,284 @@
+require_relative '../xcb_wrapper'
+begin
+  require_relative 'picture'
+rescue LoadError
+  # libxcb-render is not installed: sprites are blitted with clip-mask GCs
+end
+
+module XCB
+  # Images that live on the server. A sheet is one pixmap of the screen's
+  # depth plus a depth-1 mask pixmap of the same size; sprites are packed
+  # into it in shelves and are rasterized or uploaded exactly once.
+  # Drawing an instance is then a single blit: a RENDER Composite with
+  # the mask as mask picture, or without RENDER a CopyArea through a GC
+  # whose clip mask is moved to the instance (ChangeGC + CopyArea).
+  #
+  # Instances are drawn in batches through the connection's
+  # RequestEncoder, so a frame with thousands of sprites is one writev:
+  #
+  #   sheet = XCB::SpriteSheet.new(conn)
+  #   ball = sheet.add(:ball, 21, 21) { |c| c.fill_circle(10, 10, 10, :red) }
+  #   sheet.batch(frame.pixmap) { |b| balls.each { |x, y| b.draw(ball, x, y) } }
+  #   sheet.release(frame.pixmap)  # before the pixmap is freed
+  class SpriteSheet
+    # Area of the sheet; x/y are the position within the sheet
+    class Sprite
+      attr_reader :sheet, :name, :x, :y, :width, :height
+      
+      def initialize(sheet, name, x, y, width, height)
+        @sheet = sheet
+        @name = name
+        @x = x
+        @y = y
+        @width = width
+        @height = height
+      end
+      
+      # One instance with its top-left corner at x, y
+      def draw(target, x, y)
+        @sheet.batch(target) { |batch| batch.draw(self, x, y) }
+        self
+      end
+      
+      # A sprite on a sheet of its own
+      def self.from_rgba(connection, width, height, rgba, name: :sprite, **options)
+        SpriteSheet.new(connection, width: width, height: height, **options).add(name, width, height, rgba)
+      end
+      
+      def self.render(connection, width, height, name: :sprite, **options, &block)
+        SpriteSheet.new(connection, width: width, height: height, **options).add(name, width, height, &block)
+      end
+      
+      def inspect
+        "#<XCB::Sprite #{@name.inspect} #{@width}x#{@height} at #{@x},#{@y}>"
+      end
+    end
+    
+    # Drawing into a sprite while it is created: every shape goes to the
+    # color pixmap and sets the same pixels in the mask. Coordinates are
+    # relative to the sprite and clipped to it
+    class Canvas
+      def initialize(sheet, sprite)
+        @sheet = sheet
+        @sprite = sprite
+      end
+      
+      def fill_rectangle(x, y, width, height, color)
+        x1 = [x, 0].max
+        y1 = [y, 0].max
+        x2 = [x + width, @sprite.width].min
+        y2 = [y + height, @sprite.height].min
+        return self if x2 <= x1 || y2 <= y1
+        
+        @sheet.send(:paint, @sprite.x + x1, @sprite.y + y1, x2 - x1, y2 - y1, color)
+        self
+      end
+      
+      # Filled disc as one span per row
+      def fill_circle(cx, cy, radius, color)
+        (-radius..radius).each do |dy|
+          half = Math.sqrt(radius * radius - dy * dy).round
+          fill_rectangle(cx - half, cy + dy, half * 2 + 1, 1, color)
+        end
+        self
+      end
+    end
+    
+    # Instances queued for one target drawable
+    class Batch
+      attr_reader :count
+      
+      def initialize(sheet, target)
+        @sheet = sheet
+        @target = target
+        @count = 0
+      end
+      
+      # sprite is a Sprite or its name
+      def draw(sprite, x, y)
+        sprite = @sheet[sprite] unless sprite.is_a?(Sprite)
+        @sheet.send(:blit, @target, sprite, x.to_i, y.to_i)
+        @count += 1
+        self
+      end
+    end
+    
+    attr_reader :connection, :pixmap, :mask, :width, :height, :depth, :mode, :sprites
+    
+    # render: false forces clip-mask blits even when RENDER is available
+    def initialize(connection, width: 1024, height: 1024, render: true)
+      @connection = connection
+      @width = width
+      @height = height
+      screen = connection.default_screen
+      @depth = screen.depth
+      @pixmap = Pixmap.new(connection, screen.root_window, width, height, @depth)
+      @mask = Pixmap.new(connection, screen.root_window, width, height, 1)
+      @encoder = connection.encoder
+      
+      @paint_gc = @pixmap.create_graphics_context(foreground: 0, graphics_exposures: false)
+      @mask_clear_gc = @mask.create_graphics_context(foreground: 0, background: 0, graphics_exposures: false)
+      @mask_set_gc = @mask.create_graphics_context(foreground: 1, background: 0, graphics_exposures: false)
+      @paint_color = nil
+      @encoder.fill_rectangle(@mask, @mask_clear_gc, 0, 0, width, height)
+      
+      @sprites = {}
+      @shelf_x = 0
+      @shelf_y = 0
+      @shelf_height = 0
+      
+      render_extension = render && defined?(Render) && connection.extension(Render::ID)
+      if render_extension
+        @mode = :render
+        @render_opcode = render_extension[:major_opcode]
+        @source = Picture.new(@pixmap)
+        @mask_source = Picture.new(@mask)
+        @targets = {}
+      else
+        @mode = :core
+        @blit_gc = @pixmap.create_graphics_context(clip_mask: @mask, graphics_exposures: false)
+        @clip_x = @clip_y = nil
+      end
+    end
+    
+    def [](name)
+      @sprites.fetch(name) { raise ArgumentError, "Unknown sprite #{name.inspect}" }
+    end
+    
+    # Reserve width x height and fill it, either from rgba (width*height
+    # 8-bit RGBA, as Capturable#capture(alpha: true) returns; alpha >= 128
+    # is opaque) or by drawing on a Canvas in the block
+    def add(name, width, height, rgba = nil)
+      raise ArgumentError, "Sprite #{name.inspect} already exists" if @sprites.key?(name)
+      
+      x, y = allocate(width, height)
+      sprite = Sprite.new(self, name, x, y, width, height)
+      if rgba
+        upload(sprite, rgba)
+      else
+        yield Canvas.new(self, sprite)
+      end
+      @encoder.flush
+      @connection.flush
+      @sprites[name] = sprite
+    end
+    
+    # Queue instances on target (a Window or Pixmap of the screen's
+    # depth) and send them with one flush; returns the instance count
+    def batch(target)
+      batch = Batch.new(self, target)
+      @connection.traced("sprite_batch", :draw, :mode, @mode) do
+        yield batch
+        @encoder.flush
+      end
+      @connection.flush
+      batch.count
+    end
+    
+    # Free the RENDER picture cached for target; call it before
+    # destroying a drawable the sheet has drawn on
+    def release(target)
+      picture = @targets&.delete(target.drawable_id)
+      return self unless picture
+      
+      picture.cleanup
+      @connection.send(:unregister_resource, picture)
+      self
+    end
+    
+    def stats
+      { mode: @mode, sprites: @sprites.size, width: @width, height: @height,
+        used_height: @shelf_y + @shelf_height }
+    end
+    
+    def inspect
+      "#<XCB::SpriteSheet #{@width}x#{@height} #{@mode} sprites=#{@sprites.size}>"
+    end
+    
+    private
+    
+    # Shelf packing: left to right, a new shelf when the row is full
+    def allocate(width, height)
+      raise ArgumentError, "Sprite #{width}x#{height} does not fit a #{@width}x#{@height} sheet" if width > @width
+      
+      if @shelf_x + width > @width
+        @shelf_y += @shelf_height
+        @shelf_x = 0
+        @shelf_height = 0
+      end
+      raise XCBError, "Sprite sheet is full" if @shelf_y + height > @height
+      
+      position = [@shelf_x, @shelf_y]
+      @shelf_x += width
+      @shelf_height = [@shelf_height, height].max
+      position
+    end
+    
+    def paint(x, y, width, height, color)
+      if color != @paint_color
+        @paint_gc.set_foreground(color)
+        @paint_color = color
+      end
+      @encoder.fill_rectangle(@pixmap, @paint_gc, x, y, width, height)
+      @encoder.fill_rectangle(@mask, @mask_set_gc, x, y, width, height)
+    end
+    
+    # Color as ZPixmap rows; the mask as runs of opaque pixels per row,
+    # which keeps it independent of the server's bitmap bit order
+    def upload(sprite, rgba)
+      width = sprite.width
+      height = sprite.height
+      raise ArgumentError, "Expected #{width * height * 4} bytes of RGBA" if rgba.bytesize != width * height * 4
+      
+      format = @connection.pixmap_format(@depth)
+      raise XCBError, "Sprite upload needs 32 bits per pixel, depth #{@depth} has #{format[:bits_per_pixel]}" if format[:bits_per_pixel] != 32
+      
+      pixels = rgba.unpack('N*').map! { |value| value >> 8 }
+      data = pixels.pack(@connection.image_byte_order == :lsb_first ? 'V*' : 'N*')
+      @encoder.put_image(@pixmap, @paint_gc, width, height, sprite.x, sprite.y, @depth, data)
+      
+      height.times do |row|
+        offset = row * width * 4 + 3
+        start = nil
+        (0..width).each do |column|
+          opaque = column < width && rgba.getbyte(offset + column * 4) >= 128
+          if opaque
+            start ||= column
+          elsif start
+            @encoder.fill_rectangle(@mask, @mask_set_gc, sprite.x + start, sprite.y + row, column - start, 1)
+            start = nil
+          end
+        end
+      end
+    end
+    
+    def blit(target, sprite, x, y)
+      if @mode == :render
+        @encoder.render_composite(@render_opcode, Render::PICT_OP_OVER, @source, @mask_source,
+                                  target_picture(target), sprite.x, sprite.y, sprite.x, sprite.y,
+                                  x, y, sprite.width, sprite.height)
+      else
+        clip_x = x - sprite.x
+        clip_y = y - sprite.y
+        if clip_x != @clip_x || clip_y != @clip_y
+          @encoder.clip_origin(@blit_gc, clip_x, clip_y)
+          @clip_x = clip_x
+          @clip_y = clip_y
+        end
+        @encoder.copy_area(@pixmap, target, @blit_gc, sprite.x, sprite.y, x, y, sprite.width, sprite.height)
+      end
+    end
+    
+    # Cached per drawable id; a picture made for another object with the
+    # same id (the XID was freed and reused) is replaced
+    def target_picture(target)
+      picture = @targets[target.drawable_id]
+      return picture if picture&.drawable.equal?(target)
+      
+      release(picture.drawable) if picture
+      @targets[target.drawable_id] = Picture.new(target)
+    end
+  end
+  
+  Sprite = SpriteSheet::Sprite
+end
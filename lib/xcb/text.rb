@@ -0,0 +1,90 @@
+module XCB
+  # Item list for a PolyText8/PolyText16 request: strings with per-item
+  # x deltas and font switches, all drawn on one baseline
+  class TextItems
+    FONT_SHIFT = 255
+    MAX_ITEM = 254
+    
+    attr_reader :bytes
+    
+    # wide: false for PolyText8 (byte strings), true for PolyText16 (CHAR2B)
+    def initialize(font, wide: Text.wide?(font))
+      @font = font
+      @wide = wide
+      @bytes = String.new(encoding: Encoding::BINARY)
+    end
+    
+    def wide?
+      @wide
+    end
+    
+    # delta is added to the x position before the string is drawn
+    def text(string, delta: 0)
+      encoded = Text.encode(string, @font)
+      unit = @wide ? 2 : 1
+      
+      # Deltas are INT8; larger offsets go into empty items first
+      while delta > 127 || delta < -128
+        step = delta.clamp(-128, 127)
+        [0, step].pack('Cc', buffer: @bytes)
+        delta -= step
+      end
+      
+      offset = 0
+      total = encoded.bytesize / unit
+      loop do
+        count = [total - offset, MAX_ITEM].min
+        [count, delta].pack('Cc', buffer: @bytes)
+        @bytes << encoded.byteslice(offset * unit, count * unit)
+        offset += count
+        delta = 0
+        break if offset >= total
+      end
+      self
+    end
+    
+    # Switch fonts for the items that follow; the font must have the same
+    # width (8- or 16-bit) as the rest of the request
+    def font(font)
+      raise XCBError, "Cannot mix 8-bit and 16-bit fonts in one PolyText" if Text.wide?(font) != @wide
+      
+      @font = font
+      font_id = font.respond_to?(:font_id) ? font.font_id : font
+      [FONT_SHIFT, font_id].pack('CN', buffer: @bytes)
+      self
+    end
+    
+    def empty?
+      @bytes.empty?
+    end
+  end
+  
+  # Transcoding of Ruby strings into a core font's encoding
+  module Text
+    # Variation selectors and zero-width joiners have no glyph in core fonts
+    INVISIBLE = /[\u{FE00}-\u{FE0F}\u{200D}]/
+    NON_BMP = /[^\u{0000}-\u{FFFF}]/
+    
+    module_function
+    
+    def wide?(font)
+      font.respond_to?(:wide?) && font.wide?
+    end
+    
+    # Returns binary bytes: the font's 8-bit charset, or big-endian CHAR2B
+    # for ISO 10646 fonts. Characters the font cannot show become '?'
+    def encode(string, font)
+      string = string.to_s
+      string = string.encode(Encoding::UTF_8, invalid: :replace, undef: :replace, replace: "?") unless string.encoding == Encoding::UTF_8
+      string = string.gsub(INVISIBLE, "") if string.match?(INVISIBLE)
+      
+      if wide?(font)
+        string = string.gsub(NON_BMP, "?") if string.match?(NON_BMP)
+        string.encode(Encoding::UTF_16BE).force_encoding(Encoding::BINARY)
+      else
+        encoding = font.respond_to?(:encoding) ? font.encoding : Encoding::ISO_8859_1
+        string.encode(encoding, invalid: :replace, undef: :replace, replace: "?").force_encoding(Encoding::BINARY)
+      end
+    end
+  end
+end
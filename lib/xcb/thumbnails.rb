@@ -0,0 +1,321 @@
+require_relative 'picture'
+require_relative '../xcb_composite'
+require_relative '../xcb_damage'
+
+module XCB
+  # Live scaled previews of windows, produced entirely on the server.
+  # Each source window is redirected with Composite (automatic mode, so
+  # it still shows normally), its backing pixmap is named with
+  # NameWindowPixmap and wrapped in a picture whose RENDER transform
+  # scales it down; a refresh is one Composite into the thumbnail's own
+  # pixmap. A DAMAGE object per window (NonEmpty level: one event until
+  # the damage is subtracted) marks the thumbnail dirty, so refresh only
+  # re-scales windows whose contents changed. No pixel ever crosses the
+  # socket.
+  #
+  #   thumbs = XCB::Thumbnails.new(conn, width: 160, height: 120)
+  #   thumbs.add(*windows)
+  #   loop do
+  #     while (event = conn.poll_for_event)
+  #       next if thumbs.handle_event(event)
+  #       ...
+  #     end
+  #     thumbs.refresh.each { |t| dashboard.composite(t.picture, *slot(t), t.width, t.height) }
+  #   end
+  class Thumbnails
+    # One preview. width/height is the scaled size inside the
+    # thumbnail pixmap (the box size, aspect ratio kept)
+    class Thumbnail
+      attr_reader :source_id, :pixmap, :picture, :damage_id, :refreshes
+      attr_reader :width, :height, :scale, :source_width, :source_height, :visual, :depth
+      attr_accessor :source_pixmap, :source_picture
+      attr_writer :viewable
+      
+      def initialize(source_id, pixmap, picture, damage_id, visual, depth)
+        @source_id = source_id
+        @pixmap = pixmap
+        @picture = picture
+        @damage_id = damage_id
+        @visual = visual
+        @depth = depth
+        @refreshes = 0
+        @width = @height = 0
+        @source_width = @source_height = 0
+        @scale = 1.0
+        @source_pixmap = nil
+        @source_picture = nil
+        @viewable = false
+      end
+      
+      def viewable?
+        @viewable
+      end
+      
+      # Source size including the border; the preview keeps its aspect
+      def resize(source_width, source_height, box_width, box_height)
+        @source_width = source_width
+        @source_height = source_height
+        @scale = [box_width.to_f / source_width, box_height.to_f / source_height, 1.0].min
+        @width = [(source_width * @scale).round, 1].max
+        @height = [(source_height * @scale).round, 1].max
+      end
+      
+      def refreshed
+        @refreshes += 1
+      end
+      
+      # Thumbnail composited OVER into a Picture (e.g. the dashboard's)
+      def draw(target, x, y)
+        target.composite(@picture, x, y, @width, @height)
+        self
+      end
+      
+      def inspect
+        "#<XCB::Thumbnail window=#{@source_id} #{@width}x#{@height} scale=#{@scale.round(3)} refreshes=#{@refreshes}>"
+      end
+    end
+    
+    attr_reader :connection, :width, :height, :filter
+    
+    def initialize(connection, width: 160, height: 120, filter: "bilinear")
+      @connection = connection
+      @width = width
+      @height = height
+      @filter = filter
+      render = connection.require_extension(Render::ID, "RENDER")
+      connection.require_extension(Composite::ID, "Composite")
+      damage = connection.require_extension(Damage::ID, "DAMAGE")
+      negotiate_versions
+      
+      @render_opcode = render[:major_opcode]
+      @damage_event = damage[:first_event] + Damage::NOTIFY
+      @by_source = {}
+      @by_damage = {}
+      @dirty = {}
+    end
+    
+    def [](window)
+      @by_source[window_id_of(window)]
+    end
+    
+    def thumbnails
+      @by_source.values
+    end
+    
+    def size
+      @by_source.size
+    end
+    
+    # Start previewing windows (Window objects or ids). Geometry,
+    # visual and map state of all of them come from one pipelined batch
+    # of requests; windows that are gone are skipped
+    def add(*windows)
+      conn = @connection.connection
+      ids = windows.flatten.map { |window| window_id_of(window) }.uniq.reject { |id| @by_source.key?(id) }
+      ids.each { |id| Composite.xcb_composite_redirect_window(conn, id, Composite::REDIRECT_AUTOMATIC) }
+      cookies = ids.map { |id| [XCB.xcb_get_geometry(conn, id), XCB.xcb_get_window_attributes(conn, id)] }
+      
+      added = ids.zip(cookies).filter_map { |id, (geometry, attributes)| build(id, geometry, attributes) }
+      @connection.flush
+      added
+    end
+    
+    # Stop previewing a window and free everything made for it. For a
+    # destroyed window (destroyed: true) the server has already dropped
+    # its DAMAGE object and redirection; only what this client still
+    # owns is freed (the named pixmap and the thumbnail's own resources)
+    def remove(window, destroyed: false)
+      thumb = @by_source.delete(window_id_of(window))
+      return nil unless thumb
+      
+      conn = @connection.connection
+      @by_damage.delete(thumb.damage_id)
+      @dirty.delete(thumb)
+      release_source(thumb)
+      unless destroyed
+        Damage.xcb_damage_destroy(conn, thumb.damage_id)
+        Composite.xcb_composite_unredirect_window(conn, thumb.source_id, Composite::REDIRECT_AUTOMATIC)
+      end
+      [thumb.picture, thumb.pixmap].each do |resource|
+        resource.cleanup
+        @connection.send(:unregister_resource, resource)
+      end
+      @connection.flush
+      thumb
+    end
+    
+    # DamageNotify for one of our DAMAGE objects marks its thumbnail
+    # dirty (consumed: returns true; others, e.g. a DamageStream's, are
+    # left alone); structure events of source windows re-name the
+    # backing pixmap after a resize or map and are left for the
+    # application
+    def handle_event(event)
+      if event.response_type == @damage_event
+        thumb = @by_damage[event.event_ptr.get_uint32(Damage::NOTIFY_DAMAGE)]
+        return false unless thumb
+        
+        @dirty[thumb] = true
+        return true
+      end
+      return false unless event.structure?
+      
+      thumb = @by_source[event.subject_window]
+      return false unless thumb
+      
+      case event.type
+      when :configure_notify
+        _x, _y, width, height, border_width = event.geometry
+        if width + 2 * border_width != thumb.source_width || height + 2 * border_width != thumb.source_height
+          name_source(thumb, width + 2 * border_width, height + 2 * border_width)
+        end
+      when :map_notify
+        thumb.viewable = true
+        name_source(thumb, thumb.source_width, thumb.source_height)
+      when :unmap_notify
+        thumb.viewable = false
+      when :destroy_notify
+        remove(thumb.source_id, destroyed: true)
+      end
+      false
+    end
+    
+    def dirty?
+      !@dirty.empty?
+    end
+    
+    # Re-scale every thumbnail whose window changed since the last
+    # refresh: DamageSubtract plus one Composite each, sent with one
+    # flush. Returns the refreshed thumbnails
+    def refresh
+      return [] if @dirty.empty?
+      
+      changed = @dirty.keys
+      @dirty.clear
+      conn = @connection.connection
+      encoder = @connection.encoder
+      @connection.traced("thumbnails", :draw, :count, changed.size) do
+        changed.select! do |thumb|
+          Damage.xcb_damage_subtract(conn, thumb.damage_id, XCB::XCB_NONE, XCB::XCB_NONE)
+          next false unless thumb.source_picture
+          
+          encoder.render_composite(@render_opcode, Render::PICT_OP_SRC, thumb.source_picture, XCB::XCB_NONE,
+                                   thumb.picture, 0, 0, 0, 0, 0, 0, thumb.width, thumb.height)
+          thumb.refreshed
+        end
+      end
+      @connection.flush
+      changed
+    end
+    
+    # Redirections and DAMAGE objects die with the connection anyway;
+    # this is for dropping the previews while it stays open
+    def clear
+      @by_source.keys.each { |id| remove(id) }
+      self
+    end
+    
+    def inspect
+      "#<XCB::Thumbnails #{@width}x#{@height} windows=#{@by_source.size} dirty=#{@dirty.size}>"
+    end
+    
+    private
+    
+    def negotiate_versions
+      conn = @connection.connection
+      cookies = [Composite.xcb_composite_query_version(conn, 0, 4),
+                 Damage.xcb_damage_query_version(conn, 1, 1),
+                 Render.xcb_render_query_version(conn, 0, 11)]
+      replies = [
+        @connection.wait_for_reply("CompositeQueryVersion", "Composite:0") do
+          Composite.xcb_composite_query_version_reply(conn, cookies[0], nil)
+        end,
+        @connection.wait_for_reply("DamageQueryVersion", "DAMAGE:0") { Damage.xcb_damage_query_version_reply(conn, cookies[1], nil) },
+        @connection.wait_for_reply("RenderQueryVersion", "RENDER:0") { Render.xcb_render_query_version_reply(conn, cookies[2], nil) }
+      ]
+      replies.each { |reply| XCB::LibC.free(reply) unless reply.null? }
+    end
+    
+    def window_id_of(window)
+      window.respond_to?(:window_id) ? window.window_id : window
+    end
+    
+    # Our own windows keep their event mask; on foreign ones
+    # StructureNotify is added to what this client already selected
+    # there (event_mask: your_event_mask from GetWindowAttributes)
+    def watch_structure(id, event_mask)
+      window = @connection.tracked_window(id)
+      if window
+        window.add_events(:structure_notify)
+      elsif event_mask & XCB::XCB_EVENT_MASK_STRUCTURE_NOTIFY == 0
+        XCB.xcb_change_window_attributes(@connection.connection, id, XCB::XCB_CW_EVENT_MASK,
+                                         @connection.scratch.uint32(event_mask | XCB::XCB_EVENT_MASK_STRUCTURE_NOTIFY))
+      end
+    end
+    
+    def build(id, geometry_cookie, attributes_cookie)
+      conn = @connection.connection
+      geometry = @connection.wait_for_reply("GetGeometry", 14) { XCB.xcb_get_geometry_reply(conn, geometry_cookie, nil) }
+      attributes = @connection.wait_for_reply("GetWindowAttributes", 3) { XCB.xcb_get_window_attributes_reply(conn, attributes_cookie, nil) }
+      return nil if geometry.null? || attributes.null?
+      
+      watch_structure(id, attributes.get_uint32(36))   # your_event_mask
+      depth = geometry.get_uint8(1)
+      width, height, border_width = geometry.get_bytes(16, 6).unpack('S3')
+      visual = attributes.get_uint32(8)
+      viewable = attributes.get_uint8(26) == XCB::XCB_MAP_STATE_VIEWABLE
+      
+      pixmap = Pixmap.new(@connection, id, @width, @height)
+      picture = Picture.new(pixmap)
+      damage_id = @connection.generate_id
+      Damage.xcb_damage_create(conn, damage_id, id, Damage::REPORT_LEVEL_NON_EMPTY)
+      
+      thumb = Thumbnail.new(id, pixmap, picture, damage_id, visual, depth)
+      thumb.viewable = viewable
+      @by_source[id] = thumb
+      @by_damage[damage_id] = thumb
+      name_source(thumb, width + 2 * border_width, height + 2 * border_width)
+      thumb
+    ensure
+      [geometry, attributes].each { |reply| XCB::LibC.free(reply) unless reply.nil? || reply.null? }
+    end
+    
+    # NameWindowPixmap is only valid while the window is viewable and
+    # names the storage of its current size, so it is redone after every
+    # resize and map. The source picture scales by the transform
+    def name_source(thumb, source_width, source_height)
+      release_source(thumb)
+      thumb.resize(source_width, source_height, @width, @height)
+      return unless thumb.viewable?
+      
+      conn = @connection.connection
+      pixmap_id = @connection.generate_id
+      picture_id = @connection.generate_id
+      Composite.xcb_composite_name_window_pixmap(conn, thumb.source_id, pixmap_id)
+      Render.xcb_render_create_picture(conn, picture_id, pixmap_id,
+                                       Picture.visual_format(@connection, thumb.visual),
+                                       0, nil)
+      
+      transform = Render::Transform.new
+      inverse = Render.fixed(1.0 / thumb.scale)
+      transform[:matrix11] = inverse
+      transform[:matrix22] = inverse
+      transform[:matrix33] = Render.fixed(1)
+      Render.xcb_render_set_picture_transform(conn, picture_id, transform)
+      Render.xcb_render_set_picture_filter(conn, picture_id, @filter.bytesize, @filter, 0, nil) if thumb.scale < 1.0
+      
+      thumb.source_pixmap = pixmap_id
+      thumb.source_picture = picture_id
+      @dirty[thumb] = true
+    end
+    
+    def release_source(thumb)
+      return unless thumb.source_picture
+      
+      conn = @connection.connection
+      Render.xcb_render_free_picture(conn, thumb.source_picture)
+      XCB.xcb_free_pixmap(conn, thumb.source_pixmap)
+      thumb.source_picture = nil
+      thumb.source_pixmap = nil
+    end
+  end
+end
@@ -0,0 +1,444 @@
+require 'zlib'
+require_relative '../xcb_wrapper'
+require_relative 'capture'
+
+module XCB
+  # A virtual drawing surface of any size (past the 32767x32767 limit of
+  # one pixmap), split into square tile pixmaps. A tile is created the
+  # first time something is drawn on it; tiles never drawn on cost
+  # nothing and show the background. At most budget bytes of tiles stay
+  # on the server: the least recently used one is read back, deflated
+  # into a client-side store and its pixmap reused; it is uploaded again
+  # when drawn on or shown. A tile that was not drawn on since it came
+  # back keeps its stored copy, so panning over a finished area reads
+  # nothing back.
+  #
+  #   canvas = XCB::TiledSurface.new(conn, width: 200_000, height: 200_000, budget: 32 << 20)
+  #   canvas.fill_rectangle(150_000, 80_000, 400, 300, 0xFF0000)
+  #   canvas.draw_line(0, 0, 199_999, 199_999, 0x0000FF, line_width: 3)
+  #   canvas.blit(window, view_x, view_y, window.width, window.height)
+  #   canvas.blit(window, view_x, view_y, window.width, window.height, scale: 0.25)   # RENDER
+  #   canvas.release(window)   # frees its cached picture before window goes away
+  #
+  # Drawing is split per tile (coordinates made tile-relative and
+  # clipped to it) and written through the connection's RequestEncoder;
+  # it reaches the server with the next blit or flush.
+  class TiledSurface
+    # A tile is resident (pixmap set) or stored (deflated ZPixmap data),
+    # or both when it came back and was not drawn on since
+    Tile = Struct.new(:column, :row, :pixmap, :stored, :dirty, :picture, :picture_scale)
+    
+    # Tile pixmap as a drawable for Capture::Reader
+    Target = Struct.new(:connection, :drawable_id)
+    
+    # Translated coordinates past this are clipped first (int16 on the wire)
+    COORDINATE_LIMIT = 16_000
+    CLIP_MARGIN = 8192
+    
+    attr_reader :connection, :width, :height, :tile_size, :budget, :depth, :background
+    
+    def initialize(connection, width:, height:, tile_size: 256, budget: 64 << 20, background: 0xFFFFFF,
+                   compression: Zlib::BEST_SPEED, shm: true)
+      @connection = connection
+      @encoder = connection.encoder
+      @width = width
+      @height = height
+      @tile_size = tile_size
+      @budget = budget
+      @background = background
+      @compression = compression
+      @shm = shm
+      
+      screen = connection.default_screen
+      @depth = screen.depth
+      @format = Capture::PixelFormat.new(connection, @depth, screen.visual_type)
+      @tile_bytes = @format.stride(tile_size) * tile_size
+      @max_resident = [budget / @tile_bytes, 1].max
+      @columns = (width + tile_size - 1) / tile_size
+      @rows = (height + tile_size - 1) / tile_size
+      
+      @tiles = {}
+      @resident = {} # insertion order is LRU order
+      @gc = create_gc(background)
+      @fill_gc = create_gc(background)
+      @foreground = background
+      @line_width = 0
+      @stored_bytes = 0
+      @allocations = @evictions = @readbacks = @restores = 0
+      connection.send(:register_resource, self)
+    end
+    
+    def fill_rectangle(x, y, width, height, color)
+      left = [x, 0].max
+      top = [y, 0].max
+      right = [x + width, @width].min
+      bottom = [y + height, @height].min
+      return self if right <= left || bottom <= top
+      
+      gc_values(color, @line_width)
+      each_tile(left, top, right, bottom) do |tile, origin_x, origin_y, l, t, r, b|
+        @encoder.fill_rectangle(tile.pixmap, @gc, l - origin_x, t - origin_y, r - l, b - t)
+      end
+      self
+    end
+    
+    def draw_point(x, y, color)
+      fill_rectangle(x, y, 1, 1, color)
+    end
+    
+    # Only the tiles the line passes through (widened by the line width)
+    # are touched. A pixel row y takes the part of the line between
+    # y - 0.5 and y + 0.5
+    def draw_line(x1, y1, x2, y2, color, line_width: 0)
+      half = line_width / 2.0
+      return self if [x1, x2].max + half < 0 || [x1, x2].min - half >= @width ||
+                     [y1, y2].max + half < 0 || [y1, y2].min - half >= @height
+      
+      first_row = ([y1, y2].min - half).round.clamp(0, @height - 1) / @tile_size
+      last_row = ([y1, y2].max + half).round.clamp(0, @height - 1) / @tile_size
+      gc_values(color, line_width)
+      
+      (first_row..last_row).each do |row|
+        origin_y = row * @tile_size
+        extent = x_extent(x1, y1, x2, y2, origin_y - 0.5 - half, origin_y + @tile_size - 0.5 + half)
+        next if extent.nil? || extent[1] + half < 0 || extent[0] - half >= @width
+        
+        first_column = (extent[0] - half).round.clamp(0, @width - 1) / @tile_size
+        last_column = (extent[1] + half).round.clamp(0, @width - 1) / @tile_size
+        (first_column..last_column).each do |column|
+          origin_x = column * @tile_size
+          segment = [x1 - origin_x, y1 - origin_y, x2 - origin_x, y2 - origin_y]
+          if segment.any? { |c| c.abs > COORDINATE_LIMIT }
+            segment = clip_segment(*segment, -CLIP_MARGIN, @tile_size + CLIP_MARGIN)
+            next unless segment
+            
+            segment.map!(&:round)
+          end
+          tile = resident(column, row, dirty: true)
+          @encoder.segment(tile.pixmap, @gc, *segment)
+        end
+      end
+      self
+    end
+    
+    # Copy an area of a drawable (a Pixmap with text or a sprite rendered
+    # into it) onto the surface
+    def copy_from(drawable, src_x, src_y, width, height, x, y)
+      left = [x, 0].max
+      top = [y, 0].max
+      right = [x + width, @width].min
+      bottom = [y + height, @height].min
+      return self if right <= left || bottom <= top
+      
+      each_tile(left, top, right, bottom) do |tile, origin_x, origin_y, l, t, r, b|
+        @encoder.copy_area(drawable, tile.pixmap, @fill_gc, src_x + l - x, src_y + t - y,
+                           l - origin_x, t - origin_y, r - l, b - t)
+      end
+      self
+    end
+    
+    # Show the area at (view_x, view_y) of the surface in target (a Window
+    # or Pixmap). With scale, width x height target pixels show
+    # width / scale x height / scale surface pixels, scaled by RENDER.
+    # Only the visible tiles are made resident; never drawn ones are
+    # filled with the background. One flush
+    def blit(target, view_x, view_y, width, height, dst_x: 0, dst_y: 0, scale: 1.0)
+      @connection.traced("tiled_blit", :draw, :scale, scale) do
+        if scale == 1.0
+          blit_copy(target, view_x, view_y, width, height, dst_x, dst_y)
+        else
+          blit_scaled(target, view_x, view_y, width, height, dst_x, dst_y, scale)
+        end
+      end
+      @connection.flush
+      self
+    end
+    
+    def flush
+      @connection.flush
+      self
+    end
+    
+    # Free the RENDER picture cached for a scaled blit target; call it
+    # before destroying a drawable the surface has been shown on
+    def release(target)
+      picture = @target_pictures&.delete(target.drawable_id)
+      return self unless picture
+      
+      picture.cleanup
+      @connection.send(:unregister_resource, picture)
+      self
+    end
+    
+    # Tile at surface position (for tests and debugging)
+    def tile_at(x, y)
+      @tiles[key(x / @tile_size, y / @tile_size)]
+    end
+    
+    def stats
+      { tiles: @tiles.size, resident: @resident.size, max_resident: @max_resident,
+        server_bytes: @resident.size * @tile_bytes, stored: @tiles.count { |_key, tile| tile.stored },
+        stored_bytes: @stored_bytes, allocations: @allocations, evictions: @evictions,
+        readbacks: @readbacks, restores: @restores }
+    end
+    
+    def cleanup
+      conn = @connection.connection
+      @resident.each_value do |tile|
+        Render.xcb_render_free_picture(conn, tile.picture) if tile.picture
+        XCB.xcb_free_pixmap(conn, tile.pixmap)
+      end
+      [@gc, @fill_gc].each { |gc| XCB.xcb_free_gc(conn, gc) }
+      @resident.clear
+      @target_pictures&.values&.each { |picture| release(picture.drawable) }
+    rescue StandardError
+      nil
+    end
+    
+    def inspect
+      "#<XCB::TiledSurface #{@width}x#{@height} tiles=#{@tiles.size} resident=#{@resident.size}/#{@max_resident}>"
+    end
+    
+    private
+    
+    def key(column, row)
+      row * @columns + column
+    end
+    
+    def create_gc(foreground)
+      gc = @connection.generate_id
+      values = @connection.scratch.value_list
+      values.set(XCB::XCB_GC_FOREGROUND, foreground)
+      # No NoExpose event per blitted tile
+      values.set(XCB::XCB_GC_GRAPHICS_EXPOSURES, 0)
+      XCB.xcb_create_gc(@connection.connection, gc, @connection.default_screen.root_window,
+                        values.mask, values.pointer)
+      gc
+    end
+    
+    def gc_values(color, line_width)
+      return if color == @foreground && line_width == @line_width
+      
+      @encoder.change_gc(@gc, XCB::XCB_GC_FOREGROUND | XCB::XCB_GC_LINE_WIDTH, [color, line_width])
+      @foreground = color
+      @line_width = line_width
+    end
+    
+    # Yields every tile the area covers, made resident and marked dirty,
+    # with its origin and the area's part inside it
+    def each_tile(left, top, right, bottom)
+      (top / @tile_size..(bottom - 1) / @tile_size).each do |row|
+        origin_y = row * @tile_size
+        t = [top, origin_y].max
+        b = [bottom, origin_y + @tile_size].min
+        (left / @tile_size..(right - 1) / @tile_size).each do |column|
+          origin_x = column * @tile_size
+          yield resident(column, row, dirty: true), origin_x, origin_y,
+                [left, origin_x].max, t, [right, origin_x + @tile_size].min, b
+        end
+      end
+    end
+    
+    # The tile with a pixmap, most recently used. A new tile starts as
+    # the background; a stored one is uploaded again
+    def resident(column, row, dirty: false)
+      key = key(column, row)
+      tile = @resident.delete(key)
+      unless tile
+        tile = @tiles[key] ||= Tile.new(column, row)
+        tile.pixmap = @resident.size >= @max_resident ? evict : allocate
+        if tile.stored
+          data = Zlib::Inflate.inflate(tile.stored)
+          @encoder.put_image(tile.pixmap, @fill_gc, @tile_size, @tile_size, 0, 0, @depth, data)
+          @restores += 1
+        else
+          @encoder.fill_rectangle(tile.pixmap, @fill_gc, 0, 0, @tile_size, @tile_size)
+        end
+      end
+      @resident[key] = tile
+      
+      if dirty && !tile.dirty
+        tile.dirty = true
+        # The stored copy is out of date from now on
+        if tile.stored
+          @stored_bytes -= tile.stored.bytesize
+          tile.stored = nil
+        end
+      end
+      tile
+    end
+    
+    def allocate
+      pixmap = @connection.generate_id
+      @encoder.create_pixmap(@depth, pixmap, @connection.default_screen.root_window, @tile_size, @tile_size)
+      @allocations += 1
+      pixmap
+    end
+    
+    # Frees the least recently used tile's pixmap for reuse; its pixels
+    # are read back only if drawn on since they were last stored
+    def evict
+      key, tile = @resident.first
+      @resident.delete(key)
+      if tile.dirty || !tile.stored
+        tile.stored = Zlib::Deflate.deflate(read_tile(tile.pixmap), @compression)
+        @stored_bytes += tile.stored.bytesize
+        @readbacks += 1
+      end
+      if tile.picture
+        Render.xcb_render_free_picture(@connection.connection, tile.picture)
+        tile.picture = nil
+      end
+      tile.dirty = false
+      pixmap = tile.pixmap
+      tile.pixmap = nil
+      @evictions += 1
+      pixmap
+    end
+    
+    def read_tile(pixmap)
+      data = String.new(capacity: @tile_bytes, encoding: Encoding::BINARY)
+      Capture::Reader.new(Target.new(@connection, pixmap), 0, 0, @tile_size, @tile_size, @format, shm: @shm)
+                     .each_strip { |_top, _rows, strip| data << strip }
+      data
+    end
+    
+    def visible_range(view, length, limit)
+      first = [view, 0].max / @tile_size
+      last = ([view + length, limit].min - 1) / @tile_size
+      (first..last)
+    end
+    
+    def blit_copy(target, view_x, view_y, width, height, dst_x, dst_y)
+      right = [view_x + width, @width].min
+      bottom = [view_y + height, @height].min
+      return if right <= [view_x, 0].max || bottom <= [view_y, 0].max
+      
+      visible_range(view_y, height, @height).each do |row|
+        origin_y = row * @tile_size
+        top = [view_y, origin_y].max
+        rows = [bottom, origin_y + @tile_size].min - top
+        visible_range(view_x, width, @width).each do |column|
+          origin_x = column * @tile_size
+          left = [view_x, origin_x].max
+          columns = [right, origin_x + @tile_size].min - left
+          if @tiles.key?(key(column, row))
+            tile = resident(column, row)
+            @encoder.copy_area(tile.pixmap, target, @fill_gc, left - origin_x, top - origin_y,
+                               dst_x + left - view_x, dst_y + top - view_y, columns, rows)
+          else
+            @encoder.fill_rectangle(target, @fill_gc, dst_x + left - view_x, dst_y + top - view_y, columns, rows)
+          end
+        end
+      end
+    end
+    
+    # Each tile picture carries the scale as its transform; tile edges are
+    # padded so filtering does not darken the seams
+    def blit_scaled(target, view_x, view_y, width, height, dst_x, dst_y, scale)
+      require_relative 'picture'
+      @render_opcode ||= @connection.require_extension(Render::ID, "RENDER")[:major_opcode]
+      destination = target_picture(target)
+      view_width = (width / scale).ceil
+      view_height = (height / scale).ceil
+      to_target = ->(surface, view, dst) { dst + ((surface - view) * scale).floor }
+      
+      visible_range(view_y, view_height, @height).each do |row|
+        origin_y = row * @tile_size
+        tile_top = to_target.(origin_y, view_y, dst_y)
+        top = [tile_top, dst_y].max
+        bottom = [to_target.(origin_y + @tile_size, view_y, dst_y), dst_y + height].min
+        next if bottom <= top
+        
+        visible_range(view_x, view_width, @width).each do |column|
+          origin_x = column * @tile_size
+          tile_left = to_target.(origin_x, view_x, dst_x)
+          left = [tile_left, dst_x].max
+          right = [to_target.(origin_x + @tile_size, view_x, dst_x), dst_x + width].min
+          next if right <= left
+          
+          if @tiles.key?(key(column, row))
+            picture = tile_picture(resident(column, row), scale)
+            @encoder.render_composite(@render_opcode, Render::PICT_OP_SRC, picture, XCB::XCB_NONE, destination,
+                                      left - tile_left, top - tile_top, 0, 0, left, top, right - left, bottom - top)
+          else
+            @encoder.fill_rectangle(target, @fill_gc, left, top, right - left, bottom - top)
+          end
+        end
+      end
+    end
+    
+    # Cached per drawable id; a picture made for another object with the
+    # same id (the XID was freed and reused) is replaced
+    def target_picture(target)
+      @target_pictures ||= {}
+      picture = @target_pictures[target.drawable_id]
+      return picture if picture&.drawable.equal?(target)
+      
+      release(picture.drawable) if picture
+      @target_pictures[target.drawable_id] = Picture.new(target)
+    end
+    
+    def tile_picture(tile, scale)
+      conn = @connection.connection
+      unless tile.picture
+        tile.picture = @connection.generate_id
+        format = Picture.visual_format(@connection, @connection.default_screen.root_visual)
+        Render.xcb_render_create_picture(conn, tile.picture, tile.pixmap, format, Render::CP_REPEAT,
+                                         @connection.scratch.uint32(Render::REPEAT_PAD))
+        tile.picture_scale = nil
+      end
+      return tile.picture if tile.picture_scale == scale
+      
+      transform = Render::Transform.new
+      inverse = Render.fixed(1.0 / scale)
+      transform[:matrix11] = inverse
+      transform[:matrix22] = inverse
+      transform[:matrix33] = Render.fixed(1)
+      Render.xcb_render_set_picture_transform(conn, tile.picture, transform)
+      filter = scale < 1.0 ? "bilinear" : "nearest"
+      Render.xcb_render_set_picture_filter(conn, tile.picture, filter.bytesize, filter, 0, nil)
+      tile.picture_scale = scale
+      tile.picture
+    end
+    
+    # x range of the segment inside the horizontal band low..high, nil
+    # if it misses the band
+    def x_extent(x1, y1, x2, y2, low, high)
+      return (low..high).cover?(y1) ? [x1, x2].minmax : nil if y1 == y2
+      
+      a = (low - y1).to_f / (y2 - y1)
+      b = (high - y1).to_f / (y2 - y1)
+      t0 = [[a, b].min, 0.0].max
+      t1 = [[a, b].max, 1.0].min
+      return nil if t0 > t1
+      
+      [x1 + t0 * (x2 - x1), x1 + t1 * (x2 - x1)].minmax
+    end
+    
+    # Liang-Barsky clip of a segment to the square low..high
+    def clip_segment(x1, y1, x2, y2, low, high)
+      dx = x2 - x1
+      dy = y2 - y1
+      t0 = 0.0
+      t1 = 1.0
+      [[-dx, x1 - low], [dx, high - x1], [-dy, y1 - low], [dy, high - y1]].each do |p, q|
+        if p.zero?
+          return nil if q < 0
+        else
+          r = q.to_f / p
+          if p < 0
+            return nil if r > t1
+            
+            t0 = r if r > t0
+          else
+            return nil if r < t0
+            
+            t1 = r if r < t1
+          end
+        end
+      end
+      [x1 + t0 * dx, y1 + t0 * dy, x1 + t1 * dx, y1 + t1 * dy]
+    end
+  end
+end
@@ -0,0 +1,128 @@
+require 'json'
+
+module XCB
+  # Timeline of where a frame's time goes: event dispatch, draw batches,
+  # encoder and xcb_flush, blocking waits and round trips. Spans are kept
+  # in a preallocated ring buffer (the newest capacity spans survive) and
+  # written out as Chrome trace JSON, which chrome://tracing and
+  # ui.perfetto.dev open directly.
+  #
+  # Tracing is off unless asked for; the instrumented paths only test an
+  # instance variable for nil then.
+  #
+  #   conn.trace                        # start recording
+  #   ...
+  #   conn.tracer.write("frame.json")
+  #
+  #   XCB_TRACE=app.json ruby demo.rb   # record from the first request,
+  #                                     # written at exit and on SIGUSR2
+  class Tracer
+    DEFAULT_CAPACITY = 1 << 16
+    
+    attr_reader :capacity, :recorded
+    
+    def initialize(capacity: DEFAULT_CAPACITY)
+      @capacity = capacity
+      @names = Array.new(capacity)
+      @categories = Array.new(capacity)
+      @starts = Array.new(capacity, 0.0)
+      @durations = Array.new(capacity, 0.0)
+      @threads = Array.new(capacity, 0)
+      @args = Array.new(capacity)
+      @next = 0
+      @recorded = 0
+      @pid = Process.pid
+    end
+    
+    # Microseconds on the monotonic clock (the trace format's unit)
+    def now
+      Process.clock_gettime(Process::CLOCK_MONOTONIC, :float_microsecond)
+    end
+    
+    # A span that started at started (from now) and ends now
+    def complete(name, category, started, args = nil)
+      index = @next
+      @names[index] = name
+      @categories[index] = category
+      @starts[index] = started
+      @durations[index] = now - started
+      @threads[index] = Thread.current.native_thread_id
+      @args[index] = args
+      @next = index + 1 == @capacity ? 0 : index + 1
+      @recorded += 1
+      self
+    end
+    
+    def span(name, category, args = nil)
+      started = now
+      yield
+    ensure
+      complete(name, category, started, args)
+    end
+    
+    # Zero-length marker
+    def instant(name, category, args = nil)
+      complete(name, category, now, args)
+    end
+    
+    def size
+      [@recorded, @capacity].min
+    end
+    
+    def dropped
+      [@recorded - @capacity, 0].max
+    end
+    
+    def clear
+      @next = 0
+      @recorded = 0
+      self
+    end
+    
+    # Chrome trace events, oldest first
+    def events
+      first = @recorded > @capacity ? @next : 0
+      Array.new(size) do |i|
+        index = (first + i) % @capacity
+        event = { name: @names[index], cat: @categories[index].to_s, ph: "X",
+                  ts: @starts[index].round(3), dur: @durations[index].round(3),
+                  pid: @pid, tid: @threads[index] }
+        event[:args] = @args[index] if @args[index]
+        event
+      end
+    end
+    
+    def to_json(*)
+      JSON.generate(traceEvents: events, displayTimeUnit: "ms",
+                    otherData: { recorded: @recorded, dropped: dropped })
+    end
+    
+    # Write the trace to a path or IO
+    def write(target)
+      if target.respond_to?(:write)
+        target.write(to_json)
+      else
+        File.write(target, to_json)
+      end
+      self
+    end
+    
+    # Write the trace to path whenever signal arrives (kill -USR2 <pid>).
+    # The trap only wakes a writer thread: file IO and JSON are not safe
+    # in trap context
+    def write_on_signal(path, signal = "USR2")
+      requests = (@signal_requests ||= Thread::Queue.new)
+      @signal_writer ||= Thread.new do
+        while (target = requests.pop)
+          write(target) rescue warn("⚠️ Trace write to #{target} failed: #{$!.message}")
+        end
+      end
+      Signal.trap(signal) { requests.push(path) }
+      self
+    end
+    
+    def inspect
+      "#<XCB::Tracer #{size}/#{@capacity} spans dropped=#{dropped}>"
+    end
+  end
+end
@@ -1,7 +1,76 @@
 module XCB
   class Window
+    include Capturable
+    
     attr_reader :connection, :screen, :window_id
     
+    # Server-side state of a window, cached until the window changes.
+    # mapped is the window's own map state; whether it is viewable also
+    # depends on its ancestors and is not cached (see map_state)
+    Info = Struct.new(:x, :y, :width, :height, :border_width, :depth, :root, :parent, :children,
+                      :mapped, :override_redirect, :visual, :window_class)
+    
+    MAP_STATES = { XCB::XCB_MAP_STATE_UNMAPPED => :unmapped,
+                   XCB::XCB_MAP_STATE_UNVIEWABLE => :unviewable,
+                   XCB::XCB_MAP_STATE_VIEWABLE => :viewable }.freeze
+    
+    # Fill the info cache of many windows with one pipelined batch: the
+    # GetGeometry, QueryTree and GetWindowAttributes requests of every
+    # window go out before the first reply is read. StructureNotify is
+    # selected first, so every later change arrives as an event
+    def self.load_info(windows)
+      windows = windows.reject { |window| window.info_loaded? || window.destroyed? }
+      return windows if windows.empty?
+      
+      windows.each { |window| window.send(:watch_structure) }
+      requests = windows.map do |window|
+        conn = window.connection.connection
+        [XCB.xcb_get_geometry(conn, window.window_id),
+         XCB.xcb_query_tree(conn, window.window_id),
+         XCB.xcb_get_window_attributes(conn, window.window_id)]
+      end
+      windows.zip(requests).each { |window, cookies| window.send(:store_info, *cookies) }
+      windows
+    end
+    
+    # Create many windows with a single flush and no round trips: every
+    # CreateWindow is encoded into the connection's RequestEncoder. A
+    # spec's :children are created inside it. With map: true each window
+    # that got children maps them with one MapSubwindows, then each new
+    # top-level window gets a MapWindow (a parent's existing unmapped
+    # children stay unmapped).
+    # Returns all new windows, parents before their children
+    #
+    #   grid = parent.create_children(50.times.flat_map { |r| 50.times.map { |c|
+    #     { x: c * 10, y: r * 10, width: 10, height: 10, border_width: 0 } } }, map: true)
+    def self.create_many(connection, screen, specs, parent: nil, map: false)
+      encoder = connection.encoder
+      windows = []
+      connection.traced("create_windows", :draw, :count, specs.size) do
+        top = build_tree(connection, screen, specs, parent, map, encoder, windows)
+        top.each { |window| encoder.map_window(window) } if map
+      end
+      connection.flush
+      windows
+    end
+    
+    # Returns the windows created at this level
+    def self.build_tree(connection, screen, specs, parent, map, encoder, windows)
+      specs.map do |spec|
+        children = spec[:children]
+        options = children ? spec.reject { |key, _| key == :children } : spec
+        options = options.merge(parent: parent) if parent && !options.key?(:parent)
+        window = Window.new(connection, screen, options, encoder: encoder)
+        windows << window
+        if children
+          build_tree(connection, screen, children, window, map, encoder, windows)
+          encoder.map_subwindows(window) if map
+        end
+        window
+      end
+    end
+    private_class_method :build_tree
+    
     DEFAULT_OPTIONS = {
       x: 0,
       y: 0, 
@@ -13,15 +82,143 @@ module XCB
       events: [:exposure, :key_press]
     }.freeze
     
-    def initialize(connection, screen, options = {})
+    # options[:parent] is a Window or window id (default: the root).
+    # With encoder the CreateWindow request is encoded there instead of
+    # being sent through libxcb (see Window.create_many)
+    def initialize(connection, screen, options = {}, encoder: nil)
       @connection = connection
       @screen = screen
       @options = DEFAULT_OPTIONS.merge(options)
       @window_id = connection.generate_id
       @graphics_contexts = []
       
-      create_window
+      parent = @options[:parent]
+      @parent_id = parent.respond_to?(:window_id) ? parent.window_id : (parent || screen.root_window)
+      
+      create_window(encoder)
       connection.send(:register_resource, self)
+      connection.send(:track_window, self)
+      connection.tracked_window(@parent_id)&.send(:child_added, @window_id)
+    end
+    
+    # Parent the window was created in (parent reads the live tree)
+    attr_reader :parent_id
+    
+    def drawable_id
+      @window_id
+    end
+    
+    # === GEOMETRY AND TREE ===
+    # Loaded once (see Window.load_info), then kept current by
+    # ConfigureNotify/MapNotify/UnmapNotify/ReparentNotify, so reading
+    # these is free after the first call (map_state excepted)
+    
+    def info
+      Window.load_info([self]) unless @info || @destroyed
+      @info
+    end
+    
+    def info_loaded?
+      !@info.nil?
+    end
+    
+    # Drop the cache; the next read queries the server again
+    def refresh_info
+      @info = nil
+      self
+    end
+    
+    def x
+      info ? @info.x : @options[:x]
+    end
+    
+    def y
+      info ? @info.y : @options[:y]
+    end
+    
+    def width
+      info ? @info.width : @options[:width]
+    end
+    
+    def height
+      info ? @info.height : @options[:height]
+    end
+    
+    def border_width
+      info ? @info.border_width : @options[:border_width]
+    end
+    
+    def depth
+      info ? @info.depth : @screen.depth
+    end
+    
+    def parent
+      info&.parent
+    end
+    
+    def children
+      info ? @info.children : []
+    end
+    
+    # :unmapped, :unviewable or :viewable. An ancestor being mapped or
+    # unmapped sends no event about this window, so for a mapped window
+    # the answer comes from a GetWindowAttributes round trip
+    def map_state
+      return :unmapped unless mapped?
+      
+      conn = @connection.connection
+      cookie = XCB.xcb_get_window_attributes(conn, @window_id)
+      attributes = @connection.wait_for_reply("GetWindowAttributes", 3) { XCB.xcb_get_window_attributes_reply(conn, cookie, nil) }
+      return :unmapped if attributes.null?
+      
+      begin
+        MAP_STATES[attributes.get_uint8(26)]
+      ensure
+        XCB::LibC.free(attributes)
+      end
+    end
+    
+    # Whether the window itself is mapped (cached, no round trip)
+    def mapped?
+      info ? @info.mapped : false
+    end
+    
+    def viewable?
+      map_state == :viewable
+    end
+    
+    def destroyed?
+      @destroyed == true
+    end
+    
+    # Apply a structure event about this window (called by the
+    # connection for every event it reads)
+    def update_from_event(event)
+      case event.type
+      when :configure_notify
+        x, y, width, height, border_width = event.geometry
+        @options = @options.merge(x: x, y: y, width: width, height: height, border_width: border_width)
+        @info&.tap do |info|
+          info.x, info.y, info.width, info.height, info.border_width = x, y, width, height, border_width
+          info.override_redirect = event.override_redirect?
+        end
+      when :map_notify
+        @info.mapped = true if @info
+      when :unmap_notify
+        @info.mapped = false if @info
+      when :reparent_notify
+        @connection.tracked_window(@info.parent)&.send(:child_removed, @window_id) if @info
+        @connection.tracked_window(event.parent)&.send(:child_added, @window_id)
+        if @info
+          @info.parent = event.parent
+          @info.x, @info.y = event.geometry
+        end
+      when :destroy_notify
+        @connection.tracked_window(@info.parent)&.send(:child_removed, @window_id) if @info
+        @destroyed = true
+        @connection.send(:untrack_window, self)
+      end
+      self
     end
     
     # Window management
@@ -32,6 +229,18 @@ module XCB
     end
     alias_method :map, :show
     
+    # Map all unmapped children with one MapSubwindows request
+    def map_subwindows
+      XCB.xcb_map_subwindows(@connection.connection, @window_id)
+      @connection.flush
+      self
+    end
+    
+    # Bulk child creation (see Window.create_many)
+    def create_children(specs, map: false)
+      Window.create_many(@connection, @screen, specs, parent: self, map: map)
+    end
+    
     def hide
       XCB.xcb_unmap_window(@connection.connection, @window_id)
       @connection.flush
@@ -47,48 +256,82 @@ module XCB
       configure(width: width, height: height)
     end
     
-    def configure(options = {})
-      mask = 0
-      values = []
-      
-      if options[:x]
-        mask |= 1  # XCB_CONFIG_WINDOW_X
-        values << options[:x]
-      end
-      
-      if options[:y]
-        mask |= 2  # XCB_CONFIG_WINDOW_Y
-        values << options[:y]
+    # Values go straight into the connection's scratch arena
+    def configure(options = nil, x: nil, y: nil, width: nil, height: nil)
+      if options
+        x ||= options[:x]
+        y ||= options[:y]
+        width ||= options[:width]
+        height ||= options[:height]
       end
       
-      if options[:width]
-        mask |= 4  # XCB_CONFIG_WINDOW_WIDTH
-        values << options[:width]
-      end
+      values = @connection.scratch.value_list
+      values.set(1, x) if x           # XCB_CONFIG_WINDOW_X
+      values.set(2, y) if y           # XCB_CONFIG_WINDOW_Y
+      values.set(4, width) if width   # XCB_CONFIG_WINDOW_WIDTH
+      values.set(8, height) if height # XCB_CONFIG_WINDOW_HEIGHT
+      return self if values.empty?
       
-      if options[:height]
-        mask |= 8  # XCB_CONFIG_WINDOW_HEIGHT
-        values << options[:height]
-      end
+      XCB.xcb_configure_window(@connection.connection, @window_id, values.mask, values.pointer)
+      @connection.flush
       
-      if values.any?
-        values_ptr = FFI::MemoryPointer.new(:uint32, values.size)
-        values.each_with_index { |val, i| values_ptr[i].write_uint32(val) }
-        
-        XCB.xcb_configure_window(@connection.connection, @window_id, mask, values_ptr)
-        @connection.flush
+      # The window manager may override this; ConfigureNotify corrects it
+      @options[:x] = x if x
+      @options[:y] = y if y
+      @options[:width] = width if width
+      @options[:height] = height if height
+      if @info
+        @info.x = x if x
+        @info.y = y if y
+        @info.width = width if width
+        @info.height = height if height
       end
-      
       self
     end
     
     def set_cursor(cursor)
       cursor_id = cursor.respond_to?(:cursor_id) ? cursor.cursor_id : cursor
-      cursor_vals = FFI::MemoryPointer.new(:uint32, 1)
-      cursor_vals.write(:uint32, cursor_id)
-      
-      XCB.xcb_change_window_attributes(@connection.connection, @window_id, 
-                                       XCB::XCB_CW_CURSOR, cursor_vals)
+      XCB.xcb_change_window_attributes(@connection.connection, @window_id,
+                                       XCB::XCB_CW_CURSOR, @connection.scratch.uint32(cursor_id))
+      @connection.flush
+      self
+    end
+    
+    # Select more events after creation (e.g. :property_change)
+    def add_events(*events)
+      @options = @options.merge(events: (Array(@options[:events]) + events).uniq)
+      XCB.xcb_change_window_attributes(@connection.connection, @window_id, XCB::XCB_CW_EVENT_MASK,
+                                       @connection.scratch.uint32(event_mask(@options[:events])))
+      @connection.flush
+      self
+    end
+    
+    # === PROPERTIES ===
+    # property and type are atom ids or names
+    
+    def property_info(property)
+      Property.info(@connection, @window_id, atom_for(property))
+    end
+    
+    # Enumerator over chunks of a property value (see Property.chunks)
+    def property_chunks(property, **options)
+      options[:type] = atom_for(options[:type]) if options[:type]
+      Property.chunks(@connection, @window_id, atom_for(property), **options)
+    end
+    
+    def read_property(property, **options)
+      options[:type] = atom_for(options[:type]) if options[:type]
+      Property.read(@connection, @window_id, atom_for(property), **options)
+    end
+    
+    def write_property(property, type, data, format: 8, mode: XCB::XCB_PROP_MODE_REPLACE)
+      Property.write(@connection, @window_id, atom_for(property), atom_for(type), data, format: format, mode: mode)
+      @connection.flush
+      self
+    end
+    
+    def delete_property(property)
+      Property.delete(@connection, @window_id, atom_for(property))
       @connection.flush
       self
     end
@@ -102,8 +345,33 @@ module XCB
     
     # Graphics operations
     def clear(color = :white)
-      XCB.xcb_clear_area(@connection.connection, 0, @window_id, 0, 0, 
-                         @options[:width], @options[:height])
+      XCB.xcb_clear_area(@connection.connection, 0, @window_id, 0, 0, width, height)
+      @connection.flush
+      self
+    end
+    
+    # Show a pixmap with the Present extension (require 'xcb_present').
+    # target_msc 0 presents at the next vblank; divisor/remainder pick the
+    # first MSC after target_msc with msc % divisor == remainder
+    def present_pixmap(pixmap, serial: 0, target_msc: 0, divisor: 0, remainder: 0,
+                       options: 0, x_off: 0, y_off: 0)
+      raise XCBError, "Present bindings are not loaded (require 'xcb_present')" unless defined?(Present)
+      
+      @connection.require_extension(Present::ID, "Present")
+      pixmap_id = pixmap.respond_to?(:drawable_id) ? pixmap.drawable_id : pixmap
+      Present.xcb_present_pixmap(@connection.connection, @window_id, pixmap_id, serial,
+                                 XCB_NONE, XCB_NONE, x_off, y_off, XCB_NONE, XCB_NONE, XCB_NONE,
+                                 options, target_msc, divisor, remainder, 0, nil)
+      self
+    end
+    
+    # Window shape (kind :bounding, :clip or :input) from an XFixes region
+    # (require 'xcb/region'); nil resets it to the plain rectangle
+    def set_shape_region(region, kind: :bounding, x: 0, y: 0)
+      raise XCBError, "Region support is not loaded (require 'xcb/region')" unless defined?(Region)
+      
+      XFixes.xcb_xfixes_set_window_shape_region(@connection.connection, @window_id, Region.shape_kind(kind),
+                                                x, y, region ? region.region_id : XCB_NONE)
       @connection.flush
       self
     end
@@ -131,48 +399,76 @@ module XCB
       @graphics_contexts.clear
       
       XCB.xcb_destroy_window(@connection.connection, @window_id) rescue nil
+      @connection.send(:untrack_window, self)
     end
     
     def inspect
-      "#<XCB::Window id=#{@window_id} #{@options[:width]}x#{@options[:height]}>"
+      size = @info ? "#{@info.width}x#{@info.height}" : "#{@options[:width]}x#{@options[:height]}"
+      "#<XCB::Window id=#{@window_id} #{size}>"
     end
     
     private
     
-    def create_window
-      # Prepare values
-      mask = 0
-      values = []
+    def watch_structure
+      add_events(:structure_notify) unless Array(@options[:events]).include?(:structure_notify)
+    end
+    
+    def store_info(geometry_cookie, tree_cookie, attributes_cookie)
+      conn = @connection.connection
+      geometry = @connection.wait_for_reply("GetGeometry", 14) { XCB.xcb_get_geometry_reply(conn, geometry_cookie, nil) }
+      tree = @connection.wait_for_reply("QueryTree", 15) { XCB.xcb_query_tree_reply(conn, tree_cookie, nil) }
+      attributes = @connection.wait_for_reply("GetWindowAttributes", 3) { XCB.xcb_get_window_attributes_reply(conn, attributes_cookie, nil) }
       
-      # Background
-      if @options[:background]
-        mask |= XCB::XCB_CW_BACK_PIXEL
-        values << background_pixel(@options[:background])
+      if geometry.null? || tree.null? || attributes.null?
+        # BadWindow: the window is gone
+        @destroyed = true
+        return
       end
       
-      # Events
-      if @options[:events]
-        mask |= XCB::XCB_CW_EVENT_MASK
-        values << event_mask(@options[:events])
-      end
+      x, y, width, height, border_width = geometry.get_bytes(12, 10).unpack('s2S3')
+      children = tree.get_uint16(16)
+      @info = Info.new(x, y, width, height, border_width, geometry.get_uint8(1), geometry.get_uint32(8),
+                       tree.get_uint32(12), children.zero? ? [] : tree.get_array_of_uint32(32, children),
+                       attributes.get_uint8(26) != XCB::XCB_MAP_STATE_UNMAPPED, attributes.get_uint8(27) != 0,
+                       attributes.get_uint32(8), attributes.get_uint16(12))
+    ensure
+      [geometry, tree, attributes].each { |reply| XCB::LibC.free(reply) unless reply.nil? || reply.null? }
+    end
+    
+    def child_added(window_id)
+      @info.children |= [window_id] if @info
+    end
+    
+    def child_removed(window_id)
+      @info.children -= [window_id] if @info
+    end
+    
+    def create_window(encoder = nil)
+      values = @connection.scratch.value_list
+      values.set(XCB::XCB_CW_BACK_PIXEL, background_pixel(@options[:background])) if @options[:background]
+      values.set(XCB::XCB_CW_EVENT_MASK, event_mask(@options[:events])) if @options[:events]
       
-      # Create values array
-      values_ptr = FFI::MemoryPointer.new(:uint32, values.size)
-      values.each_with_index { |val, i| values_ptr[i].write_uint32(val) }
+      if encoder
+        encoder.create_window(XCB::XCB_COPY_FROM_PARENT, @window_id, @parent_id,
+                              @options[:x], @options[:y], @options[:width], @options[:height],
+                              @options[:border_width], window_class_value(@options[:window_class]),
+                              @screen.root_visual, values.mask, values.to_a)
+        return
+      end
       
       # Create window
       XCB.xcb_create_window(
         @connection.connection,
         XCB::XCB_COPY_FROM_PARENT,  # depth
         @window_id,
-        @screen.root_window,
+        @parent_id,
         @options[:x], @options[:y],
         @options[:width], @options[:height],
         @options[:border_width],
         window_class_value(@options[:window_class]),
         @screen.root_visual,
-        mask,
-        values_ptr
+        values.mask,
+        values.pointer
       )
     end
     
@@ -199,15 +495,22 @@ module XCB
         mask |= case event
                 when :exposure then XCB::XCB_EVENT_MASK_EXPOSURE
                 when :key_press then XCB::XCB_EVENT_MASK_KEY_PRESS
+                when :key_release then XCB::XCB_EVENT_MASK_KEY_RELEASE
                 when :button_press then XCB::XCB_EVENT_MASK_BUTTON_PRESS
                 when :button_release then XCB::XCB_EVENT_MASK_BUTTON_RELEASE
                 when :motion_notify then XCB::XCB_EVENT_MASK_POINTER_MOTION
+                when :structure_notify then XCB::XCB_EVENT_MASK_STRUCTURE_NOTIFY
+                when :property_change then XCB::XCB_EVENT_MASK_PROPERTY_CHANGE
                 else 0
                 end
       end
       mask
     end
     
+    def atom_for(atom)
+      atom.is_a?(Integer) ? atom : @connection.atom(atom)
+    end
+    
     def belongs_to_window?(event)
       # Simplified - в реальной реализации нужно проверять window ID в событии
       true
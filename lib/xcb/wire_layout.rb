@@ -0,0 +1,25 @@
+module XCB
+  module Proto
+    class << self
+      # Fixed wire offset of a field that hand-written code reads, e.g.
+      #   Proto.wire_offset("Damage::NotifyEvent", :damage, 8)
+      # Returns offset unchanged; the lookup is only recorded so that
+      # test/proto_test.rb can check it against the generated struct
+      def wire_offset(path, field, offset)
+        wire_layout << [path, field, offset]
+        offset
+      end
+      
+      # Size of the fixed part of a struct (where its lists start)
+      def wire_size(path, size)
+        wire_layout << [path, nil, size]
+        size
+      end
+      
+      # [path, field (nil: size), value] of every offset declared so far
+      def wire_layout
+        @wire_layout ||= []
+      end
+    end
+  end
+end
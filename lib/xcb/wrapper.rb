@@ -1,11 +1,21 @@
 # High-level Ruby wrapper for XCB
+require_relative 'scratch_arena'
+require_relative 'tracer'
 require_relative 'connection'
 require_relative 'screen'
+require_relative 'capture'
 require_relative 'window'
 require_relative 'graphics_context'
 require_relative 'font'
 require_relative 'cursor'
 require_relative 'event'
+require_relative 'keymap'
+require_relative 'request_encoder'
+require_relative 'text'
+require_relative 'property'
+require_relative 'selection'
+require_relative 'list_view'
+require_relative 'display_pool'
 
 module XCB
   # Convenience class methods for common operations
@@ -57,13 +67,19 @@ module XCB
       @connection = connection
       @screen = connection.default_screen
       @windows = []
+      @windows_by_id = {}
       @running = false
     end
     
     def create_window(options = {})
       window = @screen.create_window(options)
-      @windows << window
-      window
+      add_window(window)
+    end
+    
+    # Many windows with one flush (see Window.create_many); all of them
+    # are dispatched to like create_window's
+    def create_windows(specs, map: false)
+      @screen.create_windows(specs, map: map).each { |window| add_window(window) }
     end
     
     def create_font(name)
@@ -81,16 +97,18 @@ module XCB
         event = @connection.wait_for_event
         next unless event
         
+        tracer = @connection.tracer
+        started = tracer.now if tracer
+        
         # Dispatch event to appropriate window
         window = find_window_for_event(event)
         
-        if block_given?
-          result = block.call(event, window)
-          break if result == :quit
-        end
+        result = block.call(event, window) if block_given?
         
         # Default event handling
-        handle_default_events(event, window)
+        handle_default_events(event, window) unless result == :quit
+        tracer.complete("dispatch", :event, started, event_args(event)) if tracer
+        break if result == :quit
       end
     end
     
@@ -104,7 +122,21 @@ module XCB
       window_id = event.window_id
       return nil unless window_id
       
-      @windows.find { |w| w.window_id == window_id }
+      @windows_by_id[window_id]
+    end
+    
+    def add_window(window)
+      @windows << window
+      @windows_by_id[window.window_id] = window
+      window
+    end
+    
+    # Trace arguments of a dispatch span
+    def event_args(event)
+      args = { type: event.type }
+      args[:opcode] = event.extension_opcode if event.generic?
+      args[:window] = event.window_id if event.window_id
+      args
     end
     
     def handle_default_events(event, window)
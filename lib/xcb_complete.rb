@@ -1,7 +1,12 @@
 require 'ffi'
+require_relative 'xcb/lazy_binding'
+
+started = XCB::LazyBinding.clock
 
 module XCB
   extend FFI::Library
+  # Функции привязываются при первом вызове (см. xcb/lazy_binding.rb)
+  extend LazyBinding
   
   # Загружаем библиотеку libxcb
   ffi_lib 'xcb'
@@ -88,6 +93,12 @@ module XCB
            :y, :int16                  # Y координата
   end
   
+  # Структура iovec для xcb_writev
+  class Iovec < FFI::Struct
+    layout :base, :pointer,            # Указатель на данные
+           :len, :size_t               # Длина данных
+  end
+  
   # Константы XCB
   X_PROTOCOL = 11                      # Версия протокола X
   X_PROTOCOL_REVISION = 0              # Ревизия протокола
@@ -114,30 +125,88 @@ module XCB
   # Константы событий
   XCB_EVENT_MASK_EXPOSURE = 0x00008000 # Exposure events
   XCB_EVENT_MASK_KEY_PRESS = 0x00000001 # Key press events
+  XCB_EVENT_MASK_KEY_RELEASE = 0x00000002 # Key release events
   XCB_EVENT_MASK_BUTTON_PRESS = 0x00000004 # Button press events
   XCB_EVENT_MASK_BUTTON_RELEASE = 0x00000008 # Button release events
   XCB_EVENT_MASK_POINTER_MOTION = 0x00000040 # Pointer motion events
   XCB_EVENT_MASK_STRUCTURE_NOTIFY = 0x00002000 # Structure notify events
+  XCB_EVENT_MASK_PROPERTY_CHANGE = 0x00400000 # Property change events
+  
+  # Состояние отображения окна (GetWindowAttributes map_state)
+  XCB_MAP_STATE_UNMAPPED = 0
+  XCB_MAP_STATE_UNVIEWABLE = 1
+  XCB_MAP_STATE_VIEWABLE = 2
+  
+  # Поле request события MappingNotify
+  XCB_MAPPING_MODIFIER = 0
+  XCB_MAPPING_KEYBOARD = 1
+  XCB_MAPPING_POINTER = 2
+  
+  # Биты модификаторов в поле state событий клавиш и кнопок
+  XCB_MOD_MASK_SHIFT = 0x0001
+  XCB_MOD_MASK_LOCK = 0x0002
+  XCB_MOD_MASK_CONTROL = 0x0004
+  XCB_MOD_MASK_1 = 0x0008             # Alt on most layouts
   
   # Константы типов событий
   XCB_EXPOSE = 12                      # Expose event
+  XCB_GRAPHICS_EXPOSURE = 13           # Graphics exposure event
+  XCB_NO_EXPOSURE = 14                 # No exposure event
+  XCB_DESTROY_NOTIFY = 17              # Destroy notify event
+  XCB_UNMAP_NOTIFY = 18                # Unmap notify event
+  XCB_MAP_NOTIFY = 19                  # Map notify event
+  XCB_REPARENT_NOTIFY = 21             # Reparent notify event
+  XCB_CONFIGURE_NOTIFY = 22            # Configure notify event
+  XCB_PROPERTY_NOTIFY = 28             # Property notify event
+  XCB_SELECTION_CLEAR = 29             # Selection clear event
+  XCB_SELECTION_REQUEST = 30           # Selection request event
+  XCB_SELECTION_NOTIFY = 31            # Selection notify event
+  XCB_CLIENT_MESSAGE = 33              # Client message event
+  XCB_MAPPING_NOTIFY = 34              # Keyboard/pointer mapping changed
+  XCB_GE_GENERIC = 35                  # Generic event (XGE, события расширений)
   XCB_KEY_PRESS = 2                    # Key press event
   XCB_BUTTON_PRESS = 4                 # Button press event
   
   # Константы для линий
   XCB_COORD_MODE_ORIGIN = 0            # Coordinate mode
   
+  # Константы для изображений
+  XCB_IMAGE_FORMAT_XY_BITMAP = 0       # XY bitmap format
+  XCB_IMAGE_FORMAT_XY_PIXMAP = 1       # XY pixmap format
+  XCB_IMAGE_FORMAT_Z_PIXMAP = 2        # Z pixmap format
+  
   # Константы для захвата
   XCB_GRAB_MODE_SYNC = 0               # Synchronous grab
   XCB_GRAB_MODE_ASYNC = 1              # Asynchronous grab
   XCB_NONE = 0                         # None value
   XCB_CURRENT_TIME = 0                 # Current time
   
+  # Константы для свойств
+  XCB_PROP_MODE_REPLACE = 0            # Replace property value
+  XCB_PROP_MODE_PREPEND = 1            # Prepend to property value
+  XCB_PROP_MODE_APPEND = 2             # Append to property value
+  XCB_PROPERTY_NEW_VALUE = 0           # PropertyNotify state: new value
+  XCB_PROPERTY_DELETE = 1              # PropertyNotify state: deleted
+  XCB_GET_PROPERTY_TYPE_ANY = 0        # Any property type
+  XCB_ATOM_ATOM = 4                    # Predefined ATOM atom
+  XCB_ATOM_INTEGER = 19                # Predefined INTEGER atom
+  XCB_ATOM_STRING = 31                 # Predefined STRING atom
+  
   # Константы для графического контекста
   XCB_GC_FOREGROUND = 0x00000004      # Foreground pixel
   XCB_GC_BACKGROUND = 0x00000008      # Background pixel
   XCB_GC_LINE_WIDTH = 0x00000010      # Line width
   XCB_GC_FONT = 0x00004000            # Font
+  XCB_GC_GRAPHICS_EXPOSURES = 0x00010000 # Graphics exposures
+  XCB_GC_CLIP_ORIGIN_X = 0x00020000   # Clip mask origin X
+  XCB_GC_CLIP_ORIGIN_Y = 0x00040000   # Clip mask origin Y
+  XCB_GC_CLIP_MASK = 0x00080000       # Clip mask pixmap (depth 1)
+  
+  # Порядок прямоугольников SetClipRectangles (подсказка серверу)
+  XCB_CLIP_ORDERING_UNSORTED = 0
+  XCB_CLIP_ORDERING_Y_SORTED = 1
+  XCB_CLIP_ORDERING_YX_SORTED = 2
+  XCB_CLIP_ORDERING_YX_BANDED = 3
   
   # === ФУНКЦИИ ПОДКЛЮЧЕНИЯ ===
   
@@ -188,21 +257,33 @@ module XCB
   attach_function :xcb_destroy_window, [:pointer, :uint32], VoidCookie
   # Показ окна
   attach_function :xcb_map_window, [:pointer, :uint32], VoidCookie
+  # Показ всех непоказанных дочерних окон одним запросом
+  attach_function :xcb_map_subwindows, [:pointer, :uint32], VoidCookie
   # Скрытие окна
   attach_function :xcb_unmap_window, [:pointer, :uint32], VoidCookie
+  # Перенос окна к другому родителю
+  attach_function :xcb_reparent_window, [:pointer, :uint32, :uint32, :int16, :int16], VoidCookie
   # Настройка окна
   attach_function :xcb_configure_window, [:pointer, :uint32, :uint16, :pointer], VoidCookie
   # Изменение атрибутов окна
   attach_function :xcb_change_window_attributes, [:pointer, :uint32, :uint32, :pointer], VoidCookie
   # Получение геометрии окна
-  attach_function :xcb_get_geometry, [:pointer, :uint32], VoidCookie
+  attach_function :xcb_get_geometry, [:pointer, :uint32], :uint32
   # Получение ответа геометрии
   attach_function :xcb_get_geometry_reply, [:pointer, :uint32, :pointer], :pointer
+  # Родитель и дочерние окна
+  attach_function :xcb_query_tree, [:pointer, :uint32], :uint32
+  # Получение ответа дерева окон
+  attach_function :xcb_query_tree_reply, [:pointer, :uint32, :pointer], :pointer
+  # Получение атрибутов окна
+  attach_function :xcb_get_window_attributes, [:pointer, :uint32], :uint32
+  # Получение ответа атрибутов окна
+  attach_function :xcb_get_window_attributes_reply, [:pointer, :uint32, :pointer], :pointer
   
   # === ФУНКЦИИ СВОЙСТВ ===
   
   # Интернирование атома
-  attach_function :xcb_intern_atom, [:pointer, :uint8, :uint16, :string], VoidCookie
+  attach_function :xcb_intern_atom, [:pointer, :uint8, :uint16, :string], :uint32
   # Получение ответа интернирования атома
   attach_function :xcb_intern_atom_reply, [:pointer, :uint32, :pointer], :pointer
   # Изменение свойства окна
@@ -211,6 +292,19 @@ module XCB
   attach_function :xcb_get_property, [:pointer, :uint8, :uint32, :uint32, :uint32, :uint32, :uint32], :uint32
   # Получение ответа свойства
   attach_function :xcb_get_property_reply, [:pointer, :uint32, :pointer], :pointer
+  # Удаление свойства окна
+  attach_function :xcb_delete_property, [:pointer, :uint32, :uint32], VoidCookie
+  
+  # === ФУНКЦИИ ВЫДЕЛЕНИЯ (SELECTION) ===
+  
+  # Установка владельца выделения
+  attach_function :xcb_set_selection_owner, [:pointer, :uint32, :uint32, :uint32], VoidCookie
+  # Запрос владельца выделения
+  attach_function :xcb_get_selection_owner, [:pointer, :uint32], :uint32
+  # Получение ответа владельца выделения
+  attach_function :xcb_get_selection_owner_reply, [:pointer, :uint32, :pointer], :pointer
+  # Запрос преобразования выделения в свойство окна
+  attach_function :xcb_convert_selection, [:pointer, :uint32, :uint32, :uint32, :uint32, :uint32], VoidCookie
   
   # === ФУНКЦИИ ГРАФИЧЕСКОГО КОНТЕКСТА ===
   
@@ -220,6 +314,8 @@ module XCB
   attach_function :xcb_free_gc, [:pointer, :uint32], VoidCookie
   # Изменение графического контекста
   attach_function :xcb_change_gc, [:pointer, :uint32, :uint32, :pointer], VoidCookie
+  # Область отсечения из прямоугольников
+  attach_function :xcb_set_clip_rectangles, [:pointer, :uint8, :uint32, :int16, :int16, :uint32, :pointer], VoidCookie
   
   # === ФУНКЦИИ РИСОВАНИЯ ===
   
@@ -237,6 +333,18 @@ module XCB
   attach_function :xcb_poly_fill_rectangle, [:pointer, :uint32, :uint32, :uint32, :pointer], VoidCookie
   # Вывод текста
   attach_function :xcb_image_text_8, [:pointer, :uint8, :uint32, :uint32, :int16, :int16, :string], VoidCookie
+  # Вывод текста 16-битными символами (CHAR2B)
+  attach_function :xcb_image_text_16, [:pointer, :uint8, :uint32, :uint32, :int16, :int16, :pointer], VoidCookie
+  # Вывод нескольких строк текста одним запросом
+  attach_function :xcb_poly_text_8, [:pointer, :uint32, :uint32, :int16, :int16, :uint32, :pointer], VoidCookie
+  # Вывод нескольких строк текста 16-битными символами
+  attach_function :xcb_poly_text_16, [:pointer, :uint32, :uint32, :int16, :int16, :uint32, :pointer], VoidCookie
+  # Загрузка изображения
+  attach_function :xcb_put_image, [:pointer, :uint8, :uint32, :uint32, :uint16, :uint16, :int16, :int16, :uint8, :uint8, :uint32, :pointer], VoidCookie
+  # Чтение изображения из drawable
+  attach_function :xcb_get_image, [:pointer, :uint8, :uint32, :int16, :int16, :uint16, :uint16, :uint32], :uint32
+  # Получение ответа с пикселями
+  attach_function :xcb_get_image_reply, [:pointer, :uint32, :pointer], :pointer
   
   # === ФУНКЦИИ ПИКСМАПОВ ===
   
@@ -297,10 +405,20 @@ module XCB
   attach_function :xcb_grab_keyboard_reply, [:pointer, :uint32, :pointer], :pointer
   # Освобождение клавиатуры
   attach_function :xcb_ungrab_keyboard, [:pointer], VoidCookie
+  # Запрос фокуса ввода
+  attach_function :xcb_get_input_focus, [:pointer], :uint32
+  # Получение ответа фокуса ввода
+  attach_function :xcb_get_input_focus_reply, [:pointer, :uint32, :pointer], :pointer
+  # Отправка события окну
+  attach_function :xcb_send_event, [:pointer, :uint8, :uint32, :uint32, :pointer], VoidCookie
   # Захват клавиши
   attach_function :xcb_grab_key, [:pointer, :uint8, :uint32, :uint32, :uint16, :uint16, :uint32, :uint32], VoidCookie
   # Освобождение клавиши
   attach_function :xcb_ungrab_key, [:pointer, :uint32, :uint32, :uint16, :uint16], VoidCookie
+  # Запрос таблицы keycode -> keysym для диапазона кодов клавиш
+  attach_function :xcb_get_keyboard_mapping, [:pointer, :uint8, :uint8], :uint32
+  # Получение ответа таблицы клавиатуры
+  attach_function :xcb_get_keyboard_mapping_reply, [:pointer, :uint32, :pointer], :pointer
   
   # === ФУНКЦИИ ЭКРАНА ===
   
@@ -318,7 +436,7 @@ module XCB
   # Получение ответа расширения
   attach_function :xcb_query_extension_reply, [:pointer, :uint32, :pointer], :pointer
   # Список расширений
-  attach_function :xcb_list_extensions, [:pointer], VoidCookie
+  attach_function :xcb_list_extensions, [:pointer], :uint32
   # Получение ответа списка расширений
   attach_function :xcb_list_extensions_reply, [:pointer, :uint32, :pointer], :pointer
   
@@ -401,6 +519,17 @@ module XCB
   # Сумма элементов
   attach_function :xcb_sumof, [:pointer, :int], :int
   
+  # === ФУНКЦИИ LIBC ===
+  
+  # Освобождение памяти ответов и событий, выделенной libxcb
+  module LibC
+    extend FFI::Library
+    ffi_lib FFI::Library::LIBC
+    
+    # Освобождение памяти
+    attach_function :free, [:pointer], :void
+  end
+  
   # === ТИПЫ УКАЗАТЕЛЕЙ ===
   
   typedef :pointer, :xcb_connection_t
@@ -443,4 +572,6 @@ module XCB
   typedef :pointer, :xcb_coloritem_t
   typedef :pointer, :xcb_host_t
   typedef :pointer, :xcb_client_message_data_t
-end 
\ No newline at end of file
+end
+
+XCB::LazyBinding.record_load('xcb_complete', started)
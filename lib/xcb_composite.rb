@@ -0,0 +1,38 @@
+require_relative 'xcb_complete'
+
+started = XCB::LazyBinding.clock
+
+module XCB
+  # Привязки к расширению Composite (libxcb-composite)
+  module Composite
+    extend FFI::Library
+    extend LazyBinding
+    
+    ffi_lib 'xcb-composite'
+    
+    # Идентификатор расширения для xcb_get_extension_data
+    ID = ffi_libraries.first.find_variable('xcb_composite_id')
+    
+    # Режим перенаправления: сервер сам рисует окно на экран (AUTOMATIC)
+    # или это делает композитный менеджер (MANUAL)
+    REDIRECT_AUTOMATIC = 0
+    REDIRECT_MANUAL = 1
+    
+    # Запрос версии Composite (обязателен до остальных запросов)
+    attach_function :xcb_composite_query_version, [:pointer, :uint32, :uint32], :uint32
+    # Получение ответа версии
+    attach_function :xcb_composite_query_version_reply, [:pointer, :uint32, :pointer], :pointer
+    # Перенаправление окна во внеэкранный буфер
+    attach_function :xcb_composite_redirect_window, [:pointer, :uint32, :uint8], VoidCookie
+    # Отмена перенаправления окна
+    attach_function :xcb_composite_unredirect_window, [:pointer, :uint32, :uint8], VoidCookie
+    # Перенаправление всех дочерних окон
+    attach_function :xcb_composite_redirect_subwindows, [:pointer, :uint32, :uint8], VoidCookie
+    # Отмена перенаправления дочерних окон
+    attach_function :xcb_composite_unredirect_subwindows, [:pointer, :uint32, :uint8], VoidCookie
+    # Имя (XID пиксмапа) для внеэкранного буфера окна
+    attach_function :xcb_composite_name_window_pixmap, [:pointer, :uint32, :uint32], VoidCookie
+  end
+end
+
+XCB::LazyBinding.record_load('xcb_composite', started)
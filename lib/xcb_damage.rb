@@ -0,0 +1,51 @@
+require_relative 'xcb_complete'
+require_relative 'xcb/wire_layout'
+
+started = XCB::LazyBinding.clock
+
+module XCB
+  # Привязки к расширению DAMAGE (libxcb-damage)
+  module Damage
+    extend FFI::Library
+    extend LazyBinding
+    
+    ffi_lib 'xcb-damage'
+    
+    # Идентификатор расширения для xcb_get_extension_data
+    ID = ffi_libraries.first.find_variable('xcb_damage_id')
+    
+    # Уровень отчётов: каждая область, прямоугольник-оболочка или одно
+    # событие до DamageSubtract (NON_EMPTY)
+    REPORT_LEVEL_RAW_RECTANGLES = 0
+    REPORT_LEVEL_DELTA_RECTANGLES = 1
+    REPORT_LEVEL_BOUNDING_BOX = 2
+    REPORT_LEVEL_NON_EMPTY = 3
+    
+    # Номер события DamageNotify относительно first_event
+    NOTIFY = 0
+    
+    # Смещения полей DamageNotify (сверяются с
+    # XCB::Proto::Damage::NotifyEvent в test/proto_test.rb)
+    NOTIFY_LEVEL = Proto.wire_offset("Damage::NotifyEvent", :level, 1)
+    NOTIFY_DRAWABLE = Proto.wire_offset("Damage::NotifyEvent", :drawable, 4)
+    NOTIFY_DAMAGE = Proto.wire_offset("Damage::NotifyEvent", :damage, 8)
+    NOTIFY_AREA = Proto.wire_offset("Damage::NotifyEvent", :area, 16)           # x, y, width, height изменённой области
+    NOTIFY_GEOMETRY = Proto.wire_offset("Damage::NotifyEvent", :geometry, 24)   # x, y, width, height drawable
+    
+    # Бит «есть ещё события» в поле level
+    NOTIFY_MORE = 0x80
+    
+    # Запрос версии DAMAGE (обязателен до остальных запросов)
+    attach_function :xcb_damage_query_version, [:pointer, :uint32, :uint32], :uint32
+    # Получение ответа версии
+    attach_function :xcb_damage_query_version_reply, [:pointer, :uint32, :pointer], :pointer
+    # Создание объекта отслеживания изменений drawable
+    attach_function :xcb_damage_create, [:pointer, :uint32, :uint32, :uint8], VoidCookie
+    # Удаление объекта отслеживания
+    attach_function :xcb_damage_destroy, [:pointer, :uint32], VoidCookie
+    # Сброс накопленных изменений (repair, parts — регионы XFixes или 0)
+    attach_function :xcb_damage_subtract, [:pointer, :uint32, :uint32, :uint32], VoidCookie
+  end
+end
+
+XCB::LazyBinding.record_load('xcb_damage', started)
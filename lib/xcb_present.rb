@@ -0,0 +1,69 @@
+require_relative 'xcb_complete'
+require_relative 'xcb/wire_layout'
+
+started = XCB::LazyBinding.clock
+
+module XCB
+  # Привязки к расширению Present (libxcb-present)
+  module Present
+    extend FFI::Library
+    extend LazyBinding
+    
+    ffi_lib 'xcb-present'
+    
+    # Идентификатор расширения для xcb_get_extension_data
+    ID = ffi_libraries.first.find_variable('xcb_present_id')
+    
+    # Маски событий (SelectInput)
+    EVENT_MASK_CONFIGURE_NOTIFY = 1
+    EVENT_MASK_COMPLETE_NOTIFY = 2
+    EVENT_MASK_IDLE_NOTIFY = 4
+    
+    # Типы событий внутри GenericEvent (evtype)
+    EVENT_CONFIGURE_NOTIFY = 0
+    EVENT_COMPLETE_NOTIFY = 1
+    EVENT_IDLE_NOTIFY = 2
+    
+    # Вид завершения CompleteNotify
+    COMPLETE_KIND_PIXMAP = 0
+    COMPLETE_KIND_NOTIFY_MSC = 1
+    
+    # Способ показа кадра
+    COMPLETE_MODE_COPY = 0
+    COMPLETE_MODE_FLIP = 1
+    COMPLETE_MODE_SKIP = 2
+    COMPLETE_MODE_SUBOPTIMAL_COPY = 3
+    
+    # Опции PresentPixmap
+    OPTION_NONE = 0
+    OPTION_ASYNC = 1
+    OPTION_COPY = 2
+    OPTION_UST = 4
+    
+    # Смещения полей в событиях (test/proto_test.rb сверяет их со
+    # сгенерированными структурами XCB::Proto::Present)
+    EVENT_EVENT_ID = Proto.wire_offset("Present::CompleteNotifyEvent", :event, 12)
+    EVENT_WINDOW = Proto.wire_offset("Present::CompleteNotifyEvent", :window, 16)
+    EVENT_SERIAL = Proto.wire_offset("Present::CompleteNotifyEvent", :serial, 20)
+    COMPLETE_KIND = Proto.wire_offset("Present::CompleteNotifyEvent", :kind, 10)
+    COMPLETE_MODE = Proto.wire_offset("Present::CompleteNotifyEvent", :mode, 11)
+    COMPLETE_UST = Proto.wire_offset("Present::CompleteNotifyEvent", :ust, 24)
+    COMPLETE_MSC = Proto.wire_offset("Present::CompleteNotifyEvent", :msc, 36)     # после full_sequence
+    IDLE_PIXMAP = Proto.wire_offset("Present::IdleNotifyEvent", :pixmap, 24)
+    
+    # Запрос версии Present
+    attach_function :xcb_present_query_version, [:pointer, :uint32, :uint32], :uint32
+    # Получение ответа версии
+    attach_function :xcb_present_query_version_reply, [:pointer, :uint32, :pointer], :pointer
+    # Подписка окна на события Present
+    attach_function :xcb_present_select_input, [:pointer, :uint32, :uint32, :uint32], VoidCookie
+    # Показ pixmap в окне на заданном MSC
+    attach_function :xcb_present_pixmap, [:pointer, :uint32, :uint32, :uint32, :uint32, :uint32,
+                                           :int16, :int16, :uint32, :uint32, :uint32, :uint32,
+                                           :uint64, :uint64, :uint64, :uint32, :pointer], VoidCookie
+    # Уведомление о достижении MSC (CompleteNotify с kind NOTIFY_MSC)
+    attach_function :xcb_present_notify_msc, [:pointer, :uint32, :uint32, :uint64, :uint64, :uint64], VoidCookie
+  end
+end
+
+XCB::LazyBinding.record_load('xcb_present', started)
@@ -0,0 +1,31 @@
+require_relative 'xcb_complete'
+
+# Bindings generated from xcb-proto (ruby tools/generate_bindings.rb):
+# XCB::Proto for the core protocol, XCB::Proto::Render, ::Shm, ... for
+# extensions. Only the modules that have been generated are loaded
+module XCB
+  module Proto
+    GENERATED_DIR = File.join(__dir__, 'xcb', 'generated')
+    
+    # Generated struct class by path ("Damage::NotifyEvent"), nil when
+    # its module has not been generated or loaded
+    def self.generated_struct(path)
+      path.split('::').reduce(self) do |scope, name|
+        return nil unless scope.const_defined?(name, false)
+        
+        scope.const_get(name, false)
+      end
+    end
+  end
+end
+
+if File.exist?(File.join(XCB::Proto::GENERATED_DIR, 'xproto.rb'))
+  require_relative 'xcb/generated/xproto'
+  Dir[File.join(XCB::Proto::GENERATED_DIR, '*.rb')].sort.each do |path|
+    begin
+      require path
+    rescue LoadError
+      # Extension library (libxcb-<name>) is not installed
+    end
+  end
+end
@@ -0,0 +1,117 @@
+require_relative 'xcb_complete'
+
+started = XCB::LazyBinding.clock
+
+module XCB
+  # Привязки к расширению RENDER (libxcb-render, libxcb-render-util)
+  module Render
+    extend FFI::Library
+    extend LazyBinding
+    
+    ffi_lib 'xcb-render', 'xcb-render-util'
+    
+    # Идентификатор расширения для xcb_get_extension_data
+    ID = ffi_libraries.first.find_variable('xcb_render_id')
+    
+    # Цвет RENDER (16 бит на канал, premultiplied alpha)
+    class Color < FFI::Struct
+      layout :red, :uint16,
+             :green, :uint16,
+             :blue, :uint16,
+             :alpha, :uint16
+    end
+    
+    # Информация о глифе для AddGlyphs
+    class GlyphInfo < FFI::Struct
+      layout :width, :uint16,          # Ширина изображения
+             :height, :uint16,         # Высота изображения
+             :x, :int16,               # Смещение начала по X
+             :y, :int16,               # Смещение начала по Y
+             :x_off, :int16,           # Сдвиг позиции после глифа
+             :y_off, :int16
+    end
+    
+    # Матрица преобразования 3x3 (числа 16.16)
+    class Transform < FFI::Struct
+      layout :matrix11, :int32, :matrix12, :int32, :matrix13, :int32,
+             :matrix21, :int32, :matrix22, :int32, :matrix23, :int32,
+             :matrix31, :int32, :matrix32, :int32, :matrix33, :int32
+    end
+    
+    # Операции композиции
+    PICT_OP_CLEAR = 0
+    PICT_OP_SRC = 1
+    PICT_OP_OVER = 3
+    
+    # Стандартные форматы (xcb_pict_standard_t)
+    PICT_STANDARD_ARGB_32 = 0
+    PICT_STANDARD_RGB_24 = 1
+    PICT_STANDARD_A_8 = 2
+    PICT_STANDARD_A_1 = 4
+    
+    # Атрибуты картинки (CreatePicture / ChangePicture)
+    CP_REPEAT = 0x00000001
+    CP_CLIP_MASK = 0x00000040
+    CP_GRAPHICS_EXPOSURE = 0x00000080
+    CP_COMPONENT_ALPHA = 0x00001000
+    
+    # Значения CP_REPEAT: PAD продлевает крайние пиксели (без швов при
+    # масштабировании соседних картинок)
+    REPEAT_NONE = 0
+    REPEAT_NORMAL = 1
+    REPEAT_PAD = 2
+    REPEAT_REFLECT = 3
+    
+    # Число 16.16 с фиксированной точкой
+    def self.fixed(value)
+      (value * 65536).round
+    end
+    
+    # === ВЕРСИЯ И ФОРМАТЫ ===
+    
+    # Запрос версии RENDER
+    attach_function :xcb_render_query_version, [:pointer, :uint32, :uint32], :uint32
+    # Получение ответа версии
+    attach_function :xcb_render_query_version_reply, [:pointer, :uint32, :pointer], :pointer
+    # Кэшированный список форматов картинок
+    attach_function :xcb_render_util_query_formats, [:pointer], :pointer
+    # Поиск формата для визуала
+    attach_function :xcb_render_util_find_visual_format, [:pointer, :uint32], :pointer
+    # Поиск стандартного формата
+    attach_function :xcb_render_util_find_standard_format, [:pointer, :int], :pointer
+    
+    # === КАРТИНКИ ===
+    
+    # Создание картинки для drawable
+    attach_function :xcb_render_create_picture, [:pointer, :uint32, :uint32, :uint32, :uint32, :pointer], VoidCookie
+    # Изменение атрибутов картинки
+    attach_function :xcb_render_change_picture, [:pointer, :uint32, :uint32, :pointer], VoidCookie
+    # Освобождение картинки
+    attach_function :xcb_render_free_picture, [:pointer, :uint32], VoidCookie
+    # Картинка со сплошной заливкой
+    attach_function :xcb_render_create_solid_fill, [:pointer, :uint32, Color.by_value], VoidCookie
+    # Композиция картинок
+    attach_function :xcb_render_composite, [:pointer, :uint8, :uint32, :uint32, :uint32, :int16, :int16, :int16, :int16, :int16, :int16, :uint16, :uint16], VoidCookie
+    # Заливка прямоугольников
+    attach_function :xcb_render_fill_rectangles, [:pointer, :uint8, :uint32, Color.by_value, :uint32, :pointer], VoidCookie
+    # Матрица преобразования картинки
+    attach_function :xcb_render_set_picture_transform, [:pointer, :uint32, Transform.by_value], VoidCookie
+    # Фильтр масштабирования картинки
+    attach_function :xcb_render_set_picture_filter, [:pointer, :uint32, :uint16, :string, :uint32, :pointer], VoidCookie
+    
+    # === ГЛИФЫ ===
+    
+    # Создание набора глифов
+    attach_function :xcb_render_create_glyph_set, [:pointer, :uint32, :uint32], VoidCookie
+    # Освобождение набора глифов
+    attach_function :xcb_render_free_glyph_set, [:pointer, :uint32], VoidCookie
+    # Загрузка глифов на сервер
+    attach_function :xcb_render_add_glyphs, [:pointer, :uint32, :uint32, :pointer, :pointer, :uint32, :pointer], VoidCookie
+    # Удаление глифов
+    attach_function :xcb_render_free_glyphs, [:pointer, :uint32, :uint32, :pointer], VoidCookie
+    # Вывод глифов с 32-битными индексами
+    attach_function :xcb_render_composite_glyphs_32, [:pointer, :uint8, :uint32, :uint32, :uint32, :uint32, :int16, :int16, :uint32, :pointer], VoidCookie
+  end
+end
+
+XCB::LazyBinding.record_load('xcb_render', started)
@@ -0,0 +1,48 @@
+require_relative 'xcb_complete'
+
+started = XCB::LazyBinding.clock
+
+module XCB
+  # Привязки к расширению MIT-SHM (libxcb-shm) и System V shared memory
+  module Shm
+    extend FFI::Library
+    extend LazyBinding
+    
+    ffi_lib 'xcb-shm', FFI::Library::LIBC
+    
+    # Идентификатор расширения для xcb_get_extension_data
+    ID = ffi_libraries.first.find_variable('xcb_shm_id')
+    
+    # Константы shmget/shmctl
+    IPC_PRIVATE = 0
+    IPC_CREAT = 0o1000
+    IPC_RMID = 0
+    
+    # Смещение поля size в ответе ShmGetImage
+    GET_IMAGE_SIZE = 12
+    
+    # Запрос версии MIT-SHM
+    attach_function :xcb_shm_query_version, [:pointer], :uint32
+    # Получение ответа версии
+    attach_function :xcb_shm_query_version_reply, [:pointer, :uint32, :pointer], :pointer
+    # Подключение сегмента к серверу (с проверкой ошибки)
+    attach_function :xcb_shm_attach_checked, [:pointer, :uint32, :uint32, :uint8], VoidCookie
+    # Отключение сегмента
+    attach_function :xcb_shm_detach, [:pointer, :uint32], VoidCookie
+    # Чтение изображения в сегмент
+    attach_function :xcb_shm_get_image, [:pointer, :uint32, :int16, :int16, :uint16, :uint16, :uint32, :uint8, :uint32, :uint32], :uint32
+    # Получение ответа ShmGetImage
+    attach_function :xcb_shm_get_image_reply, [:pointer, :uint32, :pointer], :pointer
+    
+    # Создание сегмента разделяемой памяти
+    attach_function :shmget, [:int, :size_t, :int], :int
+    # Подключение сегмента к адресному пространству
+    attach_function :shmat, [:int, :pointer, :int], :pointer
+    # Отключение сегмента
+    attach_function :shmdt, [:pointer], :int
+    # Управление сегментом (IPC_RMID)
+    attach_function :shmctl, [:int, :int, :pointer], :int
+  end
+end
+
+XCB::LazyBinding.record_load('xcb_shm', started)
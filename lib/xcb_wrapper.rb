@@ -24,7 +24,7 @@ module XCB
     
     def alloc_color(red, green, blue)
       cookie = XCB.xcb_alloc_color(@connection.connection, @colormap_id, red, green, blue)
-      reply = XCB.xcb_alloc_color_reply(@connection.connection, cookie, nil)
+      reply = @connection.wait_for_reply("AllocColor", 84) { XCB.xcb_alloc_color_reply(@connection.connection, cookie, nil) }
       
       return nil if reply.null?
       
@@ -57,6 +57,8 @@ module XCB
   
   # Pixmap support
   class Pixmap
+    include Capturable
+    
     attr_reader :connection, :pixmap_id, :width, :height, :depth
     
     def initialize(connection, drawable, width, height, depth = nil)
@@ -71,6 +73,14 @@ module XCB
       connection.send(:register_resource, self)
     end
     
+    def screen
+      @connection.default_screen
+    end
+    
+    def drawable_id
+      @pixmap_id
+    end
+    
     def create_graphics_context(options = {})
       GraphicsContext.new(@connection, self, options)
     end
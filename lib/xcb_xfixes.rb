@@ -0,0 +1,60 @@
+require_relative 'xcb_complete'
+require_relative 'xcb/wire_layout'
+
+started = XCB::LazyBinding.clock
+
+module XCB
+  # Привязки к расширению XFixes (libxcb-xfixes): серверные регионы
+  module XFixes
+    extend FFI::Library
+    extend LazyBinding
+    
+    ffi_lib 'xcb-xfixes'
+    
+    # Идентификатор расширения для xcb_get_extension_data
+    ID = ffi_libraries.first.find_variable('xcb_xfixes_id')
+    
+    # Смещения в ответе FetchRegion: оболочка и массив прямоугольников
+    # (их число — length / 2), как в XCB::Proto::Xfixes::FetchRegionReply
+    FETCH_REGION_EXTENTS = Proto.wire_offset("Xfixes::FetchRegionReply", :extents, 8)
+    FETCH_REGION_RECTANGLES = Proto.wire_size("Xfixes::FetchRegionReply", 32)
+    
+    # Вид формы окна для SetWindowShapeRegion (константы SHAPE)
+    SHAPE_BOUNDING = 0
+    SHAPE_CLIP = 1
+    SHAPE_INPUT = 2
+    
+    # Запрос версии XFixes (обязателен до остальных запросов)
+    attach_function :xcb_xfixes_query_version, [:pointer, :uint32, :uint32], :uint32
+    # Получение ответа версии
+    attach_function :xcb_xfixes_query_version_reply, [:pointer, :uint32, :pointer], :pointer
+    # Создание региона из прямоугольников
+    attach_function :xcb_xfixes_create_region, [:pointer, :uint32, :uint32, :pointer], VoidCookie
+    # Удаление региона
+    attach_function :xcb_xfixes_destroy_region, [:pointer, :uint32], VoidCookie
+    # Замена содержимого региона
+    attach_function :xcb_xfixes_set_region, [:pointer, :uint32, :uint32, :pointer], VoidCookie
+    # Регион из формы окна
+    attach_function :xcb_xfixes_create_region_from_window, [:pointer, :uint32, :uint32, :uint8], VoidCookie
+    # Копирование региона
+    attach_function :xcb_xfixes_copy_region, [:pointer, :uint32, :uint32], VoidCookie
+    # Объединение регионов (результат в destination)
+    attach_function :xcb_xfixes_union_region, [:pointer, :uint32, :uint32, :uint32], VoidCookie
+    # Пересечение регионов
+    attach_function :xcb_xfixes_intersect_region, [:pointer, :uint32, :uint32, :uint32], VoidCookie
+    # Разность регионов
+    attach_function :xcb_xfixes_subtract_region, [:pointer, :uint32, :uint32, :uint32], VoidCookie
+    # Сдвиг региона
+    attach_function :xcb_xfixes_translate_region, [:pointer, :uint32, :int16, :int16], VoidCookie
+    # Область отсечения графического контекста из региона
+    attach_function :xcb_xfixes_set_gc_clip_region, [:pointer, :uint32, :uint32, :int16, :int16], VoidCookie
+    # Форма окна из региона
+    attach_function :xcb_xfixes_set_window_shape_region, [:pointer, :uint32, :uint8, :int16, :int16, :uint32], VoidCookie
+    # Запрос прямоугольников региона
+    attach_function :xcb_xfixes_fetch_region, [:pointer, :uint32], :uint32
+    # Получение ответа FetchRegion
+    attach_function :xcb_xfixes_fetch_region_reply, [:pointer, :uint32, :pointer], :pointer
+  end
+end
+
+XCB::LazyBinding.record_load('xcb_xfixes', started)
@@ -0,0 +1,59 @@
+require_relative 'xcb_complete'
+require_relative 'xcb/wire_layout'
+
+started = XCB::LazyBinding.clock
+
+module XCB
+  # Привязки к расширению XInput 2 (libxcb-xinput)
+  module XInput
+    extend FFI::Library
+    extend LazyBinding
+    
+    ffi_lib 'xcb-xinput'
+    
+    # Идентификатор расширения для xcb_get_extension_data
+    ID = ffi_libraries.first.find_variable('xcb_input_id')
+    
+    # Специальные идентификаторы устройств
+    DEVICE_ALL = 0
+    DEVICE_ALL_MASTER = 1
+    
+    # Типы событий XI2 (evtype внутри GenericEvent)
+    EVENT_BUTTON_PRESS = 4
+    EVENT_BUTTON_RELEASE = 5
+    EVENT_MOTION = 6
+    EVENT_RAW_BUTTON_PRESS = 15
+    EVENT_RAW_BUTTON_RELEASE = 16
+    EVENT_RAW_MOTION = 17
+    
+    # Смещения полей событий устройства (сверяются со сгенерированной
+    # структурой XCB::Proto::Xinput::ButtonPressEvent в test/proto_test.rb)
+    DEVICE_ID = Proto.wire_offset("Xinput::ButtonPressEvent", :deviceid, 10)
+    TIME = Proto.wire_offset("Xinput::ButtonPressEvent", :time, 12)
+    DETAIL = Proto.wire_offset("Xinput::ButtonPressEvent", :detail, 16)
+    ROOT = Proto.wire_offset("Xinput::ButtonPressEvent", :root, 20)
+    EVENT_WINDOW = Proto.wire_offset("Xinput::ButtonPressEvent", :event, 24)
+    ROOT_X = Proto.wire_offset("Xinput::ButtonPressEvent", :root_x, 36)          # FP1616
+    ROOT_Y = Proto.wire_offset("Xinput::ButtonPressEvent", :root_y, 40)
+    EVENT_X = Proto.wire_offset("Xinput::ButtonPressEvent", :event_x, 44)
+    EVENT_Y = Proto.wire_offset("Xinput::ButtonPressEvent", :event_y, 48)
+    SOURCE_ID = Proto.wire_offset("Xinput::ButtonPressEvent", :sourceid, 56)
+    FLAGS = Proto.wire_offset("Xinput::ButtonPressEvent", :flags, 60)
+    
+    # Смещения полей сырых событий (XCB::Proto::Xinput::RawButtonPressEvent)
+    RAW_SOURCE_ID = Proto.wire_offset("Xinput::RawButtonPressEvent", :sourceid, 20)
+    RAW_VALUATORS_LEN = Proto.wire_offset("Xinput::RawButtonPressEvent", :valuators_len, 22)
+    RAW_FLAGS = Proto.wire_offset("Xinput::RawButtonPressEvent", :flags, 24)
+    # uint32[valuators_len], затем FP3232 значения
+    RAW_VALUATOR_MASK = Proto.wire_size("Xinput::RawButtonPressEvent", 36)
+    
+    # Запрос версии XI2
+    attach_function :xcb_input_xi_query_version, [:pointer, :uint16, :uint16], :uint32
+    # Получение ответа версии
+    attach_function :xcb_input_xi_query_version_reply, [:pointer, :uint32, :pointer], :pointer
+    # Выбор событий XI2 для окна (маски xcb_input_event_mask_t подряд)
+    attach_function :xcb_input_xi_select_events, [:pointer, :uint32, :uint16, :pointer], VoidCookie
+  end
+end
+
+XCB::LazyBinding.record_load('xcb_xinput', started)
@@ -0,0 +1,32 @@
+require_relative 'xcb_complete'
+
+started = XCB::LazyBinding.clock
+
+module XCB
+  # Привязки к расширению XTEST (libxcb-xtest): синтетический ввод
+  module XTest
+    extend FFI::Library
+    extend LazyBinding
+    
+    ffi_lib 'xcb-xtest'
+    
+    # Идентификатор расширения для xcb_get_extension_data
+    ID = ffi_libraries.first.find_variable('xcb_test_id')
+    
+    # Типы событий FakeInput (коды событий ядра протокола)
+    KEY_PRESS = 2
+    KEY_RELEASE = 3
+    BUTTON_PRESS = 4
+    BUTTON_RELEASE = 5
+    MOTION_NOTIFY = 6
+    
+    # Запрос версии XTEST
+    attach_function :xcb_test_get_version, [:pointer, :uint8, :uint16], :uint32
+    # Получение ответа версии
+    attach_function :xcb_test_get_version_reply, [:pointer, :uint32, :pointer], :pointer
+    # Синтетическое событие ввода: type, detail, time (0 = сейчас), root, root_x, root_y, deviceid
+    attach_function :xcb_test_fake_input, [:pointer, :uint8, :uint8, :uint32, :uint32, :int16, :int16, :uint8], VoidCookie
+  end
+end
+
+XCB::LazyBinding.record_load('xcb_xtest', started)
@@ -0,0 +1,57 @@
+#!/usr/bin/env ruby
+
+require 'stringio'
+require_relative '../lib/xcb_wrapper'
+
+puts "=== Тест захвата изображения полосами ==="
+
+conn = XCB::Connection.new
+window = conn.default_screen.create_window(width: 64, height: 64)
+width = 1500
+height = 1200
+
+# Пиксмап больше максимального размера запроса: чтение идёт полосами
+pixmap = XCB::Pixmap.new(conn, window.window_id, width, height)
+red = pixmap.create_graphics_context(foreground: 0xFF0000)
+blue = pixmap.create_graphics_context(foreground: 0x0000FF)
+red.fill_rectangle(0, 0, width, height / 2)
+blue.fill_rectangle(0, height / 2, width, height - height / 2)
+conn.flush
+
+[true, false].each do |shm|
+  strips = 0
+  rows = 0
+  ok = true
+  pixmap.capture(shm: shm) do |top, count, pixels|
+    strips += 1
+    rows += count
+    expected = top < height / 2 ? "\xFF\x00\x00".b : "\x00\x00\xFF".b
+    ok &&= pixels.bytesize == width * count * 3 && pixels.byteslice(0, 3) == expected
+  end
+
+  unless ok && rows == height
+    puts "❌ Захват (shm: #{shm}) вернул неверные пиксели"
+    exit 1
+  end
+  puts "✅ Захват (shm: #{shm}): #{rows} строк за #{strips} полос"
+end
+
+ppm = StringIO.new(String.new(encoding: Encoding::BINARY))
+pixmap.capture_ppm(ppm, height: 10)
+header = "P6\n#{width} 10\n255\n"
+unless ppm.string.start_with?(header) && ppm.string.bytesize == header.bytesize + width * 10 * 3
+  puts "❌ PPM записан неверно"
+  exit 1
+end
+puts "✅ PPM #{ppm.string.bytesize} байт"
+
+png = StringIO.new(String.new(encoding: Encoding::BINARY))
+pixmap.capture_png(png, alpha: true)
+unless png.string.start_with?(XCB::Capture::PNGWriter::SIGNATURE) && png.string.end_with?("IEND\xAEB`\x82".b)
+  puts "❌ PNG записан неверно"
+  exit 1
+end
+puts "✅ PNG #{png.string.bytesize} байт"
+
+conn.close
+puts "\n🎉 Захват изображения работает корректно!"
@@ -0,0 +1,51 @@
+#!/usr/bin/env ruby
+
+require_relative '../lib/xcb_wrapper'
+require_relative '../lib/xcb/damage_stream'
+
+puts "=== Тест инкрементального захвата (DAMAGE) ==="
+
+conn = XCB::Connection.new
+window = conn.default_screen.create_window(width: 64, height: 64)
+pixmap = XCB::Pixmap.new(conn, window.window_id, 200, 100)
+gc = pixmap.create_graphics_context(foreground: 0xFFFFFF)
+gc.fill_rectangle(0, 0, 200, 100)
+
+stream = XCB::DamageStream.new(pixmap, keyframe_interval: nil)
+pump = lambda do
+  conn.sync
+  while (event = conn.poll_for_event)
+    stream.handle_event(event)
+  end
+end
+
+pump.call
+keyframe = stream.tick
+unless keyframe.size == 1 && keyframe.first.keyframe? && keyframe.first.pixels.bytesize == 200 * 100 * 3
+  puts "❌ Первый тик должен вернуть полный ключевой кадр"
+  exit 1
+end
+puts "✅ Ключевой кадр: 200x100"
+
+if stream.tick.any?
+  puts "❌ Без изменений тик должен быть пустым"
+  exit 1
+end
+puts "✅ Без изменений ничего не читается"
+
+pixmap.create_graphics_context(foreground: 0xFF0000).fill_rectangle(150, 20, 10, 10)
+pump.call
+updates = stream.tick
+covered = updates.all? { |u| u.x <= 150 && u.y <= 20 && u.x + u.width >= 160 && u.y + u.height >= 30 }
+area = updates.sum { |u| u.width * u.height }
+red = updates.first && updates.first.pixels.byteslice(((20 - updates.first.y) * updates.first.width + 150 - updates.first.x) * 3, 3)
+
+unless updates.size == 1 && !updates.first.keyframe? && covered && area < 200 * 100 / 4 && red == "\xFF\x00\x00".b
+  puts "❌ Ожидалось одно обновление вокруг 10x10, получено #{updates.map { |u| [u.x, u.y, u.width, u.height] }.inspect}"
+  exit 1
+end
+puts "✅ Прочитано #{area} пикселей вместо #{200 * 100}"
+
+stream.close
+conn.close
+puts "\n🎉 Инкрементальный захват работает корректно!"
@@ -0,0 +1,49 @@
+#!/usr/bin/env ruby
+
+require_relative '../lib/xcb/glyph_cache'
+
+puts "=== Тест кэша глифов RENDER ==="
+
+conn = XCB::Connection.new
+window = conn.default_screen.create_window(width: 400, height: 200)
+window.show
+
+font = XCB::GlyphFont.new(nil, size: 14)
+puts "✅ Шрифт загружен: #{font.inspect}"
+
+cache = XCB::GlyphCache.new(conn, font, max_bytes: 16_384)
+text = XCB::TextRenderer.new(window, cache)
+
+text.draw_lines([[10, 20, "Hello, RENDER!"], [10, 40, "Антиалиасинг"]], color: 0x000000)
+first = cache.stats
+puts "✅ Первая отрисовка: #{first}"
+
+text.draw_lines([[10, 20, "Hello, RENDER!"], [10, 40, "Антиалиасинг"]], color: 0x0000ff)
+if cache.misses != first[:misses]
+  puts "❌ Повторная отрисовка снова загрузила глифы"
+  exit 1
+end
+puts "✅ Повторная отрисовка использует только индексы глифов"
+
+# Много разных символов — кэш должен вытеснять старые глифы
+text.draw(10, 60, ("A".."Z").to_a.join + ("a".."z").to_a.join + ("0".."9").to_a.join)
+text.draw(10, 80, ("А".."Я").to_a.join + ("а".."я").to_a.join)
+conn.sync
+
+if cache.evictions.zero? || cache.bytes > cache.max_bytes
+  puts "❌ LRU не ограничил память: #{cache.stats}"
+  exit 1
+end
+puts "✅ LRU ограничил память глифов: #{cache.stats}"
+
+while (event = conn.poll_for_event)
+  if event.event_ptr.get_uint8(0) == 0
+    puts "❌ Ошибка протокола: код #{event.event_ptr.get_uint8(1)}"
+    exit 1
+  end
+end
+puts "✅ Сервер принял все запросы без ошибок"
+
+font.close
+conn.close
+puts "\n🎉 Кэш глифов работает корректно!"
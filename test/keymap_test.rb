@@ -0,0 +1,71 @@
+#!/usr/bin/env ruby
+
+require_relative '../lib/xcb_wrapper'
+
+puts "=== Тест таблицы раскладки (Keymap) ==="
+
+conn = XCB::Connection.new
+keymap = conn.keymap
+shift = XCB::XCB_MOD_MASK_SHIFT
+lock = XCB::XCB_MOD_MASK_LOCK
+
+# keycodes: обратный поиск по имени и по числу
+letter = keymap.keycodes("a").first
+digit = keymap.keycodes("1").first
+if letter.nil? || digit.nil? || keymap.keycodes(0x61) != keymap.keycodes("a")
+  puts "❌ keycodes не нашёл клавиши \"a\" и \"1\""
+  exit 1
+end
+puts "✅ keycodes: a=#{letter}, 1=#{digit}"
+
+# lookup: Shift и Caps Lock для буквы, только Shift для цифры
+cases = {
+  [letter, 0] => "a", [letter, shift] => "A", [letter, lock] => "A", [letter, shift | lock] => "a",
+  [digit, 0] => "1", [digit, lock] => "1"
+}
+wrong = cases.reject { |(code, state), name| XCB::Keymap.name(keymap.lookup(code, state)) == name }
+unless wrong.empty?
+  puts "❌ lookup: #{wrong.keys.map { |code, state| "#{code}/#{state}" }.join(', ')}"
+  exit 1
+end
+if keymap.keysym(letter, 0) != 0x61 || keymap.lookup(keymap.max_keycode + 1) != XCB::Keymap::NO_SYMBOL
+  puts "❌ keysym по столбцу или код вне диапазона"
+  exit 1
+end
+puts "✅ lookup учитывает Shift и Caps Lock"
+
+# invalidate + refresh: MappingNotify помечает диапазон, следующий
+# lookup перечитывает его одним запросом
+table = keymap.instance_variable_get(:@keysyms)
+table[(letter - keymap.min_keycode) * keymap.keysyms_per_keycode] = XCB::Keymap::NO_SYMBOL
+notify = FFI::MemoryPointer.new(:uint8, 32)
+notify.put_bytes(0, [34, 0, 0, 0, XCB::XCB_MAPPING_KEYBOARD, letter, 1].pack('C4C3'))
+fetches = keymap.fetches
+keymap.invalidate(XCB::Event.new(notify, conn))
+unless keymap.stale?
+  puts "❌ MappingNotify не пометил таблицу устаревшей"
+  exit 1
+end
+restored = keymap.lookup(letter)
+if restored != 0x61 || keymap.fetches != fetches + 1 || keymap.stale?
+  puts "❌ refresh: keysym=#{restored}, запросов #{keymap.fetches - fetches}"
+  exit 1
+end
+keymap.lookup(letter)
+if keymap.fetches != fetches + 1
+  puts "❌ Повторный lookup снова запросил раскладку"
+  exit 1
+end
+puts "✅ MappingNotify перечитывает только изменённый диапазон"
+
+# MappingNotify для указателя таблицу не трогает
+notify.put_uint8(4, XCB::XCB_MAPPING_POINTER)
+keymap.invalidate(XCB::Event.new(notify, conn))
+if keymap.stale?
+  puts "❌ MappingNotify для указателя пометил таблицу"
+  exit 1
+end
+puts "✅ MappingNotify для указателя пропущен"
+
+conn.close
+puts "\n🎉 Keymap работает корректно!"
@@ -0,0 +1,78 @@
+#!/usr/bin/env ruby
+
+require 'tmpdir'
+require_relative '../lib/xcb_wrapper'
+require_relative '../lib/xcb_proto'
+require_relative '../tools/xcb_proto/emitter'
+%w[xcb_present xcb_xinput xcb_damage xcb_xfixes].each do |binding|
+  begin
+    require_relative "../lib/#{binding}"
+  rescue LoadError
+    # libxcb-<name> не установлена: её смещения не проверяем
+  end
+end
+
+puts "=== Тест сгенерированных структур протокола ==="
+
+# Раскладка генератора: событие короче 32 байт и GenericEvent со списком
+xml = <<~XML
+  <?xml version="1.0" encoding="utf-8"?>
+  <xcb header="sample" extension-xname="SAMPLE" extension-name="Sample" major-version="1" minor-version="0">
+    <event name="Short" number="0">
+      <pad bytes="1" />
+      <field type="CARD32" name="window" />
+      <field type="CARD16" name="width" />
+    </event>
+    <event name="Raw" number="1" xge="true">
+      <field type="CARD16" name="deviceid" />
+      <field type="CARD32" name="time" />
+      <field type="CARD32" name="detail" />
+      <field type="CARD16" name="sourceid" />
+      <field type="CARD16" name="valuators_len" />
+      <field type="CARD32" name="flags" />
+      <pad bytes="4" />
+      <list type="CARD32" name="valuator_mask"><fieldref>valuators_len</fieldref></list>
+    </event>
+  </xcb>
+XML
+
+layouts = Dir.mktmpdir do |dir|
+  path = File.join(dir, "sample.xml")
+  File.write(path, xml)
+  protocol = XCBProto::Protocol.load(path, {})
+  protocol.events.to_h do |event|
+    [event.name, XCBProto::Layout.new(event.items, event.xge ? :xge_event : :event)]
+  end
+end
+
+short = layouts["Short"]
+raw = layouts["Raw"]
+unless short.size == 32 && short.field('width').offset == 8 && raw.size == 36 && raw.field('flags').offset == 24
+  puts "❌ Раскладка: Short SIZE=#{short.size}, Raw SIZE=#{raw.size}"
+  exit 1
+end
+puts "✅ События не короче 32 байт, хвост GenericEvent после full_sequence"
+
+# Смещения, записанные в коде, должны совпадать со структурами
+unless XCB::Proto.generated_struct("KeyPressEvent")
+  puts "⚠️ Биндинги не сгенерированы (ruby tools/generate_bindings.rb), сверка смещений пропущена"
+  exit 0
+end
+
+checked = 0
+mismatches = XCB::Proto.wire_layout.filter_map do |path, field, expected|
+  klass = XCB::Proto.generated_struct(path)
+  next unless klass
+
+  checked += 1
+  actual = field ? klass.offset_of(field) : klass::SIZE
+  "#{path}#{field && "##{field}"}: #{expected} != #{actual}" unless actual == expected
+end
+unless mismatches.empty?
+  puts "❌ Смещения расходятся со сгенерированными структурами:"
+  mismatches.each { |line| puts "   #{line}" }
+  exit 1
+end
+puts "✅ #{checked} смещений совпадают со сгенерированными структурами"
+
+puts "\n🎉 Сгенерированные структуры протокола в порядке!"
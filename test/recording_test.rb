@@ -0,0 +1,97 @@
+#!/usr/bin/env ruby
+
+require 'tmpdir'
+require_relative '../lib/xcb_wrapper'
+require_relative '../lib/xcb/recording'
+
+puts "=== Тест разбора и журнала записи протокола ==="
+
+# Поток клиента: приветствие с именем и данными авторизации, обычный
+# запрос, запрос BIG-REQUESTS (длина 0, затем 32-битная длина), PolyPoint
+auth_name = "MIT-MAGIC-COOKIE-1"
+client_messages = [
+  ["l", 0, 11, 0, auth_name.bytesize, 16, 0].pack('aCvvvvv') + auth_name + "\0\0" + "\x01".b * 16,
+  [43, 0, 1].pack('CCv'),
+  [72, 2, 0, 4, 0x200001, 0x200002].pack('CCvVVV'),
+  [64, 0, 5, 0x200001, 0x200002, 1, 2, 3, 4].pack('CCvVVs4')
+]
+
+# Поток сервера: приветствие, событие, ответ с хвостом, GenericEvent, ошибка
+server_messages = [
+  [1, 0, 11, 0, 2].pack('CCvvv') + "\0".b * 8,
+  [12].pack('C') + "\0".b * 31,
+  [1, 0, 1, 1].pack('CCvV') + "\0".b * 24 + "tail",
+  [35, 0, 2, 2].pack('CCvV') + "\0".b * 24 + "generic!",
+  [0, 3, 4].pack('CCv') + "\0".b * 28
+]
+
+frame = lambda do |framer, chunks|
+  messages = []
+  chunks.each { |chunk| framer.feed(chunk) { |message, setup| messages << [message, setup] } }
+  messages
+end
+
+expected_client = client_messages.each_with_index.map { |message, i| [message, i.zero?] }
+expected_server = server_messages.each_with_index.map { |message, i| [message, i.zero?] }
+client_stream = client_messages.join
+server_stream = server_messages.join
+
+cases = {
+  "одним куском" => ->(stream) { [stream] },
+  "по байту" => ->(stream) { stream.each_char.to_a },
+  "кусками по 7 байт" => ->(stream) { stream.scan(/.{1,7}/m) }
+}
+cases.each do |name, split|
+  client = frame.(XCB::Recording::Framer.new(true), split.(client_stream))
+  server = frame.(XCB::Recording::Framer.new(false), split.(server_stream))
+  unless client == expected_client && server == expected_server
+    puts "❌ Разбор потока #{name}: #{client.size} запросов, #{server.size} сообщений сервера"
+    exit 1
+  end
+end
+puts "✅ Разбор потоков: приветствие, BIG-REQUESTS, ответы и GenericEvent (#{cases.size} способа нарезки)"
+
+records = [[XCB::Recording::CLIENT_SETUP, 0.0, client_messages[0]],
+           [XCB::Recording::SERVER_SETUP, 0.001, server_messages[0]],
+           [XCB::Recording::REQUEST, 0.25, client_messages[2]],
+           [XCB::Recording::SERVER, 1.5, server_messages[3]]]
+
+Dir.mktmpdir do |dir|
+  %w[session.xrec session.xrec.gz].each do |file|
+    path = File.join(dir, file)
+    log = XCB::Recording::Log.create(path)
+    records.each { |kind, time, bytes| log.write(kind, 100.0 + time, bytes) }
+    log.close
+
+    read = []
+    XCB::Recording::Log.read(path) { |kind, time, bytes| read << [kind, time, bytes] }
+    matches = read.size == records.size && read.zip(records).all? do |(kind, time, bytes), (k, t, b)|
+      kind == k && bytes == b && (time - t).abs < 1e-5
+    end
+    unless matches
+      puts "❌ Журнал #{file} прочитан неверно: #{read.map(&:first).inspect}"
+      exit 1
+    end
+
+    gzipped = File.binread(path, 2) == "\x1f\x8b".b
+    unless gzipped == file.end_with?(".gz")
+      puts "❌ Журнал #{file}: сжатие не соответствует имени"
+      exit 1
+    end
+  end
+end
+puts "✅ Журнал записывается и читается без потерь (обычный и .gz)"
+
+begin
+  Dir.mktmpdir do |dir|
+    path = File.join(dir, "bogus.xrec")
+    File.binwrite(path, "not a recording")
+    XCB::Recording::Log.read(path) { }
+  end
+  puts "❌ Чужой файл принят за журнал"
+  exit 1
+rescue XCB::XCBError
+  puts "✅ Чужой файл отвергается"
+end
+
+puts "\n🎉 Разбор протокола и журнал записи работают корректно!"
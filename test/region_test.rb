@@ -0,0 +1,93 @@
+#!/usr/bin/env ruby
+
+require_relative '../lib/xcb_wrapper'
+require_relative '../lib/xcb/region'
+
+puts "=== Тест областей отсечения и регионов XFixes ==="
+
+conn = XCB::Connection.new
+window = conn.default_screen.create_window(width: 32, height: 32)
+pixmap = XCB::Pixmap.new(conn, window.window_id, 32, 32)
+gc = pixmap.create_graphics_context(foreground: :white)
+gc.fill_rectangle(0, 0, 32, 32)
+
+pixels_of = lambda do
+  data = pixmap.capture.map { |_top, _rows, strip| strip }.join
+  ->(x, y) { data.byteslice((y * 32 + x) * 3, 3) }
+end
+
+# Ошибки X приходят событиями с response_type 0
+server_errors = lambda do
+  conn.sync
+  errors = []
+  while (event = conn.poll_for_event)
+    errors << event if event.response_type.zero?
+  end
+  errors
+end
+
+white = "\xFF\xFF\xFF".b
+red = "\xFF\x00\x00".b
+green = "\x00\xFF\x00".b
+blue = "\x00\x00\xFF".b
+
+# Две полосы, вторая задана первой: :auto сортирует их сам
+gc.set_foreground(:red)
+gc.set_clip_rectangles([[20, 4, 8, 8], [4, 4, 8, 8]])
+gc.fill_rectangle(0, 0, 32, 16)
+gc.clear_clip
+
+pixel = pixels_of.()
+expected = { [5, 5] => red, [27, 11] => red, [15, 5] => white, [5, 13] => white, [0, 0] => white }
+failed = expected.reject { |(x, y), rgb| pixel.(x, y) == rgb }
+unless failed.empty?
+  puts "❌ Заливка вышла за область отсечения в #{failed.keys.inspect}"
+  exit 1
+end
+puts "✅ Пиксели вне области отсечения не изменились"
+
+# Перекрывающиеся прямоугольники не годятся для YX_BANDED/YX_SORTED
+gc.set_foreground(:blue)
+gc.set_clip_rectangles([[8, 20, 10, 4], [0, 16, 10, 10], [5, 16, 10, 10]])
+gc.fill_rectangle(0, 16, 32, 16)
+gc.clear_clip
+
+errors = server_errors.()
+pixel = pixels_of.()
+unless errors.empty? && pixel.(12, 18) == blue && pixel.(17, 21) == blue && pixel.(20, 20) == white
+  puts "❌ Перекрывающиеся прямоугольники: ошибок #{errors.size}, пиксели неверны"
+  exit 1
+end
+puts "✅ Перекрывающиеся прямоугольники приняты сервером (Y_SORTED)"
+
+a = XCB::Region.new(conn, [[0, 0, 10, 10]])
+b = XCB::Region.new(conn, [[5, 5, 10, 10]])
+union = a | b
+intersection = a & b
+
+expected_union = [[0, 0, 10, 5], [0, 5, 15, 5], [5, 10, 10, 5]]
+unless union.rectangles == expected_union && intersection.rectangles == [[5, 5, 5, 5]]
+  puts "❌ Регионы: #{union.rectangles.inspect} / #{intersection.rectangles.inspect}"
+  exit 1
+end
+
+a.subtract!([[0, 0, 10, 5]])
+a.translate!(2, 0)
+unless a.rectangles == [[2, 5, 10, 5]] && a.version == 2 && !a.empty? && (a - a).empty?
+  puts "❌ Операции на месте: #{a.rectangles.inspect} version=#{a.version}"
+  exit 1
+end
+puts "✅ Объединение, пересечение, разность и сдвиг регионов"
+
+gc.set_foreground(:green)
+gc.with_clip(intersection) { gc.fill_rectangle(0, 0, 32, 32) }
+pixel = pixels_of.()
+unless pixel.(6, 6) == green && pixel.(9, 9) == green && pixel.(4, 4) == red && pixel.(11, 6) == red &&
+       pixel.(12, 12) == white && server_errors.().empty?
+  puts "❌ Отсечение регионом не сработало"
+  exit 1
+end
+puts "✅ Отсечение графического контекста регионом"
+
+conn.close
+puts "\n🎉 Области отсечения и регионы работают корректно!"
@@ -0,0 +1,56 @@
+#!/usr/bin/env ruby
+
+require_relative '../lib/xcb_wrapper'
+
+puts "=== Тест прямого кодировщика запросов ==="
+
+conn = XCB::Connection.new
+window = conn.default_screen.create_window(width: 200, height: 200)
+window.show
+gc = window.create_graphics_context(foreground: :black)
+
+encoder = conn.encoder
+
+# Смешанная пачка запросов
+1000.times do |i|
+  encoder.fill_rectangle(window, gc, i % 200, i % 200, 4, 4)
+  encoder.segment(window, gc, 0, i % 200, 199, 199 - i % 200)
+end
+encoder.change_gc(gc, XCB::XCB_GC_FOREGROUND, [conn.default_screen.white_pixel])
+encoder.copy_area(window, window, gc, 0, 0, 100, 100, 50, 50)
+encoder.put_image(window, gc, 16, 16, 10, 10, conn.default_screen.depth, "\xff".b * (16 * 16 * 4))
+
+pending = encoder.pending_requests
+puts "✅ Закодировано запросов: #{pending}"
+
+if pending > 100
+  puts "❌ Последовательные прямоугольники/отрезки не объединяются"
+  exit 1
+end
+
+encoder.flush
+puts "✅ Пачка отправлена одним xcb_writev"
+
+# Следующий запрос libxcb должен получить номер сразу после наших
+cookie = XCB.xcb_get_input_focus(conn.connection)
+expected = (encoder.last_sequence + 1) & 0xffffffff
+reply = XCB.xcb_get_input_focus_reply(conn.connection, cookie, nil)
+XCB::LibC.free(reply) unless reply.null?
+
+if cookie != expected
+  puts "❌ Номер последовательности #{cookie}, ожидался #{expected}"
+  exit 1
+end
+puts "✅ Номера последовательностей синхронизированы с libxcb (#{cookie})"
+
+# Ошибок протокола быть не должно
+while (event = conn.poll_for_event)
+  if event.event_ptr.get_uint8(0) == 0
+    puts "❌ Ошибка протокола: код #{event.event_ptr.get_uint8(1)}"
+    exit 1
+  end
+end
+puts "✅ Сервер принял все запросы без ошибок"
+
+conn.close
+puts "\n🎉 Кодировщик запросов работает корректно!"
@@ -0,0 +1,44 @@
+#!/usr/bin/env ruby
+
+require 'ffi'
+require_relative '../lib/xcb/scratch_arena'
+
+puts "=== Тест буферов аргументов (ScratchArena) ==="
+
+fail_with = lambda do |message|
+  puts "❌ #{message}"
+  exit 1
+end
+
+# Значения в порядке битов маски, в каком бы порядке их ни задали
+arena = XCB::ScratchArena.new
+list = arena.value_list
+list.set(0x800, 7).set(0x4, -1).set(0x1, 5).set(0x800, 8)
+expected = [5, 0xffffffff, 8]
+fail_with.("mask=#{list.mask.to_s(16)}, size=#{list.size}") unless list.mask == 0x805 && list.size == 3
+fail_with.("to_a: #{list.to_a.inspect}") unless list.to_a == expected
+fail_with.("pointer: #{list.pointer.get_array_of_uint32(0, 3).inspect}") unless list.pointer.get_array_of_uint32(0, 3) == expected
+puts "✅ set вне порядка: to_a и pointer в порядке маски, повторный set заменяет значение"
+
+# value_list отдаёт очищенный список; старые значения не протекают
+list = arena.value_list
+fail_with.("Список не очищен: #{list.to_a.inspect}") unless list.empty? && list.to_a.empty? && list.pointer.nil?
+list.set(0x2, 9)
+fail_with.("После clear: #{list.to_a.inspect}") unless list.to_a == [9] && list.pointer.get_uint32(0) == 9
+fail_with.("clear вернул не список") unless list.clear.equal?(list) && list.empty?
+puts "✅ clear между запросами"
+
+# Буфер растёт удвоением и только когда не хватает места
+small = XCB::ScratchArena.new(16)
+first = small.buffer(8)
+fail_with.("Лишний рост: #{small.inspect}") unless small.size == 16 && small.grows.zero?
+small.buffer(40)
+fail_with.("Рост до 40 байт: #{small.inspect}") unless small.size == 64 && small.grows == 1
+grown = small.buffer(64)
+fail_with.("Рост без нужды: #{small.inspect}") unless small.grows == 1 && small.buffer(4).equal?(grown) && !grown.equal?(first)
+small.uint32_array(Array.new(100) { |i| i })
+fail_with.("Рост до 400 байт: #{small.inspect}") unless small.size == 512 && small.grows == 2
+fail_with.("Данные массива") unless small.buffer(400).get_array_of_uint32(0, 100) == (0...100).to_a
+puts "✅ buffer растёт удвоением: #{small.inspect}"
+
+puts "\n🎉 ScratchArena работает корректно!"
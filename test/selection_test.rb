@@ -0,0 +1,50 @@
+#!/usr/bin/env ruby
+
+require_relative '../lib/xcb_wrapper'
+
+puts "=== Тест потокового чтения свойств и INCR ==="
+
+conn = XCB::Connection.new
+window = conn.default_screen.create_window(width: 100, height: 100)
+chunk_size = 64 * 1024
+
+# Большое свойство читается кусками не больше chunk_size
+blob = Random.new(1).bytes(1024 * 1024 + 123)
+window.write_property("XCB_TEST_BLOB", "STRING", blob)
+chunks = window.property_chunks("XCB_TEST_BLOB", chunk_size: chunk_size).to_a
+
+if chunks.join != blob || chunks.any? { |c| c.bytesize > chunk_size }
+  puts "❌ Чтение свойства кусками вернуло неверные данные"
+  exit 1
+end
+puts "✅ Свойство #{blob.bytesize} байт прочитано #{chunks.size} кусками"
+
+# Передача выделения самому себе через INCR
+clipboard = XCB::Selection.new(window, :CLIPBOARD, chunk_size: chunk_size)
+payload = Random.new(2).bytes(3 * 1024 * 1024)
+unless clipboard.own(payload, targets: ["application/octet-stream"])
+  puts "❌ Не удалось стать владельцем CLIPBOARD"
+  exit 1
+end
+
+largest = 0
+sink = Object.new
+sink.define_singleton_method(:data) { @data ||= String.new(encoding: Encoding::BINARY) }
+sink.define_singleton_method(:<<) do |chunk|
+  largest = chunk.bytesize if chunk.bytesize > largest
+  data << chunk
+end
+
+result = clipboard.read("application/octet-stream", sink: sink)
+if result.nil? || sink.data != payload
+  puts "❌ INCR передача вернула неверные данные"
+  exit 1
+end
+if largest > chunk_size || clipboard.transfers != 0
+  puts "❌ INCR передача не ограничила размер куска: #{largest}"
+  exit 1
+end
+puts "✅ INCR передача #{payload.bytesize} байт, кусок не больше #{largest} байт"
+
+conn.close
+puts "\n🎉 Потоковые свойства и выделения работают корректно!"
@@ -0,0 +1,57 @@
+#!/usr/bin/env ruby
+
+require_relative '../lib/xcb_wrapper'
+require_relative '../lib/xcb/sprite'
+
+puts "=== Тест спрайтов с маской ==="
+
+conn = XCB::Connection.new
+window = conn.default_screen.create_window(width: 64, height: 64)
+
+# Спрайт 4x4: левая половина красная и непрозрачная, правая прозрачная
+rgba = ("\xFF\x00\x00\xFF".b * 2 + "\x00\xFF\x00\x00".b * 2) * 4
+
+[true, false].each do |render|
+  sheet = XCB::SpriteSheet.new(conn, width: 64, height: 64, render: render)
+  sheet.add(:half, 4, 4, rgba)
+  sheet.add(:dot, 3, 3) { |canvas| canvas.fill_rectangle(1, 1, 1, 1, 0x0000FF) }
+
+  target = XCB::Pixmap.new(conn, window.window_id, 16, 16)
+  target.create_graphics_context(foreground: 0xFFFFFF).fill_rectangle(0, 0, 16, 16)
+  count = sheet.batch(target) do |batch|
+    batch.draw(:half, 0, 0)
+    batch.draw(:half, 8, 8)
+    batch.draw(:dot, 4, 0)
+  end
+
+  pixels = target.capture.map { |_top, _rows, data| data }.join
+  pixel = ->(x, y) { pixels.byteslice((y * 16 + x) * 3, 3) }
+  expected = {
+    [0, 0] => "\xFF\x00\x00".b, [3, 0] => "\xFF\xFF\xFF".b,
+    [9, 9] => "\xFF\x00\x00".b, [10, 9] => "\xFF\xFF\xFF".b,
+    [5, 1] => "\x00\x00\xFF".b, [4, 0] => "\xFF\xFF\xFF".b
+  }
+  failed = expected.reject { |(x, y), rgb| pixel.(x, y) == rgb }
+
+  unless count == 3 && failed.empty?
+    puts "❌ Режим #{sheet.mode}: неверные пиксели в #{failed.keys.inspect}"
+    exit 1
+  end
+  puts "✅ Режим #{sheet.mode}: #{count} копирования, прозрачные пиксели не затронуты"
+  next unless sheet.mode == :render
+
+  # release освобождает картинку цели; объект с тем же id получает новую
+  first = sheet.send(:target_picture, target)
+  sheet.release(target)
+  second = sheet.send(:target_picture, target)
+  twin = target.dup
+  third = sheet.send(:target_picture, twin)
+  unless second != first && third != second && sheet.send(:target_picture, twin).equal?(third)
+    puts "❌ Кэш картинок целей не освобождается"
+    exit 1
+  end
+  puts "✅ release освобождает картинку цели"
+end
+
+conn.close
+puts "\n🎉 Спрайты работают корректно!"
@@ -0,0 +1,53 @@
+#!/usr/bin/env ruby
+
+require_relative '../lib/xcb_wrapper'
+require_relative '../lib/xcb/tiled_surface'
+
+puts "=== Тест тайловой поверхности ==="
+
+conn = XCB::Connection.new
+window = conn.default_screen.create_window(width: 64, height: 64)
+
+# Бюджет на два тайла 64x64: третий тайл вытесняет самый старый
+tile_bytes = XCB::Capture::PixelFormat.new(conn, conn.default_screen.depth, conn.default_screen.visual_type)
+                                      .stride(64) * 64
+surface = XCB::TiledSurface.new(conn, width: 100_000, height: 100_000, tile_size: 64, budget: 2 * tile_bytes)
+
+surface.fill_rectangle(10, 10, 100, 20, 0xFF0000)       # тайлы (0,0) и (1,0)
+surface.fill_rectangle(90_000, 90_000, 8, 8, 0x00FF00)  # далёкий тайл
+surface.draw_line(0, 63, 127, 63, 0x0000FF)             # снова (0,0) и (1,0)
+
+stats = surface.stats
+unless stats[:tiles] == 3 && stats[:resident] == 2 && stats[:evictions] >= 1
+  puts "❌ Ожидалось 3 тайла, 2 на сервере и вытеснение: #{stats.inspect}"
+  exit 1
+end
+puts "✅ Тайлы создаются лениво, на сервере не больше бюджета: #{stats.inspect}"
+
+view = XCB::Pixmap.new(conn, window.window_id, 128, 64)
+pixels_of = lambda do |pixmap|
+  data = pixmap.capture.map { |_top, _rows, strip| strip }.join
+  ->(x, y) { data.byteslice((y * pixmap.width + x) * 3, 3) }
+end
+
+surface.blit(view, 89_990, 89_990, 128, 64)
+pixel = pixels_of.(view)
+unless pixel.(12, 12) == "\x00\xFF\x00".b && pixel.(5, 5) == "\xFF\xFF\xFF".b && pixel.(100, 40) == "\xFF\xFF\xFF".b
+  puts "❌ Вытесненный тайл восстановлен неверно"
+  exit 1
+end
+puts "✅ Вытесненный тайл восстановлен из сжатого хранилища"
+
+surface.blit(view, 0, 0, 128, 64)
+pixel = pixels_of.(view)
+expected = { [10, 10] => "\xFF\x00\x00".b, [109, 29] => "\xFF\x00\x00".b, [110, 10] => "\xFF\xFF\xFF".b,
+             [64, 63] => "\x00\x00\xFF".b, [5, 5] => "\xFF\xFF\xFF".b }
+failed = expected.reject { |(x, y), rgb| pixel.(x, y) == rgb }
+unless failed.empty?
+  puts "❌ Неверные пиксели в #{failed.keys.inspect}"
+  exit 1
+end
+puts "✅ Рисование разрезано по тайлам без швов (#{surface.stats[:restores]} восстановлений)"
+
+conn.close
+puts "\n🎉 Тайловая поверхность работает корректно!"
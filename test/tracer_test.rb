@@ -0,0 +1,64 @@
+#!/usr/bin/env ruby
+
+require 'json'
+require 'stringio'
+require_relative '../lib/xcb/tracer'
+
+puts "=== Тест трассировщика (Tracer) ==="
+
+# Кольцевой буфер: выживают последние capacity спанов
+tracer = XCB::Tracer.new(capacity: 4)
+6.times { |i| tracer.span("span#{i}", :draw, i.even? ? { index: i } : nil) { i } }
+names = tracer.events.map { |event| event[:name] }
+unless names == %w[span2 span3 span4 span5] && tracer.size == 4 && tracer.recorded == 6 && tracer.dropped == 2
+  puts "❌ Кольцо: #{names.inspect}, size=#{tracer.size}, dropped=#{tracer.dropped}"
+  exit 1
+end
+puts "✅ После переполнения остались 4 новейших спана, dropped=2"
+
+# До переполнения ничего не теряется и порядок прямой
+small = XCB::Tracer.new(capacity: 8)
+small.instant("mark", :event)
+small.span("wait", :wait, { opcode: 14 }) { nil }
+if small.dropped != 0 || small.events.map { |event| event[:name] } != %w[mark wait]
+  puts "❌ Буфер без переполнения: #{small.events.inspect}"
+  exit 1
+end
+puts "✅ Без переполнения dropped=0"
+
+# Спан записывается и при исключении в блоке
+begin
+  small.span("failing", :draw) { raise ArgumentError }
+rescue ArgumentError
+end
+unless small.events.last[:name] == "failing"
+  puts "❌ Спан с исключением не записан"
+  exit 1
+end
+puts "✅ Спан с исключением записан"
+
+# JSON в формате Chrome trace
+io = StringIO.new
+tracer.write(io)
+trace = JSON.parse(io.string)
+events = trace["traceEvents"]
+keys = %w[name cat ph ts dur pid tid]
+shape_ok = events.all? { |event| (keys - event.keys).empty? && event["ph"] == "X" && event["cat"] == "draw" } &&
+           events.all? { |event| event["dur"] >= 0 && event["pid"] == Process.pid } &&
+           events.each_cons(2).all? { |a, b| a["ts"] <= b["ts"] } &&
+           events.map { |event| event["args"] } == [{ "index" => 2 }, nil, { "index" => 4 }, nil]
+unless shape_ok && trace["displayTimeUnit"] == "ms" && trace["otherData"] == { "recorded" => 6, "dropped" => 2 }
+  puts "❌ Неверный JSON: #{io.string[0, 200]}"
+  exit 1
+end
+puts "✅ JSON: #{events.size} событий, args только где заданы, otherData с dropped"
+
+# clear начинает запись заново
+tracer.clear
+if tracer.size != 0 || tracer.dropped != 0 || !tracer.events.empty?
+  puts "❌ clear не очистил буфер"
+  exit 1
+end
+puts "✅ clear очищает буфер"
+
+puts "\n🎉 Трассировщик работает корректно!"
@@ -0,0 +1,116 @@
+#!/usr/bin/env ruby
+
+require_relative '../lib/xcb_wrapper'
+
+puts "=== Тест кэша геометрии и дерева окон ==="
+
+conn = XCB::Connection.new
+other = XCB::Connection.new
+screen = conn.default_screen
+
+# Прочитать все события: структурные обновляют кэш окон
+drain = lambda do
+  conn.sync
+  nil while conn.poll_for_event
+end
+
+fail_with = lambda do |message|
+  puts "❌ #{message}"
+  exit 1
+end
+
+parent = screen.create_window(x: 10, y: 10, width: 200, height: 150)
+children = parent.create_children([
+  { x: 0, y: 0, width: 40, height: 30 },
+  { x: 50, y: 0, width: 40, height: 30 },
+  { x: 100, y: 0, width: 40, height: 30 }
+])
+first, second, third = children
+
+# load_info: один пакет запросов на все окна
+loaded = XCB::Window.load_info([parent, *children])
+unless loaded.size == 4 && loaded.all?(&:info_loaded?)
+  fail_with.("load_info загрузил #{loaded.size} окон из 4")
+end
+unless parent.children.sort == children.map(&:window_id).sort && children.all? { |c| c.parent == parent.window_id }
+  fail_with.("Дерево: #{parent.children.inspect}")
+end
+unless second.x == 50 && second.width == 40 && second.depth == screen.depth && !second.mapped?
+  fail_with.("Геометрия: #{second.info.inspect}")
+end
+if XCB::Window.load_info([parent]).any?
+  fail_with.("load_info повторно запросил загруженное окно")
+end
+puts "✅ load_info: 4 окна, дерево и геометрия"
+
+# configure пишет в кэш сразу, ConfigureNotify подтверждает
+first.configure(x: 5, width: 60)
+unless first.x == 5 && first.width == 60
+  fail_with.("configure не обновил кэш: x=#{first.x}, width=#{first.width}")
+end
+drain.()
+unless first.x == 5 && first.width == 60 && first.height == 30
+  fail_with.("После ConfigureNotify: #{first.info.inspect}")
+end
+puts "✅ configure обновляет кэш без запроса"
+
+# Изменение другим клиентом приходит ConfigureNotify
+values = other.scratch.value_list
+values.set(2, 20)    # XCB_CONFIG_WINDOW_Y
+values.set(8, 25)    # XCB_CONFIG_WINDOW_HEIGHT
+XCB.xcb_configure_window(other.connection, second.window_id, values.mask, values.pointer)
+other.sync
+drain.()
+unless second.y == 20 && second.height == 25 && second.x == 50
+  fail_with.("ConfigureNotify от другого клиента: #{second.info.inspect}")
+end
+puts "✅ ConfigureNotify от другого клиента обновил кэш"
+
+# ReparentNotify: родитель, позиция и списки детей обоих родителей
+XCB.xcb_reparent_window(other.connection, second.window_id, first.window_id, 3, 4)
+other.sync
+drain.()
+unless second.parent == first.window_id && [second.x, second.y] == [3, 4] &&
+       first.children == [second.window_id] && !parent.children.include?(second.window_id)
+  fail_with.("ReparentNotify: parent=#{second.parent}, #{first.children.inspect}, #{parent.children.inspect}")
+end
+puts "✅ ReparentNotify перенёс окно в кэше"
+
+# DestroyNotify: окно помечено, убрано из детей и из отслеживаемых
+XCB.xcb_destroy_window(other.connection, third.window_id)
+other.sync
+drain.()
+unless third.destroyed? && !parent.children.include?(third.window_id) && conn.tracked_window(third.window_id).nil?
+  fail_with.("DestroyNotify: destroyed=#{third.destroyed?}, #{parent.children.inspect}")
+end
+puts "✅ DestroyNotify убрал окно"
+
+# child_added: новое окно попадает в загруженный список детей без запроса
+added = parent.create_children([{ x: 0, y: 60, width: 20, height: 20 }]).first
+unless parent.children.include?(added.window_id)
+  fail_with.("Новое окно не попало в children: #{parent.children.inspect}")
+end
+puts "✅ Новое дочернее окно добавлено в кэш"
+
+# map_state: окно под скрытым родителем отображено, но не видно
+first.show
+drain.()
+unless first.mapped? && first.map_state == :unviewable && !first.viewable?
+  fail_with.("Под скрытым родителем: #{first.map_state}")
+end
+parent.show
+drain.()
+fail_with.("После показа родителя: #{first.map_state}") unless first.viewable?
+parent.hide
+drain.()
+unless first.mapped? && first.map_state == :unviewable
+  fail_with.("После скрытия родителя: #{first.map_state}")
+end
+first.hide
+drain.()
+fail_with.("После UnmapNotify: #{first.map_state}") if first.mapped? || first.map_state != :unmapped
+puts "✅ map_state учитывает видимость предков"
+
+other.close
+conn.close
+puts "\n🎉 Кэш окон работает корректно!"
@@ -0,0 +1,36 @@
+#!/usr/bin/env ruby
+# Generates FFI bindings from the xcb-proto XML descriptions: exact
+# FFI::Struct layouts for structs, replies and events, attach_function
+# declarations with the right cookie types, typed reply readers and
+# direct RequestEncoder encoders. One file per protocol module is
+# written to lib/xcb/generated (load them with require 'xcb_proto').
+#
+#   ruby tools/generate_bindings.rb [--proto-dir DIR] [--output DIR] [xproto render shm ...]
+
+require 'optparse'
+require_relative 'xcb_proto/generator'
+
+ROOT = File.expand_path('..', __dir__)
+
+options = {
+  proto_dir: nil,
+  output: File.join(ROOT, 'lib', 'xcb', 'generated')
+}
+
+OptionParser.new do |opts|
+  opts.banner = "Usage: generate_bindings.rb [options] [modules]"
+  opts.on("--proto-dir DIR", "xcb-proto XML directory (default: pkg-config xcb-proto)") { |v| options[:proto_dir] = v }
+  opts.on("--output DIR", "Where to write the generated files") { |v| options[:output] = v }
+end.parse!
+
+proto_dir = XCBProto.proto_dir(options[:proto_dir])
+abort "xcb-proto XML not found in #{options[:proto_dir] || 'the default locations'} (use --proto-dir)" unless proto_dir
+
+modules = ARGV.empty? ? XCBProto::DEFAULT_MODULES : ARGV
+begin
+  XCBProto.generate(proto_dir, modules, options[:output]) do |protocol|
+    puts "#{protocol.header}.rb: #{protocol.requests.size} requests, #{protocol.events.size} events, #{protocol.structs.size} structs"
+  end
+rescue ArgumentError => e
+  abort e.message
+end
@@ -0,0 +1,557 @@
+require_relative 'parser'
+
+module XCBProto
+  # One field of a fixed layout at its wire offset
+  Slot = Struct.new(:name, :type, :offset, :count, :header)
+  
+  # Fixed part of a struct, request, reply or event as laid out on the
+  # wire (after libxcb's own changes, i.e. full_sequence at byte 32 of
+  # events). Everything from the first variable-length item on is left
+  # in tail
+  class Layout
+    attr_reader :slots, :size, :tail
+    
+    def initialize(items, kind, no_sequence: false)
+      @slots = []
+      @tail = []
+      @offset = 0
+      @shift = 0
+      @pending = nil
+      @xge = kind == :xge_event
+      header(kind, no_sequence)
+      walk(items)
+      insert_header if @pending
+      event = %i[event xge_event].include?(kind)
+      if event && @offset + @shift <= 32 && !@full_sequence
+        add('full_sequence', PRIMITIVES['CARD32'], 32 - @shift, header: true)
+        # libxcb moves the variable part of a generic event behind it
+        @shift += 4 if kind == :xge_event && @offset + @shift == 32
+      end
+      # Events are at least 32 bytes on the wire, whatever their fields
+      @size = event ? [@offset + @shift, 32].max : @offset + @shift
+    end
+    
+    def tail_offset
+      @size
+    end
+    
+    def field(name)
+      @slots.find { |slot| slot.name == name && !slot.header }
+    end
+    
+    def body_slots
+      @slots.reject(&:header)
+    end
+    
+    private
+    
+    def u8
+      PRIMITIVES['CARD8']
+    end
+    
+    def header(kind, no_sequence)
+      case kind
+      when :request_core
+        add('major_opcode', u8, 0, header: true)
+        @offset = 1
+        @pending = [['length', PRIMITIVES['CARD16']]]
+      when :request_ext
+        add('major_opcode', u8, 0, header: true)
+        add('minor_opcode', u8, 1, header: true)
+        add('length', PRIMITIVES['CARD16'], 2, header: true)
+        @offset = 4
+      when :reply
+        add('response_type', u8, 0, header: true)
+        @offset = 1
+        @pending = [['sequence', PRIMITIVES['CARD16']], ['length', PRIMITIVES['CARD32']]]
+      when :event
+        add('response_type', u8, 0, header: true)
+        @offset = 1
+        @pending = no_sequence ? nil : [['sequence', PRIMITIVES['CARD16']]]
+      when :xge_event
+        add('response_type', u8, 0, header: true)
+        add('extension', u8, 1, header: true)
+        add('sequence', PRIMITIVES['CARD16'], 2, header: true)
+        add('length', PRIMITIVES['CARD32'], 4, header: true)
+        add('event_type', PRIMITIVES['CARD16'], 8, header: true)
+        @offset = 10
+      end
+    end
+    
+    # The 2-byte header fields follow the first body byte
+    def insert_header
+      @offset = 2 if @offset < 2
+      @pending.each do |name, type|
+        add(name, type, @offset, header: true)
+        @offset += type.size
+      end
+      @pending = nil
+    end
+    
+    def walk(items)
+      items.each_with_index do |item, index|
+        insert_header if @pending && @offset == 1 && item_size(item) != 1
+        
+        case item
+        when Field, ExprField
+          return stop(items, index) unless item.type.size
+          
+          place(item.name, item.type, 1)
+        when Pad
+          @offset = item.bytes ? @offset + item.bytes : align(@offset + @shift, item.align) - @shift
+        when List
+          return stop(items, index) unless item.length.is_a?(Integer) && item.type.size
+          
+          place(item.name, item.type, item.length)
+        when ValueList
+          place(item.mask_name, item.mask_type, 1) unless item.mask_in_body
+          return stop(items, index)
+        when Fd
+          next
+        else
+          return stop(items, index)
+        end
+        
+        insert_header if @pending && @offset == 2
+      end
+    end
+    
+    def stop(items, index)
+      insert_header if @pending
+      @tail = items[index..]
+    end
+    
+    def place(name, type, count)
+      if @xge && !@full_sequence && @offset >= 32
+        add('full_sequence', PRIMITIVES['CARD32'], 32, header: true)
+        @full_sequence = true
+        @shift = 4
+      end
+      add(name, type, @offset + @shift, count: count)
+      @offset += type.size * count
+    end
+    
+    def add(name, type, offset, count: 1, header: false)
+      @full_sequence = true if name == 'full_sequence'
+      @slots << Slot.new(name, type, offset, count, header)
+    end
+    
+    def item_size(item)
+      case item
+      when Field, ExprField then item.type.size
+      when Pad then item.bytes
+      when List then item.length.is_a?(Integer) && item.type.size ? item.type.size * item.length : nil
+      end
+    end
+    
+    def align(offset, alignment)
+      (offset + alignment - 1) / alignment * alignment
+    end
+  end
+  
+  # Ruby source for one protocol module
+  class Emitter
+    RUBY_KEYWORDS = %w[alias and begin break case class def defined? do else elsif end ensure false for if in
+                       module next nil not or redo rescue retry return self super then true undef unless
+                       until when while yield].freeze
+    
+    # Extensions whose C prefix is split into words
+    SPECIAL_PREFIXES = %w[XPrint XCMisc BigRequests].freeze
+    # Extensions implemented inside libxcb itself
+    CORE_LIBRARY = %w[bigreq xc_misc ge].freeze
+    
+    def self.snake(name)
+      return name.downcase if name.match?(/\A[A-Z0-9_]+\z/)
+      
+      name.gsub(/([A-Z]+)([A-Z][a-z])/, '\1_\2').gsub(/([a-z0-9])([A-Z])/, '\1_\2').downcase
+    end
+    
+    def self.camel(name)
+      snake(name).split('_').map(&:capitalize).join
+    end
+    
+    def initialize(protocol, source_name)
+      @protocol = protocol
+      @source_name = source_name
+      @lines = []
+      @constants = {}
+    end
+    
+    def module_path
+      @protocol.extension? ? "XCB::Proto::#{Emitter.camel(@protocol.header)}" : "XCB::Proto"
+    end
+    
+    def prefix
+      return 'xcb_' unless @protocol.extension?
+      
+      name = @protocol.extension_name
+      ext = SPECIAL_PREFIXES.include?(name) ? Emitter.snake(name) : name.downcase
+      "xcb_#{ext}_"
+    end
+    
+    def library
+      return 'xcb' if !@protocol.extension? || CORE_LIBRARY.include?(@protocol.header)
+      
+      "xcb-#{@protocol.header}"
+    end
+    
+    def emit
+      @lines.clear
+      line 0, "# Generated by tools/generate_bindings.rb from #{@source_name}. Do not edit."
+      line 0, "require_relative '../../xcb_complete'"
+      line 0, "require_relative '../request_encoder'"
+      @protocol.imports.each { |header| line 0, "require_relative '#{header}'" }
+      line 0, "require_relative 'xproto'" if @protocol.extension? && !@protocol.imports.include?('xproto')
+      line 0
+      line 0, "module XCB"
+      line 1, "module Proto"
+      depth = 2
+      if @protocol.extension?
+        line 2, "module #{Emitter.camel(@protocol.header)}"
+        depth = 3
+      end
+      @depth = depth
+      
+      emit_library
+      emit_enums
+      emit_structs
+      emit_events
+      emit_errors
+      emit_requests
+      emit_encoders
+      
+      (depth - 1).downto(0) { |d| line d, "end" }
+      line 0
+      line 0, "XCB::RequestEncoder.include(#{module_path}::Encoders)"
+      @lines.join("\n") + "\n"
+    end
+    
+    private
+    
+    # Blank lines keep the indentation, like the rest of the tree
+    def line(depth, text = nil)
+      @lines << "#{'  ' * depth}#{text}"
+    end
+    
+    def l(text = nil, indent: 0)
+      line(@depth + indent, text)
+    end
+    
+    def emit_library
+      l "extend FFI::Library"
+      l "extend XCB::LazyBinding"
+      l
+      l "ffi_lib '#{library}'"
+      l
+      if @protocol.extension?
+        l "ID = ffi_libraries.first.find_variable('#{prefix}id')"
+        l "XNAME = '#{@protocol.extension_xname}'"
+        l
+      end
+    end
+    
+    def emit_enums
+      return if @protocol.enums.empty?
+      
+      l "# === ENUMS ==="
+      l
+      @protocol.enums.each do |enum|
+        enum.items.each do |item, value|
+          name = "#{Emitter.snake(enum.name).upcase}_#{Emitter.snake(item).upcase}"
+          next if @constants.key?(name)
+          
+          @constants[name] = true
+          l "#{name} = #{value}"
+        end
+      end
+      l
+    end
+    
+    def emit_structs
+      l "# === STRUCTS ==="
+      l
+      @protocol.structs.each do |struct|
+        layout = Layout.new(struct.items, :struct)
+        next if layout.slots.empty?
+        
+        l "# #{struct.name}#{struct.size ? " (#{struct.size} bytes)" : ', fixed part'}"
+        emit_struct_class(Emitter.camel(struct.name), layout)
+      end
+    end
+    
+    def emit_events
+      return if @protocol.events.empty?
+      
+      l "# === EVENTS ==="
+      l
+      classes = []
+      generic = []
+      @protocol.events.each do |event|
+        layout = Layout.new(event.items, event.xge ? :xge_event : :event, no_sequence: event.no_sequence)
+        name = "#{Emitter.camel(event.name)}Event"
+        l "# #{event.name} (#{event.xge ? 'generic event type' : 'event'} #{event.number})"
+        emit_struct_class(name, layout, constants: { 'NUMBER' => event.number })
+        (event.xge ? generic : classes) << [event.number, name]
+      end
+      
+      numbering = @protocol.extension? ? "relative to first_event" : "by response_type"
+      l "# Event structs #{numbering}"
+      emit_hash('EVENTS', classes)
+      unless generic.empty?
+        l "# Generic (XGE) event structs by event_type"
+        emit_hash('GENERIC_EVENTS', generic)
+      end
+    end
+    
+    def emit_errors
+      return if @protocol.errors.empty?
+      
+      l "# Error names by error code#{@protocol.extension? ? ' relative to first_error' : ''}"
+      emit_hash('ERRORS', @protocol.errors.map { |name, number| [number, name.inspect] })
+    end
+    
+    def emit_hash(name, pairs)
+      if pairs.empty?
+        l "#{name} = {}.freeze"
+      else
+        l "#{name} = {"
+        pairs.each_with_index do |(key, value), i|
+          l "#{key} => #{value}#{i == pairs.size - 1 ? '' : ','}", indent: 1
+        end
+        l "}.freeze"
+      end
+      l
+    end
+    
+    def emit_requests
+      l "# === REQUESTS ==="
+      l
+      @protocol.requests.each do |request|
+        function = "#{prefix}#{Emitter.snake(request.name)}"
+        l "# #{request.name} (opcode #{request.opcode})"
+        l "attach_function :#{function}, [#{c_arguments(request).join(', ')}], #{request.reply ? ':uint32' : 'VoidCookie'}"
+        emit_reply(request, function) if request.reply
+        l
+      end
+      l "OPCODES = {"
+      @protocol.requests.each_with_index do |request, i|
+        l "#{Emitter.snake(request.name)}: #{request.opcode}#{i == @protocol.requests.size - 1 ? '' : ','}", indent: 1
+      end
+      l "}.freeze"
+      l
+    end
+    
+    def emit_reply(request, function)
+      layout = Layout.new(request.reply, :reply)
+      name = "#{Emitter.camel(request.name)}Reply"
+      l "attach_function :#{function}_reply, [:pointer, :uint32, :pointer], :pointer"
+      l
+      emit_struct_class(name, layout, list: reply_list(layout))
+      l "# Typed reply (freed with the struct), nil on error"
+      l "def self.#{Emitter.snake(request.name)}_reply(conn, cookie)"
+      l "reply = #{function}_reply(conn, cookie, nil)", indent: 1
+      l "reply.null? ? nil : #{name}.new(FFI::AutoPointer.new(reply, XCB::LibC.method(:free)))", indent: 1
+      l "end"
+    end
+    
+    # The first variable-length list of a reply, read in place
+    def reply_list(layout)
+      list = layout.tail.first
+      return nil unless list.is_a?(List) && list.type.size
+      
+      count = case list.length
+              when nil then "(32 + self[:length] * 4 - #{layout.tail_offset}) / #{list.type.size}"
+              when Array
+                return nil unless layout.field(list.length[1])
+                
+                "self[:#{list.length[1]}]"
+              else return nil
+              end
+      [list, layout.tail_offset, count]
+    end
+    
+    def emit_struct_class(name, layout, constants: {}, list: nil)
+      l "class #{name} < FFI::Struct"
+      constants.each { |key, value| l "#{key} = #{value}", indent: 1 }
+      l "SIZE = #{layout.size}", indent: 1
+      l
+      layout.slots.each_with_index do |slot, i|
+        lead = i.zero? ? "layout " : "       "
+        tail = i == layout.slots.size - 1 ? "" : ","
+        l "#{lead}#{slot.name.to_sym.inspect}, #{ffi_type(slot)}, #{slot.offset}#{tail}", indent: 1
+      end
+      emit_list_reader(*list) if list
+      l "end"
+      l
+    end
+    
+    def emit_list_reader(list, offset, count)
+      l
+      l "# #{list.name}: #{count.sub(/\Aself\[:(\w+)\]\z/, '\1')} x #{list.type.name || list.type.class.name} at byte #{offset}", indent: 1
+      l "def #{ruby_name(list.name)}", indent: 1
+      case list.type
+      when Primitive
+        if list.type.ffi == :char
+          l "pointer.get_bytes(#{offset}, #{count})", indent: 2
+        else
+          l "pointer.get_array_of_#{list.type.ffi}(#{offset}, #{count})", indent: 2
+        end
+      else
+        klass = class_ref(list.type)
+        l "Array.new(#{count}) { |i| #{klass}.new(pointer + #{offset} + i * #{list.type.size}) }", indent: 2
+      end
+      l "end", indent: 1
+    end
+    
+    def ffi_type(slot)
+      base = case slot.type
+             when Primitive then slot.type.ffi.inspect
+             when Composite then class_ref(slot.type)
+             when Union then "[:uint8, #{slot.type.size}]"
+             end
+      slot.count > 1 ? "[#{base}, #{slot.count}]" : base
+    end
+    
+    def class_ref(type)
+      owner = type.module_name == 'xproto' ? "XCB::Proto" : "XCB::Proto::#{Emitter.camel(type.module_name)}"
+      "#{owner}::#{Emitter.camel(type.name)}"
+    end
+    
+    def c_arguments(request)
+      args = [':pointer']
+      request.items.each do |item|
+        case item
+        when Field
+          args << case item.type
+                  when Primitive then item.type.ffi.inspect
+                  when Composite then "#{class_ref(item.type)}.by_value"
+                  else ':pointer'
+                  end
+        when List
+          args << ':uint32' if item.length.nil?
+          args << ':pointer'
+        when ValueList
+          args << item.mask_type.ffi.inspect unless item.mask_in_body
+          args << ':pointer'
+        when Switch then args << ':pointer'
+        when Fd then args << ':int32'
+        end
+      end
+      args
+    end
+    
+    # === ENCODERS ===
+    
+    def emit_encoders
+      l "# Direct encoders for XCB::RequestEncoder: arguments go straight"
+      l "# into the request buffer, list lengths are derived from the lists"
+      l "module Encoders"
+      @depth += 1
+      @protocol.requests.each { |request| emit_encoder(request) }
+      l "private"
+      l
+      l "def pack_list(list, directive)"
+      l "return list.b if list.is_a?(String)", indent: 1
+      l
+      l "list.flatten.pack(directive * list.size)", indent: 1
+      l "end"
+      if @protocol.extension?
+        l
+        l "def #{Emitter.snake(@protocol.header)}_major_opcode"
+        l "@#{Emitter.snake(@protocol.header)}_major_opcode ||= @connection.require_extension(#{module_path}::ID, XNAME)[:major_opcode]", indent: 1
+        l "end"
+      end
+      @depth -= 1
+      l "end"
+    end
+    
+    def emit_encoder(request)
+      layout = Layout.new(request.items, @protocol.extension? ? :request_ext : :request_core)
+      return if request.items.any? { |item| item.is_a?(ExprField) || item.is_a?(Fd) }
+      return unless layout.body_slots.all? { |slot| slot.type.is_a?(Primitive) && slot.count == 1 }
+      
+      tail = layout.tail.reject { |item| item.is_a?(Pad) && item.align }
+      return if tail.size > 1
+      return if (list = tail.first) && !encodable_list?(list, layout)
+      
+      computed = list.is_a?(List) && list.length.is_a?(Array) ? list.length[1] : nil
+      data_slot = layout.body_slots.find { |slot| slot.offset == 1 }
+      params = layout.body_slots.map(&:name).reject { |name| name == computed }
+      params << (list.is_a?(ValueList) ? list.list_name : list.name) if list
+      variable = list && ruby_name(params.last)
+      
+      l "# #{request.name}"
+      l "def encode_#{encoder_prefix}#{Emitter.snake(request.name)}(#{params.map { |p| ruby_name(p) }.join(', ')})"
+      case list
+      when List
+        element = element_directive(list.type)
+        l "#{variable} = pack_list(#{variable}, '#{element}')", indent: 1
+        l "#{ruby_name(computed)} = #{variable}.bytesize / #{list.type.size}", indent: 1 if computed
+      when ValueList
+        l "#{variable} = #{variable}.pack('L*')", indent: 1
+      end
+      body = layout.size - 4
+      size = list ? "#{body} + #{variable}.bytesize + -#{variable}.bytesize % 4" : body.to_s
+      opcode = @protocol.extension? ? "#{Emitter.snake(@protocol.header)}_major_opcode" : request.opcode
+      data = if @protocol.extension? then request.opcode
+             elsif data_slot then ruby_name(data_slot.name)
+             else 0
+             end
+      l "start_request(#{opcode}, #{data}, #{size})", indent: 1
+      
+      fields = layout.body_slots.reject { |slot| slot.offset < 4 }
+      unless fields.empty?
+        directive = +""
+        offset = 4
+        fields.each do |slot|
+          directive << "x#{slot.offset - offset}" if slot.offset > offset
+          directive << slot.type.pack
+          offset = slot.offset + slot.type.size
+        end
+        directive << "x#{layout.size - offset}" if layout.size > offset
+        l "[#{fields.map { |slot| ruby_name(slot.name) }.join(', ')}].pack('#{directive}', buffer: @buffer)", indent: 1
+      end
+      if list
+        l "@buffer << #{variable}", indent: 1
+        l "@buffer << XCB::RequestEncoder::PADDING[-#{variable}.bytesize % 4]", indent: 1
+      end
+      l "self", indent: 1
+      l "end"
+      l
+    end
+    
+    # Encoders of every module end up in RequestEncoder
+    def encoder_prefix
+      @protocol.extension? ? "#{Emitter.snake(@protocol.header)}_" : ""
+    end
+    
+    def encodable_list?(list, layout)
+      case list
+      when ValueList then true
+      when List
+        return false unless list.type.size && element_directive(list.type)
+        
+        list.length.nil? || (list.length.is_a?(Array) && layout.field(list.length[1]))
+      else false
+      end
+    end
+    
+    def element_directive(type)
+      case type
+      when Primitive then type.pack
+      when Composite
+        type.items.map do |item|
+          case item
+          when Field then item.type.is_a?(Primitive) ? item.type.pack : (return nil)
+          when Pad then "x#{item.bytes || (return nil)}"
+          else return nil
+          end
+        end.join
+      end
+    end
+    
+    def ruby_name(name)
+      RUBY_KEYWORDS.include?(name) ? "#{name}_" : name
+    end
+  end
+end
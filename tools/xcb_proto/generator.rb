@@ -0,0 +1,54 @@
+require 'fileutils'
+require_relative 'emitter'
+
+module XCBProto
+  # Protocol modules generated by default: everything whose layouts the
+  # wrapper reads (see XCB::Proto.wire_layout)
+  DEFAULT_MODULES = %w[xproto render shm present xinput damage xfixes].freeze
+  
+  # xcb-proto XML directory: the given one, pkg-config's, or the usual
+  # install path; nil when xproto.xml is not there
+  def self.proto_dir(explicit = nil)
+    dir = explicit || ENV['XCB_PROTO_DIR']
+    dir = `pkg-config --variable=xcbincludedir xcb-proto 2>/dev/null`.strip if dir.nil? || dir.empty?
+    dir = '/usr/share/xcb' if dir.empty?
+    File.exist?(File.join(dir, 'xproto.xml')) ? dir : nil
+  rescue SystemCallError
+    File.exist?('/usr/share/xcb/xproto.xml') ? '/usr/share/xcb' : nil
+  end
+  
+  # Writes one file per module (and the modules they import) to output;
+  # yields each generated protocol. Modules missing from proto_dir raise
+  def self.generate(proto_dir, modules, output)
+    registry = {}
+    load_module = lambda do |header|
+      return registry[header] if registry[header]
+      
+      path = File.join(proto_dir, "#{header}.xml")
+      raise ArgumentError, "#{path} not found" unless File.exist?(path)
+      
+      # Imports are loaded (and generated) before the modules that use them
+      REXML::Document.new(File.read(path)).root.get_elements('import').each { |i| load_module.call(i.text) }
+      Protocol.load(path, registry)
+    end
+    
+    FileUtils.mkdir_p(output)
+    generated = []
+    modules.each do |header|
+      load_module.call(header)
+      registry.each_value do |protocol|
+        next if generated.include?(protocol.header)
+        
+        source = Emitter.new(protocol, "#{protocol.header}.xml").emit
+        # Written aside and renamed, so a concurrent require never sees
+        # half a file
+        target = File.join(output, "#{protocol.header}.rb")
+        File.write("#{target}.#{Process.pid}", source)
+        File.rename("#{target}.#{Process.pid}", target)
+        generated << protocol.header
+        yield protocol if block_given?
+      end
+    end
+    generated
+  end
+end
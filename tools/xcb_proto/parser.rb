@@ -0,0 +1,208 @@
+require 'rexml/document'
+
+module XCBProto
+  # Wire types. pack is the Array#pack directive, ffi the FFI type
+  Primitive = Struct.new(:name, :size, :ffi, :pack)
+  
+  PRIMITIVES = {
+    'CARD8' => [1, :uint8, 'C'], 'INT8' => [1, :int8, 'c'], 'BYTE' => [1, :uint8, 'C'],
+    'BOOL' => [1, :uint8, 'C'], 'char' => [1, :char, 'C'], 'void' => [1, :uint8, 'C'],
+    'CARD16' => [2, :uint16, 'S'], 'INT16' => [2, :int16, 's'],
+    'CARD32' => [4, :uint32, 'L'], 'INT32' => [4, :int32, 'l'],
+    'CARD64' => [8, :uint64, 'Q'], 'INT64' => [8, :int64, 'q'],
+    'float' => [4, :float, 'f'], 'double' => [8, :double, 'd'], 'fd' => [4, :int32, 'l']
+  }.to_h { |name, (size, ffi, pack)| [name, Primitive.new(name, size, ffi, pack)] }.freeze
+  
+  XID = Primitive.new('XID', 4, :uint32, 'L')
+  
+  # Body items of structs, requests, replies and events
+  Field = Struct.new(:name, :type)
+  Pad = Struct.new(:bytes, :align)
+  # length: nil (runs to the end), Integer, [:fieldref, name] or :expr
+  List = Struct.new(:name, :type, :length)
+  ExprField = Struct.new(:name, :type)
+  # valueparam, or a switch whose bitcases are all 4-byte values
+  ValueList = Struct.new(:mask_name, :mask_type, :list_name, :mask_in_body)
+  Switch = Struct.new(:name)
+  Fd = Struct.new(:name)
+  
+  Composite = Struct.new(:kind, :name, :items, :module_name) do
+    def size
+      return @size if defined?(@size)
+      
+      @size = items.sum do |item|
+        case item
+        when Field then item.type.size || (return @size = nil)
+        when Pad then item.bytes || (return @size = nil)
+        when List
+          return @size = nil unless item.length.is_a?(Integer) && item.type.size
+          
+          item.type.size * item.length
+        else return @size = nil
+        end
+      end
+    end
+  end
+  
+  Union = Struct.new(:name, :members, :module_name) do
+    def size
+      sizes = members.map(&:size)
+      sizes.all? ? sizes.max : nil
+    end
+  end
+  
+  Request = Struct.new(:name, :opcode, :items, :reply)
+  Event = Struct.new(:name, :number, :items, :no_sequence, :xge)
+  Enum = Struct.new(:name, :items)
+  
+  # One xcb-proto XML file
+  class Protocol
+    attr_reader :header, :extension_name, :extension_xname, :imports, :requests, :events,
+                :structs, :enums, :errors
+    
+    def self.load(path, registry)
+      new(REXML::Document.new(File.read(path)).root, registry)
+    end
+    
+    def initialize(root, registry)
+      @registry = registry
+      @header = root.attributes['header']
+      @extension_name = root.attributes['extension-name']
+      @extension_xname = root.attributes['extension-xname']
+      @imports = root.get_elements('import').map(&:text)
+      @types = {}
+      @requests = []
+      @events = []
+      @structs = []
+      @enums = []
+      @errors = []
+      registry[@header] = self
+      parse(root)
+    end
+    
+    def extension?
+      !@extension_name.nil?
+    end
+    
+    # Type by XML name; "xproto:WINDOW" looks only in that module
+    def lookup(name)
+      if name.include?(':')
+        header, name = name.split(':', 2)
+        return @registry.fetch(header).lookup(name)
+      end
+      PRIMITIVES[name] || @types[name] || resolve_import(name) ||
+        raise(ArgumentError, "#{@header}: unknown type #{name}")
+    end
+    
+    protected
+    
+    def own_type(name)
+      @types[name]
+    end
+    
+    private
+    
+    def resolve_import(name)
+      @imports.each do |header|
+        type = @registry.fetch(header).own_type(name)
+        return type if type
+      end
+      nil
+    end
+    
+    def parse(root)
+      root.elements.each do |element|
+        case element.name
+        when 'xidtype' then @types[element.attributes['name']] = XID
+        when 'xidunion' then @types[element.attributes['name']] = XID
+        when 'typedef' then @types[element.attributes['newname']] = lookup(element.attributes['oldname'])
+        when 'struct'
+          struct = Composite.new(:struct, element.attributes['name'], items(element), @header)
+          @types[struct.name] = struct
+          @structs << struct
+        when 'union'
+          members = element.elements.to_a.select { |e| %w[field list].include?(e.name) }.map do |e|
+            list = items_of([e]).first
+            list.is_a?(List) ? Composite.new(:struct, list.name, [list], @header) : list.type
+          end
+          @types[element.attributes['name']] = Union.new(element.attributes['name'], members, @header)
+        when 'enum' then @enums << enum(element)
+        when 'request' then @requests << request(element)
+        when 'event' then @events << event(element)
+        when 'eventcopy'
+          original = @events.find { |e| e.name == element.attributes['ref'] }
+          @events << Event.new(element.attributes['name'], element.attributes['number'].to_i,
+                               original.items, original.no_sequence, original.xge)
+        when 'error'
+          @errors << [element.attributes['name'], element.attributes['number'].to_i]
+        when 'errorcopy'
+          @errors << [element.attributes['name'], element.attributes['number'].to_i]
+        end
+      end
+    end
+    
+    def enum(element)
+      values = element.get_elements('item').map do |item|
+        value = item.elements['value']&.text&.to_i
+        bit = item.elements['bit']&.text&.to_i
+        [item.attributes['name'], value || (bit && 1 << bit) || 0]
+      end
+      Enum.new(element.attributes['name'], values)
+    end
+    
+    def request(element)
+      reply = element.elements['reply']
+      Request.new(element.attributes['name'], element.attributes['opcode'].to_i, items(element),
+                  reply && items(reply))
+    end
+    
+    def event(element)
+      Event.new(element.attributes['name'], element.attributes['number'].to_i, items(element),
+                element.attributes['no-sequence-number'] == 'true', element.attributes['xge'] == 'true')
+    end
+    
+    def items(element)
+      items_of(element.elements.to_a)
+    end
+    
+    def items_of(elements)
+      elements.filter_map do |e|
+        case e.name
+        when 'field' then Field.new(e.attributes['name'], lookup(e.attributes['type']))
+        when 'pad'
+          Pad.new(e.attributes['bytes']&.to_i, e.attributes['align']&.to_i)
+        when 'list' then List.new(e.attributes['name'], lookup(e.attributes['type']), list_length(e))
+        when 'exprfield' then ExprField.new(e.attributes['name'], lookup(e.attributes['type']))
+        when 'valueparam'
+          ValueList.new(e.attributes['value-mask-name'], lookup(e.attributes['value-mask-type']),
+                        e.attributes['value-list-name'], false)
+        when 'switch' then switch(e)
+        when 'fd' then Fd.new(e.attributes['name'])
+        end
+      end
+    end
+    
+    def list_length(element)
+      expression = element.elements.to_a.first
+      return nil unless expression
+      return expression.text.to_i if expression.name == 'value'
+      return [:fieldref, expression.text] if expression.name == 'fieldref'
+      
+      :expr
+    end
+    
+    # Core-style value lists (CreateWindow, ConfigureWindow, CreateGC ...)
+    # become a mask field plus an array of CARD32
+    def switch(element)
+      mask = element.elements['fieldref']&.text
+      cases = element.get_elements('bitcase')
+      uniform = cases.all? do |bitcase|
+        fields = bitcase.elements.to_a.select { |e| e.name == 'field' }
+        fields.size == 1 && lookup(fields.first.attributes['type']).size == 4
+      end
+      return Switch.new(element.attributes['name']) unless mask && uniform
+      
+      ValueList.new(mask, nil, element.attributes['name'], true)
+    end
+  end
+end